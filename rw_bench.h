@@ -0,0 +1,806 @@
+/*
+  FILE: rw_bench.h
+  VERSION: 0.3.0
+  DESCRIPTION: Microbenchmark harness (warmup, auto-scaled iterations, robust statistics, JSON/CSV output).
+  AUTHOR: Raymond Wan
+  DEPENDENCIES: rw_time.h
+  USAGE: Simply including the file will only give you declarations (see __API)
+    To include the implementation,
+      #define RWBN_IMPLEMENTATION
+
+    A benchmark is a function that runs the code being measured a given number of times.
+    Results must be passed to RWBN_DO_NOT_OPTIMIZE so the compiler can't remove the work, e.g.
+
+      static void bench_v3_dot(void *user_data, uint64_t iterations) {
+        Vec3 *v = (Vec3 *) user_data;
+        for (uint64_t i = 0; i < iterations; i++) {
+          float d = rwm_v3_dot(v[i & 255], v[(i + 1) & 255]);
+          RWBN_DO_NOT_OPTIMIZE(d);
+        }
+      }
+
+      int main(int argc, char **argv) {
+        rwbn_add("v3/dot", bench_v3_dot, vectors);
+        return rwbn_main(argc, argv);
+      }
+
+    Every benchmark first runs for warmup_ns, then the number of iterations per sample is
+    scaled up until one sample takes at least min_sample_ns. The reported statistics are
+    per iteration over num_samples samples: median, median absolute deviation (MAD),
+    percentiles, mean, min and max. rwbn_main prints a table (counters are per iteration too) and takes the options
+      --filter <text>   only run benchmarks whose name contains text
+      --json <path>     also write the results as JSON (- for stdout)
+      --csv <path>      also write the results as CSV (- for stdout)
+      --samples <n>     samples per benchmark (at most RWBN_MAX_SAMPLES)
+      --counters        also read the hardware performance counters
+      --save-baseline <path>  write the results as a baseline (the same JSON as --json)
+      --baseline <path>       compare against a saved baseline, exits with 1 on regressions
+      --threshold <percent>   smallest change of the median reported as a regression (default 5)
+
+    On Linux, hardware counters (cycles, instructions, L1 data/last level cache, branch and
+    data TLB misses) can be read through perf_event_open while the samples run and are
+    reported per iteration along with the instructions per cycle. Counters the CPU, kernel
+    or perf_event_paranoid setting don't allow are reported as unavailable (negative) and
+    the timings are unaffected. To leave perf_event_open out entirely,
+      #define RWBN_NO_COUNTERS
+
+    A benchmark counts as slower (or faster) than its baseline when its median changed by
+    more than the threshold and a two sided Mann-Whitney U test on the samples of both runs
+    says the change is significant (p < RWBN_SIGNIFICANCE). Compare runs made on the same
+    machine, build flags and load.
+
+    The implementation of rw_time.h must be compiled somewhere in your program.
+    Defining RWTM_USE_TSC for it makes the timer overhead negligible on x86.
+
+  NOTE(ray): To quickly navigate through the file,
+             sections and/or subsections are available to jump to.
+  SECTIONS:
+    1. __TYPES
+    2. __API
+    3. __MACROS
+    4. __IMPLEMENTATION
+      4.1. __STATS
+      4.2. __COUNTERS
+      4.3. __RUN
+      4.4. __OUTPUT
+      4.5. __COMPARE
+      4.6. __MAIN
+*/
+
+#ifndef __RW_BENCH_H__
+#define __RW_BENCH_H__
+
+#if defined(RWBN_STATIC)
+  #define RWBN_DEF static
+#elif defined(RWBN_HEADER_ONLY)
+  #define RWBN_DEF static inline
+#else
+  #define RWBN_DEF extern
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// __TYPES
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+#include <stdio.h>
+#include "rw_time.h"
+
+#ifndef RWBN_MAX_SAMPLES
+#define RWBN_MAX_SAMPLES 64
+#endif
+#ifndef RWBN_MAX_BENCHMARKS
+#define RWBN_MAX_BENCHMARKS 256
+#endif
+// p value below which a difference from the baseline is significant
+#ifndef RWBN_SIGNIFICANCE
+#define RWBN_SIGNIFICANCE 0.01
+#endif
+
+// Runs the measured code iterations times
+typedef void rwbn_func(void *user_data, uint64_t iterations);
+
+typedef enum rwbn_counter {
+  RWBN_COUNTER_CYCLES,
+  RWBN_COUNTER_INSTRUCTIONS,
+  RWBN_COUNTER_L1D_MISSES,
+  RWBN_COUNTER_LLC_MISSES,
+  RWBN_COUNTER_BRANCH_MISSES,
+  RWBN_COUNTER_DTLB_MISSES,
+  RWBN_NUM_COUNTERS,
+} rwbn_counter;
+
+typedef struct rwbn_config {
+  uint64_t warmup_ns;
+  uint64_t min_sample_ns;
+  int num_samples;
+  bool counters; // read the hardware counters
+} rwbn_config;
+
+// All times are nanoseconds per iteration
+typedef struct rwbn_result {
+  const char *name;
+  uint64_t iterations; // per sample
+  int num_samples;
+  double samples[RWBN_MAX_SAMPLES]; // in the order they were measured
+  double median;
+  double mad; // median of |sample - median|, not scaled to a standard deviation
+  double p10;
+  double p90;
+  double p99;
+  double mean;
+  double min;
+  double max;
+  // Per iteration over all the samples, negative if unavailable
+  double counters[RWBN_NUM_COUNTERS];
+  double ipc; // instructions per cycle, negative if unavailable
+} rwbn_result;
+
+typedef enum rwbn_verdict {
+  RWBN_SAME,
+  RWBN_FASTER,
+  RWBN_SLOWER,
+} rwbn_verdict;
+
+typedef struct rwbn_comparison {
+  double delta; // relative change of the median, (result - baseline) / baseline
+  double p_value; // two sided Mann-Whitney U test of the samples
+  rwbn_verdict verdict;
+} rwbn_comparison;
+
+///////////////////////////////////////////////////////////////////////////////
+// __API
+///////////////////////////////////////////////////////////////////////////////
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 10ms warmup, 31 samples of at least 1ms, no counters
+RWBN_DEF rwbn_config rwbn_default_config();
+// Measures a single benchmark, config can be NULL for the defaults
+RWBN_DEF void rwbn_run(const char *name, rwbn_func *func, void *user_data, const rwbn_config *config,
+                       rwbn_result *result);
+// Fills in the statistics of result from its samples
+RWBN_DEF void rwbn_compute_stats(rwbn_result *result);
+// Linear interpolation between the closest ranks of sorted, q in [0, 1]
+RWBN_DEF double rwbn_percentile(const double *sorted, int count, double q);
+
+// Opens the hardware counters the first time it is called (rwbn_run does so when asked to),
+// returns true if any of them can be read
+RWBN_DEF bool rwbn_counters_open();
+RWBN_DEF bool rwbn_counter_available(rwbn_counter counter);
+// Short name used in the output, e.g. "l1d_misses"
+RWBN_DEF const char *rwbn_counter_name(rwbn_counter counter);
+
+RWBN_DEF void rwbn_write_json(FILE *f, const rwbn_result *results, int count);
+RWBN_DEF void rwbn_write_csv(FILE *f, const rwbn_result *results, int count);
+// Reads back the names and samples written by rwbn_write_json and recomputes the statistics,
+// returns how many results were read (-1 if f isn't a results file). Names are allocated
+// with malloc and owned by the caller.
+RWBN_DEF int rwbn_read_json(FILE *f, rwbn_result *results, int max_results);
+
+// Two sided p value of a Mann-Whitney U test (normal approximation, corrected for ties)
+RWBN_DEF double rwbn_mann_whitney(const double *a, int count_a, const double *b, int count_b);
+// threshold is the smallest relative change of the median that counts, e.g. 0.05
+RWBN_DEF rwbn_comparison rwbn_compare(const rwbn_result *baseline, const rwbn_result *result, double threshold);
+
+// Registers a benchmark for rwbn_main, name must live for the whole program
+RWBN_DEF void rwbn_add(const char *name, rwbn_func *func, void *user_data);
+// Runs the registered benchmarks (see USAGE for the options). Returns 0, 1 if a benchmark got
+// slower than the baseline or a file could not be written, 2 for bad options or baseline.
+RWBN_DEF int rwbn_main(int argc, char **argv);
+
+#ifdef __cplusplus
+}
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// __MACROS
+///////////////////////////////////////////////////////////////////////////////
+
+// NOTE(ray): The address of value escapes to an empty asm block that also clobbers memory,
+// so the compiler has to assume value is read and anything in memory may have changed.
+// value must be an lvalue.
+#if defined(_MSC_VER)
+#include <intrin.h>
+static inline void rwbn__escape(const void *p) {
+  static const void *volatile sink;
+  sink = p;
+  _ReadWriteBarrier();
+}
+#define RWBN_CLOBBER_MEMORY() _ReadWriteBarrier()
+#else
+static inline void rwbn__escape(const void *p) {
+  __asm__ __volatile__("" : : "g"(p) : "memory");
+}
+#define RWBN_CLOBBER_MEMORY() __asm__ __volatile__("" : : : "memory")
+#endif
+#define RWBN_DO_NOT_OPTIMIZE(value) rwbn__escape(&(value))
+
+
+///////////////////////////////////////////////////////////////////////////////
+// __IMPLEMENTATION
+///////////////////////////////////////////////////////////////////////////////
+
+#if defined(RWBN_IMPLEMENTATION) || defined(RWBN_HEADER_ONLY)
+
+#include <math.h> // erfc, fabs, sqrt
+#include <stdlib.h> // atof, atoi, malloc, qsort, strtod
+#include <string.h> // memset, strcmp, strstr
+
+#if defined(__linux__) && !defined(RWBN_NO_COUNTERS)
+#define RWBN__COUNTERS_AVAILABLE
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define RWBN__DEFAULT_WARMUP_NS 10000000
+#define RWBN__DEFAULT_MIN_SAMPLE_NS 1000000
+#define RWBN__DEFAULT_NUM_SAMPLES 31
+
+typedef struct rwbn__Benchmark {
+  const char *name;
+  rwbn_func *func;
+  void *user_data;
+} rwbn__Benchmark;
+
+static rwbn__Benchmark rwbn__benchmarks[RWBN_MAX_BENCHMARKS];
+static int rwbn__num_benchmarks;
+
+RWBN_DEF rwbn_config rwbn_default_config() {
+  rwbn_config config;
+  config.warmup_ns = RWBN__DEFAULT_WARMUP_NS;
+  config.min_sample_ns = RWBN__DEFAULT_MIN_SAMPLE_NS;
+  config.num_samples = RWBN__DEFAULT_NUM_SAMPLES;
+  config.counters = false;
+  return config;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// __STATS
+///////////////////////////////////////////////////////////////////////////////
+
+static int rwbn__compare_double(const void *a, const void *b) {
+  double x = *(const double *) a, y = *(const double *) b;
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+RWBN_DEF double rwbn_percentile(const double *sorted, int count, double q) {
+  if (count <= 0) return 0.0;
+  double rank = q * (count - 1);
+  int lo = (int) rank;
+  if (lo >= count - 1) return sorted[count - 1];
+  double t = rank - lo;
+  return sorted[lo] + t * (sorted[lo + 1] - sorted[lo]);
+}
+
+RWBN_DEF void rwbn_compute_stats(rwbn_result *result) {
+  int n = result->num_samples;
+  if (n <= 0) return;
+  double sorted[RWBN_MAX_SAMPLES];
+  double sum = 0.0;
+  for (int i = 0; i < n; i++) {
+    sorted[i] = result->samples[i];
+    sum += sorted[i];
+  }
+  qsort(sorted, n, sizeof(double), rwbn__compare_double);
+  result->median = rwbn_percentile(sorted, n, 0.5);
+  result->p10 = rwbn_percentile(sorted, n, 0.1);
+  result->p90 = rwbn_percentile(sorted, n, 0.9);
+  result->p99 = rwbn_percentile(sorted, n, 0.99);
+  result->mean = sum / n;
+  result->min = sorted[0];
+  result->max = sorted[n - 1];
+
+  double deviations[RWBN_MAX_SAMPLES];
+  for (int i = 0; i < n; i++) deviations[i] = fabs(sorted[i] - result->median);
+  qsort(deviations, n, sizeof(double), rwbn__compare_double);
+  result->mad = rwbn_percentile(deviations, n, 0.5);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// __COUNTERS
+///////////////////////////////////////////////////////////////////////////////
+
+static const char *rwbn__counter_names[RWBN_NUM_COUNTERS] = {
+  "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses", "dtlb_misses",
+};
+
+typedef struct rwbn__CounterValues {
+  uint64_t value[RWBN_NUM_COUNTERS];
+  uint64_t enabled[RWBN_NUM_COUNTERS];
+  uint64_t running[RWBN_NUM_COUNTERS];
+} rwbn__CounterValues;
+
+static bool rwbn__counters_opened;
+static int rwbn__counter_fds[RWBN_NUM_COUNTERS];
+
+RWBN_DEF const char *rwbn_counter_name(rwbn_counter counter) {
+  return counter >= 0 && counter < RWBN_NUM_COUNTERS ? rwbn__counter_names[counter] : "unknown";
+}
+
+RWBN_DEF bool rwbn_counter_available(rwbn_counter counter) {
+  return rwbn__counters_opened && counter >= 0 && counter < RWBN_NUM_COUNTERS && rwbn__counter_fds[counter] >= 0;
+}
+
+#if defined(RWBN__COUNTERS_AVAILABLE)
+static int rwbn__perf_open(uint32_t type, uint64_t config) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  // NOTE(ray): Counters are opened on their own instead of as one group, so one the CPU doesn't
+  // have doesn't take the others with it. If the kernel has to multiplex them, the enabled and
+  // running times are used to scale the counts.
+  attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static uint64_t rwbn__perf_cache(uint64_t cache) {
+  return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+#endif
+
+RWBN_DEF bool rwbn_counters_open() {
+  if (!rwbn__counters_opened) {
+    rwbn__counters_opened = true;
+    for (int i = 0; i < RWBN_NUM_COUNTERS; i++) rwbn__counter_fds[i] = -1;
+#if defined(RWBN__COUNTERS_AVAILABLE)
+    rwbn__counter_fds[RWBN_COUNTER_CYCLES] = rwbn__perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    rwbn__counter_fds[RWBN_COUNTER_INSTRUCTIONS] = rwbn__perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    rwbn__counter_fds[RWBN_COUNTER_L1D_MISSES] =
+        rwbn__perf_open(PERF_TYPE_HW_CACHE, rwbn__perf_cache(PERF_COUNT_HW_CACHE_L1D));
+    rwbn__counter_fds[RWBN_COUNTER_LLC_MISSES] = rwbn__perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    rwbn__counter_fds[RWBN_COUNTER_BRANCH_MISSES] = rwbn__perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    rwbn__counter_fds[RWBN_COUNTER_DTLB_MISSES] =
+        rwbn__perf_open(PERF_TYPE_HW_CACHE, rwbn__perf_cache(PERF_COUNT_HW_CACHE_DTLB));
+#endif
+  }
+  for (int i = 0; i < RWBN_NUM_COUNTERS; i++) {
+    if (rwbn__counter_fds[i] >= 0) return true;
+  }
+  return false;
+}
+
+static void rwbn__read_counters(rwbn__CounterValues *values) {
+  memset(values, 0, sizeof(*values));
+#if defined(RWBN__COUNTERS_AVAILABLE)
+  for (int i = 0; i < RWBN_NUM_COUNTERS; i++) {
+    uint64_t data[3];
+    if (rwbn__counter_fds[i] >= 0 && read(rwbn__counter_fds[i], data, sizeof(data)) == (ssize_t) sizeof(data)) {
+      values->value[i] = data[0];
+      values->enabled[i] = data[1];
+      values->running[i] = data[2];
+    }
+  }
+#endif
+}
+
+// Fills in the per iteration counts of result from the values read around its samples
+static void rwbn__counter_results(const rwbn__CounterValues *start, const rwbn__CounterValues *end,
+                                  uint64_t total_iterations, rwbn_result *result) {
+  for (int i = 0; i < RWBN_NUM_COUNTERS; i++) {
+    result->counters[i] = -1.0;
+    uint64_t running = end->running[i] - start->running[i];
+    if (!rwbn_counter_available((rwbn_counter) i) || running == 0 || total_iterations == 0) continue;
+    double scale = (double) (end->enabled[i] - start->enabled[i]) / running;
+    result->counters[i] = scale * (end->value[i] - start->value[i]) / total_iterations;
+  }
+  double cycles = result->counters[RWBN_COUNTER_CYCLES];
+  double instructions = result->counters[RWBN_COUNTER_INSTRUCTIONS];
+  result->ipc = cycles > 0.0 && instructions >= 0.0 ? instructions / cycles : -1.0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// __RUN
+///////////////////////////////////////////////////////////////////////////////
+
+static uint64_t rwbn__time(rwbn_func *func, void *user_data, uint64_t iterations) {
+  uint64_t start = rwtm_now();
+  func(user_data, iterations);
+  return rwtm_since(start);
+}
+
+RWBN_DEF void rwbn_run(const char *name, rwbn_func *func, void *user_data, const rwbn_config *config,
+                       rwbn_result *result) {
+  rwbn_config defaults = rwbn_default_config();
+  if (config == NULL) config = &defaults;
+  rwtm_init();
+
+  // Warmup, growing the batches so short benchmarks aren't dominated by the timer
+  uint64_t iterations = 1;
+  uint64_t warmup_start = rwtm_now();
+  while (rwtm_since(warmup_start) < config->warmup_ns) {
+    uint64_t elapsed = rwbn__time(func, user_data, iterations);
+    if (elapsed < config->min_sample_ns / 10) iterations *= 2;
+  }
+
+  // NOTE(ray): Scale from the warmup batch size until a sample is long enough. Overshoot the
+  // estimate a little so noise doesn't leave samples just under min_sample_ns.
+  for (;;) {
+    uint64_t elapsed = rwbn__time(func, user_data, iterations);
+    if (elapsed >= config->min_sample_ns) break;
+    double scale = elapsed > 0 ? 1.2 * (double) config->min_sample_ns / elapsed : 10.0;
+    if (scale > 10.0) scale = 10.0;
+    uint64_t next = (uint64_t) (iterations * scale);
+    iterations = next > iterations ? next : iterations + 1;
+  }
+
+  int num_samples = config->num_samples;
+  if (num_samples < 1) num_samples = 1;
+  if (num_samples > RWBN_MAX_SAMPLES) num_samples = RWBN_MAX_SAMPLES;
+  result->name = name;
+  result->iterations = iterations;
+  result->num_samples = num_samples;
+  // NOTE(ray): The counters are left running and read once around all the samples,
+  // which only adds a couple of reads to the counts.
+  rwbn__CounterValues start, end;
+  bool counters = config->counters && rwbn_counters_open();
+  if (counters) rwbn__read_counters(&start);
+  for (int i = 0; i < num_samples; i++) {
+    result->samples[i] = (double) rwbn__time(func, user_data, iterations) / iterations;
+  }
+  if (counters) {
+    rwbn__read_counters(&end);
+  } else {
+    memset(&start, 0, sizeof(start));
+    end = start;
+  }
+  rwbn__counter_results(&start, &end, iterations * num_samples, result);
+  rwbn_compute_stats(result);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// __OUTPUT
+///////////////////////////////////////////////////////////////////////////////
+
+static void rwbn__write_json_string(FILE *f, const char *s) {
+  fputc('"', f);
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\') fputc('\\', f);
+    if ((unsigned char) *s >= 0x20) fputc(*s, f);
+  }
+  fputc('"', f);
+}
+
+RWBN_DEF void rwbn_write_json(FILE *f, const rwbn_result *results, int count) {
+  fputs("{\"benchmarks\":[", f);
+  for (int i = 0; i < count; i++) {
+    const rwbn_result *r = &results[i];
+    fputs(i == 0 ? "\n{\"name\":" : ",\n{\"name\":", f);
+    rwbn__write_json_string(f, r->name);
+    fprintf(f, ",\"iterations\":%llu,\"median_ns\":%.4f,\"mad_ns\":%.4f,\"p10_ns\":%.4f,\"p90_ns\":%.4f,"
+               "\"p99_ns\":%.4f,\"mean_ns\":%.4f,\"min_ns\":%.4f,\"max_ns\":%.4f,\"samples_ns\":[",
+            (unsigned long long) r->iterations, r->median, r->mad, r->p10, r->p90, r->p99, r->mean, r->min, r->max);
+    for (int s = 0; s < r->num_samples; s++) {
+      fprintf(f, s == 0 ? "%.4f" : ",%.4f", r->samples[s]);
+    }
+    fputc(']', f);
+    // Only the counters that could be read
+    bool first = true;
+    for (int c = 0; c < RWBN_NUM_COUNTERS; c++) {
+      if (r->counters[c] < 0.0) continue;
+      fprintf(f, "%s\"%s\":%.4f", first ? ",\"counters\":{" : ",", rwbn__counter_names[c], r->counters[c]);
+      first = false;
+    }
+    if (r->ipc >= 0.0) fprintf(f, "%s\"ipc\":%.4f", first ? ",\"counters\":{" : ",", r->ipc);
+    if (!first || r->ipc >= 0.0) fputc('}', f);
+    fputc('}', f);
+  }
+  fputs("\n]}\n", f);
+}
+
+RWBN_DEF void rwbn_write_csv(FILE *f, const rwbn_result *results, int count) {
+  fputs("name,iterations,samples,median_ns,mad_ns,p10_ns,p90_ns,p99_ns,mean_ns,min_ns,max_ns", f);
+  for (int c = 0; c < RWBN_NUM_COUNTERS; c++) fprintf(f, ",%s", rwbn__counter_names[c]);
+  fputs(",ipc\n", f);
+  for (int i = 0; i < count; i++) {
+    const rwbn_result *r = &results[i];
+    // NOTE(ray): Names are quoted in case they contain commas
+    fputc('"', f);
+    for (const char *s = r->name; *s; s++) {
+      if (*s == '"') fputc('"', f);
+      fputc(*s, f);
+    }
+    fprintf(f, "\",%llu,%d,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f", (unsigned long long) r->iterations,
+            r->num_samples, r->median, r->mad, r->p10, r->p90, r->p99, r->mean, r->min, r->max);
+    // Unavailable counters are left empty
+    for (int c = 0; c < RWBN_NUM_COUNTERS; c++) {
+      if (r->counters[c] >= 0.0) {
+        fprintf(f, ",%.4f", r->counters[c]);
+      } else {
+        fputc(',', f);
+      }
+    }
+    if (r->ipc >= 0.0) {
+      fprintf(f, ",%.4f\n", r->ipc);
+    } else {
+      fputs(",\n", f);
+    }
+  }
+}
+
+// Returns the character after the closing quote, or NULL
+static const char *rwbn__read_json_string(const char *p, char **out) {
+  if (*p != '"') return NULL;
+  const char *end = ++p;
+  while (*end && *end != '"') end += end[0] == '\\' && end[1] ? 2 : 1;
+  if (*end != '"') return NULL;
+  char *s = (char *) malloc(end - p + 1);
+  size_t len = 0;
+  for (; p < end; p++) {
+    if (*p == '\\') p++;
+    s[len++] = *p;
+  }
+  s[len] = '\0';
+  *out = s;
+  return end + 1;
+}
+
+RWBN_DEF int rwbn_read_json(FILE *f, rwbn_result *results, int max_results) {
+  size_t size = 0, capacity = 1 << 16;
+  char *text = (char *) malloc(capacity);
+  for (;;) {
+    size += fread(text + size, 1, capacity - size - 1, f);
+    if (size < capacity - 1) break;
+    capacity *= 2;
+    text = (char *) realloc(text, capacity);
+  }
+  text[size] = '\0';
+  if (strstr(text, "{\"benchmarks\":[") != text) {
+    free(text);
+    return -1;
+  }
+
+  // NOTE(ray): Only has to understand what rwbn_write_json writes, every benchmark starts
+  // with its name and has its samples further on.
+  int count = 0;
+  const char *p = text;
+  while (count < max_results && (p = strstr(p, "{\"name\":")) != NULL) {
+    rwbn_result *r = &results[count];
+    memset(r, 0, sizeof(*r));
+    char *name;
+    p = rwbn__read_json_string(p + 8, &name);
+    if (p == NULL) break;
+    const char *next = strstr(p, "{\"name\":");
+    const char *samples = strstr(p, "\"samples_ns\":[");
+    if (samples == NULL || (next && samples > next)) {
+      free(name);
+      continue;
+    }
+    r->name = name;
+    p = samples + 14;
+    while (*p != ']' && r->num_samples < RWBN_MAX_SAMPLES) {
+      char *end;
+      double value = strtod(p, &end);
+      if (end == p) break;
+      r->samples[r->num_samples++] = value;
+      p = *end == ',' ? end + 1 : end;
+    }
+    for (int c = 0; c < RWBN_NUM_COUNTERS; c++) r->counters[c] = -1.0;
+    r->ipc = -1.0;
+    rwbn_compute_stats(r);
+    count++;
+  }
+  free(text);
+  return count;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// __COMPARE
+///////////////////////////////////////////////////////////////////////////////
+
+typedef struct rwbn__RankedSample {
+  double value;
+  int group;
+} rwbn__RankedSample;
+
+static int rwbn__compare_ranked(const void *a, const void *b) {
+  return rwbn__compare_double(&((const rwbn__RankedSample *) a)->value, &((const rwbn__RankedSample *) b)->value);
+}
+
+RWBN_DEF double rwbn_mann_whitney(const double *a, int count_a, const double *b, int count_b) {
+  if (count_a <= 0 || count_b <= 0 || count_a + count_b > 2 * RWBN_MAX_SAMPLES) return 1.0;
+  rwbn__RankedSample all[2 * RWBN_MAX_SAMPLES];
+  int n = count_a + count_b;
+  for (int i = 0; i < count_a; i++) { all[i].value = a[i]; all[i].group = 0; }
+  for (int i = 0; i < count_b; i++) { all[count_a + i].value = b[i]; all[count_a + i].group = 1; }
+  qsort(all, n, sizeof(rwbn__RankedSample), rwbn__compare_ranked);
+
+  // Ties share the average of their ranks
+  double rank_sum_a = 0.0, tie_term = 0.0;
+  for (int i = 0; i < n;) {
+    int j = i;
+    while (j < n && all[j].value == all[i].value) j++;
+    double rank = 0.5 * (i + 1 + j);
+    for (int k = i; k < j; k++) {
+      if (all[k].group == 0) rank_sum_a += rank;
+    }
+    double t = j - i;
+    tie_term += t * t * t - t;
+    i = j;
+  }
+
+  double na = count_a, nb = count_b;
+  double u = rank_sum_a - na * (na + 1.0) / 2.0;
+  double mean = na * nb / 2.0;
+  double variance = na * nb / 12.0 * ((n + 1.0) - tie_term / ((double) n * (n - 1.0)));
+  if (variance <= 0.0) return 1.0;
+  // NOTE(ray): Continuity correction, moves u half a step towards the mean
+  double diff = fabs(u - mean) - 0.5;
+  if (diff < 0.0) diff = 0.0;
+  return erfc(diff / sqrt(2.0 * variance));
+}
+
+RWBN_DEF rwbn_comparison rwbn_compare(const rwbn_result *baseline, const rwbn_result *result, double threshold) {
+  rwbn_comparison c;
+  c.delta = baseline->median > 0.0 ? (result->median - baseline->median) / baseline->median : 0.0;
+  c.p_value = rwbn_mann_whitney(baseline->samples, baseline->num_samples, result->samples, result->num_samples);
+  c.verdict = RWBN_SAME;
+  if (c.p_value < RWBN_SIGNIFICANCE) {
+    if (c.delta > threshold) c.verdict = RWBN_SLOWER;
+    if (c.delta < -threshold) c.verdict = RWBN_FASTER;
+  }
+  return c;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// __MAIN
+///////////////////////////////////////////////////////////////////////////////
+
+RWBN_DEF void rwbn_add(const char *name, rwbn_func *func, void *user_data) {
+  if (rwbn__num_benchmarks == RWBN_MAX_BENCHMARKS) return;
+  rwbn__Benchmark *b = &rwbn__benchmarks[rwbn__num_benchmarks++];
+  b->name = name;
+  b->func = func;
+  b->user_data = user_data;
+}
+
+static bool rwbn__write_file(const char *path, const rwbn_result *results, int count, bool json) {
+  bool to_stdout = strcmp(path, "-") == 0;
+  FILE *f = to_stdout ? stdout : fopen(path, "w");
+  if (f == NULL) {
+    fprintf(stderr, "rw_bench: could not open %s\n", path);
+    return false;
+  }
+  if (json) {
+    rwbn_write_json(f, results, count);
+  } else {
+    rwbn_write_csv(f, results, count);
+  }
+  if (!to_stdout) fclose(f);
+  return true;
+}
+
+static void rwbn__print_counter(FILE *out, const rwbn_result *r, rwbn_counter counter) {
+  if (r->counters[counter] >= 0.0) {
+    fprintf(out, " %10.3f", r->counters[counter]);
+  } else {
+    fprintf(out, " %10s", "-");
+  }
+}
+
+RWBN_DEF int rwbn_main(int argc, char **argv) {
+  rwbn_config config = rwbn_default_config();
+  const char *filter = NULL;
+  const char *json_path = NULL;
+  const char *csv_path = NULL;
+  const char *save_baseline_path = NULL;
+  const char *baseline_path = NULL;
+  double threshold = 0.05;
+  for (int i = 1; i < argc; i++) {
+    const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+    if (strcmp(argv[i], "--counters") == 0) {
+      config.counters = true;
+      continue;
+    }
+    if (strcmp(argv[i], "--filter") == 0 && value) {
+      filter = value;
+    } else if (strcmp(argv[i], "--json") == 0 && value) {
+      json_path = value;
+    } else if (strcmp(argv[i], "--csv") == 0 && value) {
+      csv_path = value;
+    } else if (strcmp(argv[i], "--samples") == 0 && value) {
+      config.num_samples = atoi(value);
+    } else if (strcmp(argv[i], "--save-baseline") == 0 && value) {
+      save_baseline_path = value;
+    } else if (strcmp(argv[i], "--baseline") == 0 && value) {
+      baseline_path = value;
+    } else if (strcmp(argv[i], "--threshold") == 0 && value) {
+      threshold = atof(value) / 100.0;
+    } else {
+      fprintf(stderr, "usage: %s [--filter text] [--json path] [--csv path] [--samples n] [--counters]\n"
+                      "       [--save-baseline path] [--baseline path] [--threshold percent]\n", argv[0]);
+      return 2;
+    }
+    i++;
+  }
+  if (config.counters && !rwbn_counters_open()) {
+    fprintf(stderr, "rw_bench: hardware counters are unavailable (no PMU or perf_event_paranoid too high), "
+                    "only timing\n");
+    config.counters = false;
+  }
+
+  // Read the baseline first so a bad path doesn't waste a whole run
+  static rwbn_result baseline[RWBN_MAX_BENCHMARKS];
+  int baseline_count = 0;
+  if (baseline_path) {
+    FILE *f = fopen(baseline_path, "r");
+    baseline_count = f ? rwbn_read_json(f, baseline, RWBN_MAX_BENCHMARKS) : -1;
+    if (f) fclose(f);
+    if (baseline_count < 0) {
+      fprintf(stderr, "rw_bench: could not read the baseline %s\n", baseline_path);
+      return 2;
+    }
+  }
+
+  // Keep stdout clean for the results when they are written there
+  bool quiet = (json_path && strcmp(json_path, "-") == 0) || (csv_path && strcmp(csv_path, "-") == 0);
+  FILE *out = quiet ? stderr : stdout;
+  static rwbn_result results[RWBN_MAX_BENCHMARKS];
+  int count = 0;
+  fprintf(out, "%-32s %12s %12s %8s %12s %12s", "benchmark", "iterations", "median ns", "mad %",
+          "p90 ns", "p99 ns");
+  if (config.counters) {
+    fprintf(out, " %6s %10s %10s %10s %10s %10s %10s", "ipc", "cycles", "instrs", "l1d miss", "llc miss",
+            "br miss", "dtlb miss");
+  }
+  fputc('\n', out);
+  for (int i = 0; i < rwbn__num_benchmarks; i++) {
+    rwbn__Benchmark *b = &rwbn__benchmarks[i];
+    if (filter && strstr(b->name, filter) == NULL) continue;
+    rwbn_result *r = &results[count++];
+    rwbn_run(b->name, b->func, b->user_data, &config, r);
+    fprintf(out, "%-32s %12llu %12.3f %8.2f %12.3f %12.3f", r->name, (unsigned long long) r->iterations,
+            r->median, r->median > 0.0 ? 100.0 * r->mad / r->median : 0.0, r->p90, r->p99);
+    if (config.counters) {
+      if (r->ipc >= 0.0) {
+        fprintf(out, " %6.2f", r->ipc);
+      } else {
+        fprintf(out, " %6s", "-");
+      }
+      for (int c = 0; c < RWBN_NUM_COUNTERS; c++) rwbn__print_counter(out, r, (rwbn_counter) c);
+    }
+    fputc('\n', out);
+    fflush(out);
+  }
+
+  int regressions = 0;
+  if (baseline_path) {
+    fprintf(out, "\ncompared with %s (threshold %.1f%%, p < %g)\n", baseline_path, 100.0 * threshold,
+            RWBN_SIGNIFICANCE);
+    fprintf(out, "%-32s %12s %12s %9s %9s\n", "benchmark", "baseline ns", "median ns", "delta %", "p");
+    for (int i = 0; i < count; i++) {
+      rwbn_result *r = &results[i];
+      rwbn_result *base = NULL;
+      for (int j = 0; j < baseline_count && base == NULL; j++) {
+        if (strcmp(baseline[j].name, r->name) == 0) base = &baseline[j];
+      }
+      if (base == NULL) {
+        fprintf(out, "%-32s %12s %12.3f\n", r->name, "new", r->median);
+        continue;
+      }
+      rwbn_comparison c = rwbn_compare(base, r, threshold);
+      const char *verdict = c.verdict == RWBN_SLOWER ? "  SLOWER" : (c.verdict == RWBN_FASTER ? "  faster" : "");
+      fprintf(out, "%-32s %12.3f %12.3f %+9.2f %9.4f%s\n", r->name, base->median, r->median, 100.0 * c.delta,
+              c.p_value, verdict);
+      if (c.verdict == RWBN_SLOWER) regressions++;
+    }
+    if (regressions > 0) fprintf(out, "%d regression(s)\n", regressions);
+    for (int j = 0; j < baseline_count; j++) free((void *) baseline[j].name);
+  }
+
+  bool ok = true;
+  if (json_path) ok = rwbn__write_file(json_path, results, count, true) && ok;
+  if (csv_path) ok = rwbn__write_file(csv_path, results, count, false) && ok;
+  if (save_baseline_path) ok = rwbn__write_file(save_baseline_path, results, count, true) && ok;
+  return ok && regressions == 0 ? 0 : 1;
+}
+
+#endif // #if defined(RWBN_IMPLEMENTATION) || defined(RWBN_HEADER_ONLY)
+#endif // #ifndef __RW_BENCH_H__
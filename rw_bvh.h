@@ -0,0 +1,926 @@
+/*
+  FILE: rw_bvh.h
+  VERSION: 0.1.0
+  DESCRIPTION: Bounding Volume Hierarchy (BVH) built with the binned surface area heuristic.
+  AUTHOR: Raymond Wan
+  DEPENDENCIES: rw_math.h, rw_th.h and rw_memory.h (only with RWBVH_PARALLEL)
+  USAGE: Simply including the file will only give you declarations (see __API)
+    To include the implementation,
+      #define RWBVH_IMPLEMENTATION
+
+    The BVH only knows about the bounds of your primitives. Build it from an array
+    of Rect3 (one per primitive) and intersect rays by passing a callback that tests
+    a single primitive, e.g.
+
+      float my_intersect(void *user_data, int prim_index, Point3 o, Vec3 d, float t_max);
+      BVH bvh = rwbvh_build(prim_bounds, num_prims, 4);
+      BVHHit hit;
+      if (rwbvh_intersect(&bvh, o, d, FLT_MAX, my_intersect, my_data, &hit)) { ... }
+      rwbvh_free(&bvh);
+
+    To build on multiple threads,
+      #define RWBVH_PARALLEL
+    before including the file and call rwbvh_build_parallel instead. It produces exactly
+    the same BVH as rwbvh_build. The implementations of rw_th.h and rw_memory.h must be
+    compiled somewhere in your program. If the rw_th.h job system is running the build
+    uses its threads, otherwise it starts its own.
+
+  NOTE(ray): To quickly navigate through the file,
+             sections and/or subsections are available to jump to.
+  SECTIONS:
+    1. __TYPES
+    2. __API
+    3. __MACROS
+    4. __IMPLEMENTATION
+      4.1. __BUILD
+      4.2. __COLLAPSE
+      4.3. __PARALLEL_BUILD
+      4.4. __TRAVERSAL
+*/
+
+#ifndef __RW_BVH_H__
+#define __RW_BVH_H__
+
+// Detect compiler type (for intrinsics)
+#if !defined(RW_DISABLE_INTRINSICS)
+#define RW_USE_INTRINSICS
+#if defined(__GNUC__) || defined(__GNUG__) || defined(__clang__)
+#include <x86intrin.h>
+#elif defined(_WIN32)
+#include <intrin.h>
+#endif
+#endif // #if !defined(RW_DISABLE_INTRINSICS)
+
+#if defined(RWBVH_STATIC)
+  #define RWBVH_DEF static
+#elif defined(RWBVH_HEADER_ONLY)
+  #define RWBVH_DEF static inline
+#else
+  #define RWBVH_DEF extern
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// __TYPES
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+#include "rw_math.h"
+#if defined(RWBVH_PARALLEL)
+#include "rw_th.h"
+#include "rw_memory.h"
+#endif
+
+// NOTE(ray): Binary tree node laid out depth first (pbrt's LinearBVHNode).
+// The first child of an interior node is always the next node in the array.
+typedef struct BVHLinearNode {
+  Rect3 bounds;
+  union {
+    int32_t prims_offset; // leaf
+    int32_t second_child_offset; // interior
+  };
+  uint16_t num_prims; // 0 -> interior node
+  uint8_t axis; // interior node split axis
+  uint8_t pad;
+} BVHLinearNode;
+
+// NOTE(ray): 4 wide node used for traversal. The bounds are stored as a
+// structure of arrays so the ray can be tested against all 4 children at once.
+typedef struct BVH4Node {
+  float min_x[4], min_y[4], min_z[4];
+  float max_x[4], max_y[4], max_z[4];
+  // Interior child: index into nodes4. Leaf child: offset into prim_indices.
+  int32_t child[4];
+  // 0 -> interior child, > 0 -> leaf child with this many primitives, -1 -> empty
+  int32_t num_prims[4];
+} BVH4Node;
+
+typedef struct BVH {
+  BVHLinearNode *nodes;
+  int num_nodes;
+  BVH4Node *nodes4;
+  int num_nodes4;
+  int depth4; // levels of 4 wide nodes, sizes the traversal stack
+  // Primitive indices in leaf order
+  int *prim_indices;
+  int num_prims;
+} BVH;
+
+typedef struct BVHHit {
+  float t;
+  int prim_index; // -1 if nothing was hit
+} BVHHit;
+
+// Tests the ray o + t*d against the primitive prim_index (an index into the array
+// the BVH was built from). Returns the hit distance t if 0 <= t < t_max, otherwise
+// any value >= t_max (e.g. FLT_MAX).
+typedef float (*rwbvh_intersect_fn)(void *user_data, int prim_index, Point3 o, Vec3 d, float t_max);
+
+///////////////////////////////////////////////////////////////////////////////
+// __API
+///////////////////////////////////////////////////////////////////////////////
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Builds a BVH over num_prims primitives with the given bounds.
+// Leaves hold at most max_prims_in_leaf primitives (unless they cannot be split).
+RWBVH_DEF BVH rwbvh_build(Rect3 *prim_bounds, int num_prims, int max_prims_in_leaf);
+#if defined(RWBVH_PARALLEL)
+// Same as rwbvh_build but the work is split num_threads ways
+// (<= 0 -> one per job system thread, or one per cpu if the job system isn't running).
+// The result is byte for byte the same as rwbvh_build's.
+RWBVH_DEF BVH rwbvh_build_parallel(Rect3 *prim_bounds, int num_prims, int max_prims_in_leaf, int num_threads);
+#endif
+RWBVH_DEF void rwbvh_free(BVH *bvh);
+// Returns the bounds of the whole hierarchy
+RWBVH_DEF Rect3 rwbvh_bounds(BVH *bvh);
+// Finds the closest hit along o + t*d with t < t_max
+RWBVH_DEF bool rwbvh_intersect(BVH *bvh, Point3 o, Vec3 d, float t_max, rwbvh_intersect_fn intersect, void *user_data, BVHHit *hit);
+// Returns true as soon as any hit with t < t_max is found (e.g. shadow rays)
+RWBVH_DEF bool rwbvh_occluded(BVH *bvh, Point3 o, Vec3 d, float t_max, rwbvh_intersect_fn intersect, void *user_data);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// __MACROS
+///////////////////////////////////////////////////////////////////////////////
+
+#define RWBVH_NUM_BUCKETS 12
+#define RWBVH_TRAVERSAL_STACK_SIZE 128
+// Parallel build: ranges with fewer prims than this are binned on a single thread
+#if !defined(RWBVH_PARALLEL_MIN_PRIMS)
+#define RWBVH_PARALLEL_MIN_PRIMS 16384
+#endif
+// Parallel build: roughly how many independent subtrees each thread gets to build
+#define RWBVH_SUBTREES_PER_THREAD 8
+
+
+///////////////////////////////////////////////////////////////////////////////
+// __IMPLEMENTATION
+///////////////////////////////////////////////////////////////////////////////
+
+#if defined(RWBVH_IMPLEMENTATION) || defined(RWBVH_HEADER_ONLY)
+
+#include <stdlib.h> // malloc
+#include <float.h> // FLT_MAX
+#include <string.h> // memcpy
+
+///////////////////////////////////////////////////////////////////////////////
+// __BUILD
+///////////////////////////////////////////////////////////////////////////////
+
+typedef struct BVHPrimInfo {
+  int prim_index;
+  Rect3 bounds;
+  Point3 centroid;
+} BVHPrimInfo;
+
+typedef struct BVHBucket {
+  int count;
+  Rect3 bounds;
+} BVHBucket;
+
+static Rect3 rwbvh__empty_r3() {
+  Rect3 result = {
+    FLT_MAX, FLT_MAX, FLT_MAX,
+    -FLT_MAX, -FLT_MAX, -FLT_MAX
+  };
+  return result;
+}
+
+static int rwbvh__bucket_index(BVHPrimInfo *info, Rect3 *centroid_bounds, int dim) {
+  int b = (int) (RWBVH_NUM_BUCKETS * rwm_r3_offset(*centroid_bounds, info->centroid).e[dim]);
+  if (b == RWBVH_NUM_BUCKETS) b = RWBVH_NUM_BUCKETS - 1;
+  return b;
+}
+
+static void rwbvh__init_prims(BVHPrimInfo *prims, Rect3 *prim_bounds, int start, int end) {
+  for (int i = start; i < end; i++) {
+    prims[i].prim_index = i;
+    prims[i].bounds = prim_bounds[i];
+    prims[i].centroid = rwm_v3_scalar_mult(0.5f, rwm_v3_add(prim_bounds[i].min_p, prim_bounds[i].max_p));
+  }
+}
+
+// Grows bounds and centroid_bounds by the prims in [start, end)
+static void rwbvh__accumulate_bounds(BVHPrimInfo *prims, int start, int end, Rect3 *bounds, Rect3 *centroid_bounds) {
+  for (int i = start; i < end; i++) {
+    *bounds = rwm_r3_union(*bounds, prims[i].bounds);
+    *centroid_bounds = rwm_r3_union_p(*centroid_bounds, prims[i].centroid);
+  }
+}
+
+static void rwbvh__clear_buckets(BVHBucket *buckets) {
+  for (int i = 0; i < RWBVH_NUM_BUCKETS; i++) {
+    buckets[i].count = 0;
+    buckets[i].bounds = rwbvh__empty_r3();
+  }
+}
+
+// Adds the centroids of the prims in [start, end) to buckets
+static void rwbvh__accumulate_buckets(BVHPrimInfo *prims, int start, int end, Rect3 *centroid_bounds, int dim, BVHBucket *buckets) {
+  for (int i = start; i < end; i++) {
+    int b = rwbvh__bucket_index(&prims[i], centroid_bounds, dim);
+    buckets[b].count++;
+    buckets[b].bounds = rwm_r3_union(buckets[b].bounds, prims[i].bounds);
+  }
+}
+
+// Finds the cheapest split between buckets. Writes the last bucket of the left side to min_bucket.
+// Returns false if a leaf is cheaper than any split.
+static bool rwbvh__choose_split(BVHBucket *buckets, Rect3 bounds, int num_prims, int max_prims_in_leaf, int *min_bucket) {
+  // NOTE(ray): Sweep from both sides so computing the cost is linear in the number of buckets.
+  // Cost of a split is 1/8 (relative cost of a traversal step) plus the expected
+  // number of primitive tests (count * probability of hitting the child).
+  float left_area[RWBVH_NUM_BUCKETS - 1];
+  int left_count[RWBVH_NUM_BUCKETS - 1];
+  Rect3 acc = rwbvh__empty_r3();
+  int acc_count = 0;
+  for (int i = 0; i < RWBVH_NUM_BUCKETS - 1; i++) {
+    acc = rwm_r3_union(acc, buckets[i].bounds);
+    acc_count += buckets[i].count;
+    left_area[i] = acc_count ? rwm_r3_surface_area(acc) : 0.0f;
+    left_count[i] = acc_count;
+  }
+  float inv_area = 1.0f/rwm_r3_surface_area(bounds);
+  float min_cost = FLT_MAX;
+  *min_bucket = 0;
+  acc = rwbvh__empty_r3();
+  acc_count = 0;
+  for (int i = RWBVH_NUM_BUCKETS - 1; i > 0; i--) {
+    acc = rwm_r3_union(acc, buckets[i].bounds);
+    acc_count += buckets[i].count;
+    float right_area = acc_count ? rwm_r3_surface_area(acc) : 0.0f;
+    float cost = 0.125f + (left_count[i-1] * left_area[i-1] + acc_count * right_area) * inv_area;
+    if (cost < min_cost) {
+      min_cost = cost;
+      *min_bucket = i - 1;
+    }
+  }
+  return num_prims > max_prims_in_leaf || min_cost < num_prims;
+}
+
+// Partitions the prims so that everything in buckets <= min_bucket comes first.
+// Returns the start of the second half.
+static int rwbvh__partition(BVHPrimInfo *prims, int start, int end, Rect3 *centroid_bounds, int dim, int min_bucket) {
+  int lo = start;
+  int hi = end - 1;
+  while (lo <= hi) {
+    if (rwbvh__bucket_index(&prims[lo], centroid_bounds, dim) <= min_bucket) {
+      lo++;
+    } else {
+      BVHPrimInfo tmp = prims[lo];
+      prims[lo] = prims[hi];
+      prims[hi] = tmp;
+      hi--;
+    }
+  }
+  return lo;
+}
+
+// Recursively builds the subtree over prims [start, end) into nodes, depth first.
+// Returns the index of the subtree's root node.
+static int rwbvh__build_recursive(BVHLinearNode *nodes, int *num_nodes, BVHPrimInfo *prims, int start, int end, int max_prims_in_leaf) {
+  int node_index = (*num_nodes)++;
+  BVHLinearNode *node = &nodes[node_index];
+  node->pad = 0;
+
+  Rect3 bounds = rwbvh__empty_r3();
+  Rect3 centroid_bounds = rwbvh__empty_r3();
+  rwbvh__accumulate_bounds(prims, start, end, &bounds, &centroid_bounds);
+  node->bounds = bounds;
+
+  int num_prims = end - start;
+  int dim = rwm_r3_max_extent(centroid_bounds);
+  // NOTE(ray): All centroids in the same spot means binning can't separate them.
+  // Make a leaf if allowed, otherwise just split the range in half.
+  bool degenerate = centroid_bounds.max_p.e[dim] == centroid_bounds.min_p.e[dim];
+  bool make_leaf = num_prims == 1 || (degenerate && num_prims <= max_prims_in_leaf);
+
+  int mid = start + num_prims/2;
+  if (!make_leaf && !degenerate) {
+    BVHBucket buckets[RWBVH_NUM_BUCKETS];
+    rwbvh__clear_buckets(buckets);
+    rwbvh__accumulate_buckets(prims, start, end, &centroid_bounds, dim, buckets);
+    int min_bucket;
+    if (rwbvh__choose_split(buckets, bounds, num_prims, max_prims_in_leaf, &min_bucket)) {
+      mid = rwbvh__partition(prims, start, end, &centroid_bounds, dim, min_bucket);
+    } else {
+      make_leaf = true;
+    }
+  }
+
+  if (make_leaf) {
+    node->prims_offset = start;
+    node->num_prims = (uint16_t) num_prims;
+    node->axis = 0;
+    return node_index;
+  }
+
+  node->num_prims = 0;
+  node->axis = (uint8_t) dim;
+  rwbvh__build_recursive(nodes, num_nodes, prims, start, mid, max_prims_in_leaf);
+  node->second_child_offset = rwbvh__build_recursive(nodes, num_nodes, prims, mid, end, max_prims_in_leaf);
+  return node_index;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// __COLLAPSE
+///////////////////////////////////////////////////////////////////////////////
+
+// Converts the binary subtree rooted at the interior node bin_index into 4 wide nodes.
+// Returns the index of the new node in bvh->nodes4.
+static int rwbvh__collapse_recursive(BVH *bvh, int bin_index, int depth) {
+  int node4_index = bvh->num_nodes4++;
+  if (depth > bvh->depth4) bvh->depth4 = depth;
+
+  // Start with the two children and keep opening the interior child with
+  // the largest surface area until there are 4 children or only leaves
+  int children[4];
+  int num_children = 2;
+  children[0] = bin_index + 1;
+  children[1] = bvh->nodes[bin_index].second_child_offset;
+  while (num_children < 4) {
+    int best = -1;
+    float best_area = -1.0f;
+    for (int i = 0; i < num_children; i++) {
+      BVHLinearNode *c = &bvh->nodes[children[i]];
+      if (c->num_prims == 0) {
+        float area = rwm_r3_surface_area(c->bounds);
+        if (area > best_area) {
+          best_area = area;
+          best = i;
+        }
+      }
+    }
+    if (best == -1) break;
+    int opened = children[best];
+    children[best] = opened + 1;
+    children[num_children++] = bvh->nodes[opened].second_child_offset;
+  }
+
+  for (int i = 0; i < 4; i++) {
+    BVH4Node *node4 = &bvh->nodes4[node4_index];
+    if (i >= num_children) {
+      // NOTE(ray): Inverted bounds so an empty slot can never be hit
+      node4->min_x[i] = node4->min_y[i] = node4->min_z[i] = FLT_MAX;
+      node4->max_x[i] = node4->max_y[i] = node4->max_z[i] = -FLT_MAX;
+      node4->child[i] = 0;
+      node4->num_prims[i] = -1;
+      continue;
+    }
+    BVHLinearNode *c = &bvh->nodes[children[i]];
+    node4->min_x[i] = c->bounds.min_px;
+    node4->min_y[i] = c->bounds.min_py;
+    node4->min_z[i] = c->bounds.min_pz;
+    node4->max_x[i] = c->bounds.max_px;
+    node4->max_y[i] = c->bounds.max_py;
+    node4->max_z[i] = c->bounds.max_pz;
+    if (c->num_prims > 0) {
+      node4->child[i] = c->prims_offset;
+      node4->num_prims[i] = c->num_prims;
+    } else {
+      node4->num_prims[i] = 0;
+      int child4 = rwbvh__collapse_recursive(bvh, children[i], depth + 1);
+      bvh->nodes4[node4_index].child[i] = child4;
+    }
+  }
+
+  return node4_index;
+}
+
+// Fills in prim_indices and the 4 wide nodes once the binary nodes are built
+static void rwbvh__finish(BVH *bvh, BVHPrimInfo *prims, int num_prims) {
+  bvh->num_prims = num_prims;
+  bvh->prim_indices = (int *) malloc(num_prims * sizeof(int));
+  for (int i = 0; i < num_prims; i++) {
+    bvh->prim_indices[i] = prims[i].prim_index;
+  }
+
+  // NOTE(ray): Every 4 wide node consumes at least one binary interior node
+  // and a single leaf root still gets a node so traversal doesn't need a special case.
+  bvh->nodes4 = (BVH4Node *) malloc(bvh->num_nodes * sizeof(BVH4Node));
+  if (bvh->nodes[0].num_prims == 0) {
+    rwbvh__collapse_recursive(bvh, 0, 1);
+  } else {
+    BVH4Node *root = &bvh->nodes4[bvh->num_nodes4++];
+    bvh->depth4 = 1;
+    Rect3 b = bvh->nodes[0].bounds;
+    for (int i = 0; i < 4; i++) {
+      root->min_x[i] = root->min_y[i] = root->min_z[i] = FLT_MAX;
+      root->max_x[i] = root->max_y[i] = root->max_z[i] = -FLT_MAX;
+      root->child[i] = 0;
+      root->num_prims[i] = -1;
+    }
+    root->min_x[0] = b.min_px; root->min_y[0] = b.min_py; root->min_z[0] = b.min_pz;
+    root->max_x[0] = b.max_px; root->max_y[0] = b.max_py; root->max_z[0] = b.max_pz;
+    root->child[0] = bvh->nodes[0].prims_offset;
+    root->num_prims[0] = bvh->nodes[0].num_prims;
+  }
+}
+
+RWBVH_DEF BVH rwbvh_build(Rect3 *prim_bounds, int num_prims, int max_prims_in_leaf) {
+  BVH result = {};
+  if (num_prims <= 0) return result;
+  if (max_prims_in_leaf < 1) max_prims_in_leaf = 1;
+  if (max_prims_in_leaf > UINT16_MAX) max_prims_in_leaf = UINT16_MAX;
+
+  BVHPrimInfo *prims = (BVHPrimInfo *) malloc(num_prims * sizeof(BVHPrimInfo));
+  rwbvh__init_prims(prims, prim_bounds, 0, num_prims);
+
+  // NOTE(ray): A binary tree with n leaves has 2n - 1 nodes
+  result.nodes = (BVHLinearNode *) malloc((2 * num_prims - 1) * sizeof(BVHLinearNode));
+  rwbvh__build_recursive(result.nodes, &result.num_nodes, prims, 0, num_prims, max_prims_in_leaf);
+
+  rwbvh__finish(&result, prims, num_prims);
+  free(prims);
+  return result;
+}
+
+RWBVH_DEF void rwbvh_free(BVH *bvh) {
+  free(bvh->nodes);
+  free(bvh->nodes4);
+  free(bvh->prim_indices);
+  bvh->nodes = NULL;
+  bvh->nodes4 = NULL;
+  bvh->prim_indices = NULL;
+  bvh->num_nodes = 0;
+  bvh->num_nodes4 = 0;
+  bvh->num_prims = 0;
+}
+
+RWBVH_DEF Rect3 rwbvh_bounds(BVH *bvh) {
+  if (bvh->num_nodes == 0) return rwbvh__empty_r3();
+  return bvh->nodes[0].bounds;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// __PARALLEL_BUILD
+///////////////////////////////////////////////////////////////////////////////
+
+#if defined(RWBVH_PARALLEL)
+
+// NOTE(ray): The top levels of the tree are built one node at a time with the bounds and
+// binning of each node split across threads. Once ranges are small enough they become
+// subtrees which are built in parallel by rwbvh__build_recursive into per thread arenas,
+// then copied to their final (depth first) position. Every split decision is the same
+// one the serial build makes, so the output is identical.
+
+// A range of prims built into its own node array by a single thread
+typedef struct BVHSubtree {
+  int start;
+  int end;
+  BVHLinearNode *nodes; // allocated from the building thread's arena
+  int num_nodes;
+  int offset; // index of the subtree's root in the final node array
+} BVHSubtree;
+
+// Binary node above the subtrees
+typedef struct BVHTopNode {
+  Rect3 bounds;
+  int axis;
+  int left;
+  int right;
+  int subtree; // -1 -> interior node, otherwise index into subtrees
+} BVHTopNode;
+
+typedef struct BVHParallelBuild BVHParallelBuild;
+typedef void (*rwbvh__parallel_fn)(BVHParallelBuild *pb, int thread_index);
+
+typedef struct BVHWorker {
+  BVHParallelBuild *pb;
+  rwbvh__parallel_fn fn;
+  int thread_index;
+  bool started;
+  rwth_thread thread;
+} BVHWorker;
+
+struct BVHParallelBuild {
+  int num_threads;
+  int max_prims_in_leaf;
+  Rect3 *prim_bounds;
+  BVHPrimInfo *prims;
+  BVHWorker *workers;
+  rwbvh__parallel_fn fn;
+  MemoryArena *arenas; // one per thread
+  BVHTopNode *top;
+  int num_top;
+  int top_capacity;
+  BVHSubtree *subtrees;
+  int num_subtrees;
+  int subtrees_capacity;
+  BVHSubtree **subtree_order; // largest first
+  int64_t volatile next_subtree;
+  BVHLinearNode *nodes;
+  // Range [start, end) that is split into one chunk per thread
+  int start;
+  int end;
+  Rect3 centroid_bounds;
+  int dim;
+  Rect3 *chunk_bounds;
+  Rect3 *chunk_centroid_bounds;
+  BVHBucket *chunk_buckets; // RWBVH_NUM_BUCKETS per thread
+};
+
+static void *rwbvh__worker_entry(void *arg) {
+  BVHWorker *w = (BVHWorker *) arg;
+  w->fn(w->pb, w->thread_index);
+  return NULL;
+}
+
+static void rwbvh__parallel_for_entry(void *data, int start, int end) {
+  BVHParallelBuild *pb = (BVHParallelBuild *) data;
+  for (int i = start; i < end; i++) {
+    pb->fn(pb, i);
+  }
+}
+
+// Runs fn for every thread_index in [0, num_threads) and waits for all of them to finish.
+// Without the job system, the calling thread is thread 0 and the rest get their own thread.
+// NOTE(ray): Jobs queued from a thread outside of the job system run inline, so only the init
+// thread and the workers can hand the build to it.
+static void rwbvh__run_parallel(BVHParallelBuild *pb, rwbvh__parallel_fn fn) {
+  if (rwth_jobs_num_threads() > 1 && rwth_jobs_worker_index() >= 0) {
+    pb->fn = fn;
+    rwth_parallel_for(0, pb->num_threads, 1, rwbvh__parallel_for_entry, pb);
+    return;
+  }
+  for (int i = 1; i < pb->num_threads; i++) {
+    BVHWorker *w = &pb->workers[i];
+    w->pb = pb;
+    w->fn = fn;
+    w->thread_index = i;
+    w->started = rwth_thread_create(&w->thread, rwbvh__worker_entry, w);
+  }
+  fn(pb, 0);
+  for (int i = 1; i < pb->num_threads; i++) {
+    if (pb->workers[i].started) {
+      rwth_thread_join(&pb->workers[i].thread);
+    } else {
+      // NOTE(ray): Couldn't get a thread, do its share here
+      fn(pb, i);
+    }
+  }
+}
+
+static void rwbvh__chunk(BVHParallelBuild *pb, int thread_index, int *start, int *end) {
+  int64_t n = pb->end - pb->start;
+  *start = pb->start + (int) (n * thread_index / pb->num_threads);
+  *end = pb->start + (int) (n * (thread_index + 1) / pb->num_threads);
+}
+
+static void rwbvh__init_prims_job(BVHParallelBuild *pb, int thread_index) {
+  int start, end;
+  rwbvh__chunk(pb, thread_index, &start, &end);
+  rwbvh__init_prims(pb->prims, pb->prim_bounds, start, end);
+}
+
+static void rwbvh__bounds_job(BVHParallelBuild *pb, int thread_index) {
+  int start, end;
+  rwbvh__chunk(pb, thread_index, &start, &end);
+  pb->chunk_bounds[thread_index] = rwbvh__empty_r3();
+  pb->chunk_centroid_bounds[thread_index] = rwbvh__empty_r3();
+  rwbvh__accumulate_bounds(pb->prims, start, end, &pb->chunk_bounds[thread_index], &pb->chunk_centroid_bounds[thread_index]);
+}
+
+static void rwbvh__bin_job(BVHParallelBuild *pb, int thread_index) {
+  int start, end;
+  rwbvh__chunk(pb, thread_index, &start, &end);
+  BVHBucket *buckets = &pb->chunk_buckets[thread_index * RWBVH_NUM_BUCKETS];
+  rwbvh__clear_buckets(buckets);
+  rwbvh__accumulate_buckets(pb->prims, start, end, &pb->centroid_bounds, pb->dim, buckets);
+}
+
+static void rwbvh__build_subtrees_job(BVHParallelBuild *pb, int thread_index) {
+  for (;;) {
+    int64_t i = rwth_atomic_add_i64(&pb->next_subtree, 1);
+    if (i >= pb->num_subtrees) break;
+    BVHSubtree *subtree = pb->subtree_order[i];
+    int num_prims = subtree->end - subtree->start;
+    subtree->nodes = (BVHLinearNode *) rwmem_arena_alloc(&pb->arenas[thread_index], (2 * num_prims - 1) * sizeof(BVHLinearNode));
+    subtree->num_nodes = 0;
+    rwbvh__build_recursive(subtree->nodes, &subtree->num_nodes, pb->prims, subtree->start, subtree->end, pb->max_prims_in_leaf);
+  }
+}
+
+static void rwbvh__copy_subtrees_job(BVHParallelBuild *pb, int thread_index) {
+  (void) thread_index;
+  for (;;) {
+    int64_t i = rwth_atomic_add_i64(&pb->next_subtree, 1);
+    if (i >= pb->num_subtrees) break;
+    BVHSubtree *subtree = pb->subtree_order[i];
+    BVHLinearNode *dst = &pb->nodes[subtree->offset];
+    memcpy(dst, subtree->nodes, subtree->num_nodes * sizeof(BVHLinearNode));
+    for (int n = 0; n < subtree->num_nodes; n++) {
+      if (dst[n].num_prims == 0) dst[n].second_child_offset += subtree->offset;
+    }
+  }
+}
+
+static int rwbvh__push_top(BVHParallelBuild *pb) {
+  if (pb->num_top == pb->top_capacity) {
+    pb->top_capacity = pb->top_capacity ? 2 * pb->top_capacity : 64;
+    pb->top = (BVHTopNode *) realloc(pb->top, pb->top_capacity * sizeof(BVHTopNode));
+  }
+  int result = pb->num_top++;
+  pb->top[result].subtree = -1;
+  return result;
+}
+
+static int rwbvh__push_subtree(BVHParallelBuild *pb, int start, int end) {
+  if (pb->num_subtrees == pb->subtrees_capacity) {
+    pb->subtrees_capacity = pb->subtrees_capacity ? 2 * pb->subtrees_capacity : 64;
+    pb->subtrees = (BVHSubtree *) realloc(pb->subtrees, pb->subtrees_capacity * sizeof(BVHSubtree));
+  }
+  int result = pb->num_subtrees++;
+  pb->subtrees[result].start = start;
+  pb->subtrees[result].end = end;
+  return result;
+}
+
+// Same splits as rwbvh__build_recursive, but ranges of at most max_subtree_prims are
+// deferred to the subtree builds. Returns the index of the node in pb->top.
+static int rwbvh__build_top(BVHParallelBuild *pb, int start, int end, int max_subtree_prims) {
+  int top_index = rwbvh__push_top(pb);
+  int num_prims = end - start;
+  if (num_prims <= max_subtree_prims) {
+    pb->top[top_index].subtree = rwbvh__push_subtree(pb, start, end);
+    return top_index;
+  }
+
+  bool parallel = num_prims >= RWBVH_PARALLEL_MIN_PRIMS;
+  pb->start = start;
+  pb->end = end;
+
+  Rect3 bounds = rwbvh__empty_r3();
+  Rect3 centroid_bounds = rwbvh__empty_r3();
+  if (parallel) {
+    rwbvh__run_parallel(pb, rwbvh__bounds_job);
+    // NOTE(ray): Merging the chunks in order gives the exact same bits as a serial scan
+    // (MIN keeps the first and MAX the last of equal values, e.g. 0.0f and -0.0f)
+    for (int i = 0; i < pb->num_threads; i++) {
+      bounds = rwm_r3_union(bounds, pb->chunk_bounds[i]);
+      centroid_bounds = rwm_r3_union(centroid_bounds, pb->chunk_centroid_bounds[i]);
+    }
+  } else {
+    rwbvh__accumulate_bounds(pb->prims, start, end, &bounds, &centroid_bounds);
+  }
+
+  // NOTE(ray): num_prims > max_prims_in_leaf here so this is always an interior node
+  int dim = rwm_r3_max_extent(centroid_bounds);
+  bool degenerate = centroid_bounds.max_p.e[dim] == centroid_bounds.min_p.e[dim];
+  int mid = start + num_prims/2;
+  if (!degenerate) {
+    BVHBucket buckets[RWBVH_NUM_BUCKETS];
+    rwbvh__clear_buckets(buckets);
+    if (parallel) {
+      pb->centroid_bounds = centroid_bounds;
+      pb->dim = dim;
+      rwbvh__run_parallel(pb, rwbvh__bin_job);
+      for (int i = 0; i < pb->num_threads; i++) {
+        BVHBucket *chunk = &pb->chunk_buckets[i * RWBVH_NUM_BUCKETS];
+        for (int b = 0; b < RWBVH_NUM_BUCKETS; b++) {
+          buckets[b].count += chunk[b].count;
+          buckets[b].bounds = rwm_r3_union(buckets[b].bounds, chunk[b].bounds);
+        }
+      }
+    } else {
+      rwbvh__accumulate_buckets(pb->prims, start, end, &centroid_bounds, dim, buckets);
+    }
+    int min_bucket;
+    rwbvh__choose_split(buckets, bounds, num_prims, pb->max_prims_in_leaf, &min_bucket);
+    mid = rwbvh__partition(pb->prims, start, end, &centroid_bounds, dim, min_bucket);
+  }
+
+  pb->top[top_index].bounds = bounds;
+  pb->top[top_index].axis = dim;
+  int left = rwbvh__build_top(pb, start, mid, max_subtree_prims);
+  int right = rwbvh__build_top(pb, mid, end, max_subtree_prims);
+  // NOTE(ray): pb->top may have moved while building the children
+  pb->top[top_index].left = left;
+  pb->top[top_index].right = right;
+  return top_index;
+}
+
+// Gives every top node and subtree its depth first position in pb->nodes.
+// Returns the index following the last node of the subtree rooted at top_index.
+static int rwbvh__place_top(BVHParallelBuild *pb, int top_index, int offset) {
+  BVHTopNode *top = &pb->top[top_index];
+  if (top->subtree >= 0) {
+    BVHSubtree *subtree = &pb->subtrees[top->subtree];
+    subtree->offset = offset;
+    return offset + subtree->num_nodes;
+  }
+  BVHLinearNode *node = &pb->nodes[offset];
+  node->bounds = top->bounds;
+  node->num_prims = 0;
+  node->axis = (uint8_t) top->axis;
+  node->pad = 0;
+  int right_offset = rwbvh__place_top(pb, top->left, offset + 1);
+  node->second_child_offset = right_offset;
+  return rwbvh__place_top(pb, top->right, right_offset);
+}
+
+static int rwbvh__compare_subtree_size(const void *a, const void *b) {
+  BVHSubtree *sa = *(BVHSubtree **) a;
+  BVHSubtree *sb = *(BVHSubtree **) b;
+  return (sb->end - sb->start) - (sa->end - sa->start);
+}
+
+RWBVH_DEF BVH rwbvh_build_parallel(Rect3 *prim_bounds, int num_prims, int max_prims_in_leaf, int num_threads) {
+  if (num_threads <= 0) num_threads = rwth_jobs_num_threads();
+  if (num_threads <= 0) num_threads = rwth_num_cpus();
+  if (num_threads == 1 || num_prims <= 1) return rwbvh_build(prim_bounds, num_prims, max_prims_in_leaf);
+  if (max_prims_in_leaf < 1) max_prims_in_leaf = 1;
+  if (max_prims_in_leaf > UINT16_MAX) max_prims_in_leaf = UINT16_MAX;
+
+  BVHParallelBuild pb = {};
+  pb.num_threads = num_threads;
+  pb.max_prims_in_leaf = max_prims_in_leaf;
+  pb.prim_bounds = prim_bounds;
+  pb.prims = (BVHPrimInfo *) malloc(num_prims * sizeof(BVHPrimInfo));
+  pb.workers = (BVHWorker *) malloc(num_threads * sizeof(BVHWorker));
+  pb.arenas = (MemoryArena *) malloc(num_threads * sizeof(MemoryArena));
+  for (int i = 0; i < num_threads; i++) {
+    pb.arenas[i] = rwmem_arena_create(DEFAULT_ARENA_BLOCK_SIZE_BYTES);
+  }
+  pb.chunk_bounds = (Rect3 *) malloc(num_threads * sizeof(Rect3));
+  pb.chunk_centroid_bounds = (Rect3 *) malloc(num_threads * sizeof(Rect3));
+  pb.chunk_buckets = (BVHBucket *) malloc(num_threads * RWBVH_NUM_BUCKETS * sizeof(BVHBucket));
+
+  pb.start = 0;
+  pb.end = num_prims;
+  rwbvh__run_parallel(&pb, rwbvh__init_prims_job);
+
+  int max_subtree_prims = num_prims / (num_threads * RWBVH_SUBTREES_PER_THREAD);
+  if (max_subtree_prims < max_prims_in_leaf) max_subtree_prims = max_prims_in_leaf;
+  rwbvh__build_top(&pb, 0, num_prims, max_subtree_prims);
+
+  // NOTE(ray): Hand out the biggest subtrees first so no thread is left with a big one at the end
+  pb.subtree_order = (BVHSubtree **) malloc(pb.num_subtrees * sizeof(BVHSubtree *));
+  for (int i = 0; i < pb.num_subtrees; i++) {
+    pb.subtree_order[i] = &pb.subtrees[i];
+  }
+  qsort(pb.subtree_order, pb.num_subtrees, sizeof(BVHSubtree *), rwbvh__compare_subtree_size);
+  pb.next_subtree = 0;
+  rwbvh__run_parallel(&pb, rwbvh__build_subtrees_job);
+
+  BVH result = {};
+  result.nodes = (BVHLinearNode *) malloc((2 * num_prims - 1) * sizeof(BVHLinearNode));
+  pb.nodes = result.nodes;
+  result.num_nodes = rwbvh__place_top(&pb, 0, 0);
+  pb.next_subtree = 0;
+  rwbvh__run_parallel(&pb, rwbvh__copy_subtrees_job);
+
+  rwbvh__finish(&result, pb.prims, num_prims);
+
+  for (int i = 0; i < num_threads; i++) {
+    rwmem_arena_free(&pb.arenas[i]);
+  }
+  free(pb.prims);
+  free(pb.workers);
+  free(pb.arenas);
+  free(pb.top);
+  free(pb.subtrees);
+  free(pb.subtree_order);
+  free(pb.chunk_bounds);
+  free(pb.chunk_centroid_bounds);
+  free(pb.chunk_buckets);
+  return result;
+}
+
+#endif // #if defined(RWBVH_PARALLEL)
+
+///////////////////////////////////////////////////////////////////////////////
+// __TRAVERSAL
+///////////////////////////////////////////////////////////////////////////////
+
+// Slab test of the ray against the 4 children of node. Writes the entry distance
+// of each child to t_near and returns a bit mask of the children that were hit.
+static inline int rwbvh__intersect_node4(BVH4Node *node, Point3 o, Vec3 inv_d, float t_max, float *t_near) {
+#if defined(RW_USE_INTRINSICS)
+  // NOTE(ray): The min/max operand order matters. If o lies on a slab and d is 0 in
+  // that axis the product is NaN, and _mm_min_ps/_mm_max_ps return the second operand.
+  __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node->min_x), _mm_set1_ps(o.x)), _mm_set1_ps(inv_d.x));
+  __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node->max_x), _mm_set1_ps(o.x)), _mm_set1_ps(inv_d.x));
+  __m128 t_min = _mm_max_ps(_mm_min_ps(t0, t1), _mm_setzero_ps());
+  __m128 t_max4 = _mm_min_ps(_mm_max_ps(t0, t1), _mm_set1_ps(t_max));
+  t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node->min_y), _mm_set1_ps(o.y)), _mm_set1_ps(inv_d.y));
+  t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node->max_y), _mm_set1_ps(o.y)), _mm_set1_ps(inv_d.y));
+  t_min = _mm_max_ps(_mm_min_ps(t0, t1), t_min);
+  t_max4 = _mm_min_ps(_mm_max_ps(t0, t1), t_max4);
+  t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node->min_z), _mm_set1_ps(o.z)), _mm_set1_ps(inv_d.z));
+  t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node->max_z), _mm_set1_ps(o.z)), _mm_set1_ps(inv_d.z));
+  t_min = _mm_max_ps(_mm_min_ps(t0, t1), t_min);
+  t_max4 = _mm_min_ps(_mm_max_ps(t0, t1), t_max4);
+  _mm_storeu_ps(t_near, t_min);
+  return _mm_movemask_ps(_mm_cmple_ps(t_min, t_max4));
+#else
+  int result = 0;
+  for (int i = 0; i < 4; i++) {
+    float t_min = 0.0f;
+    float t_far = t_max;
+    float mins[3] = { node->min_x[i], node->min_y[i], node->min_z[i] };
+    float maxs[3] = { node->max_x[i], node->max_y[i], node->max_z[i] };
+    for (int a = 0; a < 3; a++) {
+      float t0 = (mins[a] - o.e[a]) * inv_d.e[a];
+      float t1 = (maxs[a] - o.e[a]) * inv_d.e[a];
+      if (t0 > t1) {
+        float tmp = t0;
+        t0 = t1;
+        t1 = tmp;
+      }
+      // NOTE(ray): Written so a NaN t0/t1 leaves the interval untouched
+      t_min = t0 > t_min ? t0 : t_min;
+      t_far = t1 < t_far ? t1 : t_far;
+    }
+    t_near[i] = t_min;
+    if (t_min <= t_far) result |= 1 << i;
+  }
+  return result;
+#endif
+}
+
+static bool rwbvh__traverse(BVH *bvh, Point3 o, Vec3 d, float t_max, rwbvh_intersect_fn intersect, void *user_data, BVHHit *hit, bool any_hit) {
+  if (hit) {
+    hit->t = t_max;
+    hit->prim_index = -1;
+  }
+  if (bvh->num_nodes4 == 0) return false;
+
+  Vec3 inv_d = rwm_v3_init(1.0f/d.x, 1.0f/d.y, 1.0f/d.z);
+  bool result = false;
+
+  // NOTE(ray): Each level leaves at most 3 siblings on the stack when it descends and
+  // the deepest level pushes at most 4, so the stack never holds more than 3 * depth4 + 1.
+  // Skewed inputs can build very deep trees, those get a stack from the heap.
+  int local_stack[RWBVH_TRAVERSAL_STACK_SIZE];
+  int *stack = local_stack;
+  int stack_capacity = 3 * bvh->depth4 + 1;
+  if (stack_capacity > RWBVH_TRAVERSAL_STACK_SIZE) {
+    stack = (int *) malloc(stack_capacity * sizeof(int));
+  }
+  int stack_size = 0;
+  stack[stack_size++] = 0;
+  while (stack_size > 0) {
+    BVH4Node *node = &bvh->nodes4[stack[--stack_size]];
+    float t_near[4];
+    int mask = rwbvh__intersect_node4(node, o, inv_d, t_max, t_near);
+
+    // Interior children that were hit, sorted far to near so the nearest is popped first
+    int push[4];
+    float push_t[4];
+    int num_push = 0;
+    for (int i = 0; i < 4; i++) {
+      if (!(mask & (1 << i)) || node->num_prims[i] < 0) continue;
+      if (node->num_prims[i] > 0) {
+        int offset = node->child[i];
+        for (int p = 0; p < node->num_prims[i]; p++) {
+          int prim_index = bvh->prim_indices[offset + p];
+          float t = intersect(user_data, prim_index, o, d, t_max);
+          if (t < t_max) {
+            result = true;
+            if (any_hit) goto done;
+            t_max = t;
+            hit->t = t;
+            hit->prim_index = prim_index;
+          }
+        }
+      } else {
+        int j = num_push++;
+        while (j > 0 && push_t[j-1] < t_near[i]) {
+          push[j] = push[j-1];
+          push_t[j] = push_t[j-1];
+          j--;
+        }
+        push[j] = node->child[i];
+        push_t[j] = t_near[i];
+      }
+    }
+    for (int i = 0; i < num_push; i++) {
+      // NOTE(ray): Children entered beyond the closest hit found so far can be skipped
+      if (push_t[i] > t_max) continue;
+      stack[stack_size++] = push[i];
+    }
+  }
+
+done:
+  if (stack != local_stack) free(stack);
+  return result;
+}
+
+RWBVH_DEF bool rwbvh_intersect(BVH *bvh, Point3 o, Vec3 d, float t_max, rwbvh_intersect_fn intersect, void *user_data, BVHHit *hit) {
+  return rwbvh__traverse(bvh, o, d, t_max, intersect, user_data, hit, false);
+}
+
+RWBVH_DEF bool rwbvh_occluded(BVH *bvh, Point3 o, Vec3 d, float t_max, rwbvh_intersect_fn intersect, void *user_data) {
+  return rwbvh__traverse(bvh, o, d, t_max, intersect, user_data, NULL, true);
+}
+
+#endif // #if defined(RWBVH_IMPLEMENTATION) || defined(RWBVH_HEADER_ONLY)
+
+#endif // #ifndef __RW_BVH_H__
@@ -1,6 +1,6 @@
 /*
   FILE: rw_math.h
-  VERSION: 0.3.0
+  VERSION: 0.4.0
   DESCRIPTION: Math library for games/graphics.
   AUTHOR: Raymond Wan
   USAGE: Simply including the file will only give you declarations (see __API)
@@ -10,6 +10,11 @@
       #define RWM_HEADER_ONLY
     To use the fast inverse sqrt intrinsic, also include before
       #define RWM_USE_MM_RSQRT
+    The Vec3Batch (structure of arrays) functions use AVX when the compiler
+    targets it (e.g. -mavx2), otherwise SSE, otherwise plain scalar loops.
+    Mat4 arithmetic uses the SSE row registers and FMA when targeted (e.g. -mfma).
+    To get the scalar reference implementations (e.g. for validation),
+      #define RW_DISABLE_INTRINSICS
 
   NOTE(ray): To quickly navigate through the file,
              sections and/or subsections are available to jump to.
@@ -20,12 +25,13 @@
     4. __IMPLEMENTATION
       4.1. __VEC2
       4.2. __VEC3
-      4.3. __VEC4
-      4.4. __MAT3
-      4.4. __MAT4
-      4.5. __QUATERNION
-      4.6. __RECT2
-      4.7. __RECT3
+      4.3. __VEC3_BATCH
+      4.4. __VEC4
+      4.5. __MAT3
+      4.6. __MAT4
+      4.7. __QUATERNION
+      4.8. __RECT2
+      4.9. __RECT3
 */
 
 #ifndef __RW_MATH_H__
@@ -112,6 +118,19 @@ RWM_DEF float rwm_v3_dot(Vec3 a, Vec3 b);
 RWM_DEF Vec3 rwm_v3_cross(Vec3 a, Vec3 b);
 RWM_DEF Vec3 rwm_v3_lerp(Vec3 a, float t, Vec3 b);
 
+// __VEC3_BATCH
+// NOTE(ray): All batch functions operate on count elements. out may alias an input.
+RWM_DEF Vec3Batch rwm_v3_batch_init(float *x, float *y, float *z);
+RWM_DEF void rwm_v3_batch_from_aos(Vec3 *in, Vec3Batch out, int count);
+RWM_DEF void rwm_v3_batch_to_aos(Vec3Batch in, Vec3 *out, int count);
+RWM_DEF void rwm_v3_batch_add(Vec3Batch a, Vec3Batch b, Vec3Batch out, int count);
+RWM_DEF void rwm_v3_batch_subtract(Vec3Batch a, Vec3Batch b, Vec3Batch out, int count);
+RWM_DEF void rwm_v3_batch_scalar_mult(float a, Vec3Batch v, Vec3Batch out, int count);
+RWM_DEF void rwm_v3_batch_dot(Vec3Batch a, Vec3Batch b, float *out, int count);
+RWM_DEF void rwm_v3_batch_cross(Vec3Batch a, Vec3Batch b, Vec3Batch out, int count);
+RWM_DEF void rwm_v3_batch_normalize(Vec3Batch v, Vec3Batch out, int count);
+RWM_DEF void rwm_v3_batch_lerp(Vec3Batch a, float t, Vec3Batch b, Vec3Batch out, int count);
+
 // __VEC4
 RWM_DEF void rwm_v4_puts(Vec4 *v);
 RWM_DEF void rwm_v4_printf(const char *label, Vec4 *v);
@@ -157,6 +176,12 @@ RWM_DEF Mat4 rwm_m4_scalar_mult(float a, Mat4 m);
 RWM_DEF Mat4 rwm_m4_multiply(Mat4 a, Mat4 b);
 RWM_DEF Mat4 rwm_m4_hadamard(Mat4 a, Mat4 b);
 RWM_DEF Mat4 rwm_m4_inverse(Mat4 m);
+// Inverse of a matrix whose last row is (0, 0, 0, 1)
+RWM_DEF Mat4 rwm_m4_inverse_affine(Mat4 m);
+// Inverse of a matrix that is only a rotation followed by a translation
+RWM_DEF Mat4 rwm_m4_inverse_rigid(Mat4 m);
+// Returns true if the last row is exactly (0, 0, 0, 1)
+RWM_DEF bool rwm_m4_is_affine(Mat4 m);
 
 // __QUATERNION
 RWM_DEF void rwm_q_puts(Quaternion *q);
@@ -716,6 +741,189 @@ RWM_DEF Vec3 &operator*=(Vec3 &v, float a) {
 
 #endif // #ifdef __cplusplus for Vec3
 
+///////////////////////////////////////////////////////////////////////////////
+// __VEC3_BATCH
+///////////////////////////////////////////////////////////////////////////////
+
+// NOTE(ray): Lane wide helpers so each batch kernel is only written once.
+// AVX processes 8 elements per iteration, SSE processes 4. Whatever is left
+// over (or everything, when intrinsics are disabled) goes through the scalar loop.
+#if defined(RW_USE_INTRINSICS) && defined(__AVX__)
+#define RWM__LANES 8
+typedef __m256 rwm__lane;
+#define rwm__load(p) _mm256_loadu_ps(p)
+#define rwm__store(p, a) _mm256_storeu_ps(p, a)
+#define rwm__set1(a) _mm256_set1_ps(a)
+#define rwm__add(a, b) _mm256_add_ps(a, b)
+#define rwm__sub(a, b) _mm256_sub_ps(a, b)
+#define rwm__mul(a, b) _mm256_mul_ps(a, b)
+#define rwm__div(a, b) _mm256_div_ps(a, b)
+#define rwm__sqrt(a) _mm256_sqrt_ps(a)
+#define rwm__rsqrt(a) _mm256_rsqrt_ps(a)
+#elif defined(RW_USE_INTRINSICS)
+#define RWM__LANES 4
+typedef __m128 rwm__lane;
+#define rwm__load(p) _mm_loadu_ps(p)
+#define rwm__store(p, a) _mm_storeu_ps(p, a)
+#define rwm__set1(a) _mm_set1_ps(a)
+#define rwm__add(a, b) _mm_add_ps(a, b)
+#define rwm__sub(a, b) _mm_sub_ps(a, b)
+#define rwm__mul(a, b) _mm_mul_ps(a, b)
+#define rwm__div(a, b) _mm_div_ps(a, b)
+#define rwm__sqrt(a) _mm_sqrt_ps(a)
+#define rwm__rsqrt(a) _mm_rsqrt_ps(a)
+#endif
+
+RWM_DEF Vec3Batch rwm_v3_batch_init(float *x, float *y, float *z) {
+  Vec3Batch result = { x, y, z };
+  return result;
+}
+
+RWM_DEF void rwm_v3_batch_from_aos(Vec3 *in, Vec3Batch out, int count) {
+  for (int i = 0; i < count; i++) {
+    out.x[i] = in[i].x;
+    out.y[i] = in[i].y;
+    out.z[i] = in[i].z;
+  }
+}
+
+RWM_DEF void rwm_v3_batch_to_aos(Vec3Batch in, Vec3 *out, int count) {
+  for (int i = 0; i < count; i++) {
+    out[i].x = in.x[i];
+    out[i].y = in.y[i];
+    out[i].z = in.z[i];
+  }
+}
+
+RWM_DEF void rwm_v3_batch_add(Vec3Batch a, Vec3Batch b, Vec3Batch out, int count) {
+  int i = 0;
+#if defined(RW_USE_INTRINSICS)
+  for (; i + RWM__LANES <= count; i += RWM__LANES) {
+    rwm__store(out.x + i, rwm__add(rwm__load(a.x + i), rwm__load(b.x + i)));
+    rwm__store(out.y + i, rwm__add(rwm__load(a.y + i), rwm__load(b.y + i)));
+    rwm__store(out.z + i, rwm__add(rwm__load(a.z + i), rwm__load(b.z + i)));
+  }
+#endif
+  for (; i < count; i++) {
+    out.x[i] = a.x[i] + b.x[i];
+    out.y[i] = a.y[i] + b.y[i];
+    out.z[i] = a.z[i] + b.z[i];
+  }
+}
+
+RWM_DEF void rwm_v3_batch_subtract(Vec3Batch a, Vec3Batch b, Vec3Batch out, int count) {
+  int i = 0;
+#if defined(RW_USE_INTRINSICS)
+  for (; i + RWM__LANES <= count; i += RWM__LANES) {
+    rwm__store(out.x + i, rwm__sub(rwm__load(a.x + i), rwm__load(b.x + i)));
+    rwm__store(out.y + i, rwm__sub(rwm__load(a.y + i), rwm__load(b.y + i)));
+    rwm__store(out.z + i, rwm__sub(rwm__load(a.z + i), rwm__load(b.z + i)));
+  }
+#endif
+  for (; i < count; i++) {
+    out.x[i] = a.x[i] - b.x[i];
+    out.y[i] = a.y[i] - b.y[i];
+    out.z[i] = a.z[i] - b.z[i];
+  }
+}
+
+RWM_DEF void rwm_v3_batch_scalar_mult(float a, Vec3Batch v, Vec3Batch out, int count) {
+  int i = 0;
+#if defined(RW_USE_INTRINSICS)
+  rwm__lane a_l = rwm__set1(a);
+  for (; i + RWM__LANES <= count; i += RWM__LANES) {
+    rwm__store(out.x + i, rwm__mul(a_l, rwm__load(v.x + i)));
+    rwm__store(out.y + i, rwm__mul(a_l, rwm__load(v.y + i)));
+    rwm__store(out.z + i, rwm__mul(a_l, rwm__load(v.z + i)));
+  }
+#endif
+  for (; i < count; i++) {
+    out.x[i] = a * v.x[i];
+    out.y[i] = a * v.y[i];
+    out.z[i] = a * v.z[i];
+  }
+}
+
+RWM_DEF void rwm_v3_batch_dot(Vec3Batch a, Vec3Batch b, float *out, int count) {
+  int i = 0;
+#if defined(RW_USE_INTRINSICS)
+  for (; i + RWM__LANES <= count; i += RWM__LANES) {
+    rwm__lane x = rwm__mul(rwm__load(a.x + i), rwm__load(b.x + i));
+    rwm__lane y = rwm__mul(rwm__load(a.y + i), rwm__load(b.y + i));
+    rwm__lane z = rwm__mul(rwm__load(a.z + i), rwm__load(b.z + i));
+    rwm__store(out + i, rwm__add(rwm__add(x, y), z));
+  }
+#endif
+  for (; i < count; i++) {
+    out[i] = (a.x[i] * b.x[i]) +
+             (a.y[i] * b.y[i]) +
+             (a.z[i] * b.z[i]);
+  }
+}
+
+RWM_DEF void rwm_v3_batch_cross(Vec3Batch a, Vec3Batch b, Vec3Batch out, int count) {
+  int i = 0;
+#if defined(RW_USE_INTRINSICS)
+  for (; i + RWM__LANES <= count; i += RWM__LANES) {
+    rwm__lane ax = rwm__load(a.x + i), ay = rwm__load(a.y + i), az = rwm__load(a.z + i);
+    rwm__lane bx = rwm__load(b.x + i), by = rwm__load(b.y + i), bz = rwm__load(b.z + i);
+    rwm__store(out.x + i, rwm__sub(rwm__mul(ay, bz), rwm__mul(az, by)));
+    rwm__store(out.y + i, rwm__sub(rwm__mul(az, bx), rwm__mul(ax, bz)));
+    rwm__store(out.z + i, rwm__sub(rwm__mul(ax, by), rwm__mul(ay, bx)));
+  }
+#endif
+  for (; i < count; i++) {
+    // NOTE(ray): Read everything first since out may alias a or b
+    float ax = a.x[i], ay = a.y[i], az = a.z[i];
+    float bx = b.x[i], by = b.y[i], bz = b.z[i];
+    out.x[i] = (ay * bz) - (az * by);
+    out.y[i] = (az * bx) - (ax * bz);
+    out.z[i] = (ax * by) - (ay * bx);
+  }
+}
+
+RWM_DEF void rwm_v3_batch_normalize(Vec3Batch v, Vec3Batch out, int count) {
+  int i = 0;
+#if defined(RW_USE_INTRINSICS)
+  for (; i + RWM__LANES <= count; i += RWM__LANES) {
+    rwm__lane x = rwm__load(v.x + i), y = rwm__load(v.y + i), z = rwm__load(v.z + i);
+    rwm__lane len_sq = rwm__add(rwm__add(rwm__mul(x, x), rwm__mul(y, y)), rwm__mul(z, z));
+#if defined(RWM_USE_MM_RSQRT)
+    rwm__lane inv_norm = rwm__rsqrt(len_sq);
+#else
+    rwm__lane inv_norm = rwm__div(rwm__set1(1.0f), rwm__sqrt(len_sq));
+#endif
+    rwm__store(out.x + i, rwm__mul(x, inv_norm));
+    rwm__store(out.y + i, rwm__mul(y, inv_norm));
+    rwm__store(out.z + i, rwm__mul(z, inv_norm));
+  }
+#endif
+  for (; i < count; i++) {
+    float inv_norm = rwm_rsqrt(SQUARE(v.x[i]) + SQUARE(v.y[i]) + SQUARE(v.z[i]));
+    out.x[i] = v.x[i] * inv_norm;
+    out.y[i] = v.y[i] * inv_norm;
+    out.z[i] = v.z[i] * inv_norm;
+  }
+}
+
+RWM_DEF void rwm_v3_batch_lerp(Vec3Batch a, float t, Vec3Batch b, Vec3Batch out, int count) {
+  int i = 0;
+#if defined(RW_USE_INTRINSICS)
+  rwm__lane t_l = rwm__set1(t);
+  rwm__lane one_minus_t_l = rwm__set1(1.0f - t);
+  for (; i + RWM__LANES <= count; i += RWM__LANES) {
+    rwm__store(out.x + i, rwm__add(rwm__mul(one_minus_t_l, rwm__load(a.x + i)), rwm__mul(t_l, rwm__load(b.x + i))));
+    rwm__store(out.y + i, rwm__add(rwm__mul(one_minus_t_l, rwm__load(a.y + i)), rwm__mul(t_l, rwm__load(b.y + i))));
+    rwm__store(out.z + i, rwm__add(rwm__mul(one_minus_t_l, rwm__load(a.z + i)), rwm__mul(t_l, rwm__load(b.z + i))));
+  }
+#endif
+  for (; i < count; i++) {
+    out.x[i] = rwm_lerp(a.x[i], t, b.x[i]);
+    out.y[i] = rwm_lerp(a.y[i], t, b.y[i]);
+    out.z[i] = rwm_lerp(a.z[i], t, b.z[i]);
+  }
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // __VEC4
 ///////////////////////////////////////////////////////////////////////////////
@@ -1186,9 +1394,31 @@ RWM_DEF float rwm_m4_trace(Mat4 m) {
   return result;
 }
 
+#if defined(RW_USE_INTRINSICS)
+// Computes r * b for a single row r. Uses FMA when the compiler targets it (e.g. -mfma)
+static inline __m128 rwm__m4_row_mult(__m128 r, Mat4 *b) {
+  __m128 result = _mm_mul_ps(_mm_shuffle_ps(r, r, _MM_SHUFFLE(0, 0, 0, 0)), b->row[0]);
+#if defined(__FMA__)
+  result = _mm_fmadd_ps(_mm_shuffle_ps(r, r, _MM_SHUFFLE(1, 1, 1, 1)), b->row[1], result);
+  result = _mm_fmadd_ps(_mm_shuffle_ps(r, r, _MM_SHUFFLE(2, 2, 2, 2)), b->row[2], result);
+  result = _mm_fmadd_ps(_mm_shuffle_ps(r, r, _MM_SHUFFLE(3, 3, 3, 3)), b->row[3], result);
+#else
+  result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(r, r, _MM_SHUFFLE(1, 1, 1, 1)), b->row[1]));
+  result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(r, r, _MM_SHUFFLE(2, 2, 2, 2)), b->row[2]));
+  result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(r, r, _MM_SHUFFLE(3, 3, 3, 3)), b->row[3]));
+#endif
+  return result;
+}
+#endif
+
 RWM_DEF Mat4 rwm_m4_add(Mat4 a, Mat4 b) {
-  // TODO(ray): Add intrinsic version
-  Mat4 result = { 0.0f };
+  Mat4 result;
+#if defined(RW_USE_INTRINSICS)
+  result.row[0] = _mm_add_ps(a.row[0], b.row[0]);
+  result.row[1] = _mm_add_ps(a.row[1], b.row[1]);
+  result.row[2] = _mm_add_ps(a.row[2], b.row[2]);
+  result.row[3] = _mm_add_ps(a.row[3], b.row[3]);
+#else
   result.e00 = a.e00 + b.e00;
   result.e01 = a.e01 + b.e01;
   result.e02 = a.e02 + b.e02;
@@ -1205,13 +1435,18 @@ RWM_DEF Mat4 rwm_m4_add(Mat4 a, Mat4 b) {
   result.e31 = a.e31 + b.e31;
   result.e32 = a.e32 + b.e32;
   result.e33 = a.e33 + b.e33;
-
+#endif
   return result;
 }
 
 RWM_DEF Mat4 rwm_m4_subtract(Mat4 a, Mat4 b) {
-  // TODO(ray): Add intrinsic version
-  Mat4 result = { 0.0f };
+  Mat4 result;
+#if defined(RW_USE_INTRINSICS)
+  result.row[0] = _mm_sub_ps(a.row[0], b.row[0]);
+  result.row[1] = _mm_sub_ps(a.row[1], b.row[1]);
+  result.row[2] = _mm_sub_ps(a.row[2], b.row[2]);
+  result.row[3] = _mm_sub_ps(a.row[3], b.row[3]);
+#else
   result.e00 = a.e00 - b.e00;
   result.e01 = a.e01 - b.e01;
   result.e02 = a.e02 - b.e02;
@@ -1228,13 +1463,19 @@ RWM_DEF Mat4 rwm_m4_subtract(Mat4 a, Mat4 b) {
   result.e31 = a.e31 - b.e31;
   result.e32 = a.e32 - b.e32;
   result.e33 = a.e33 - b.e33;
-
+#endif
   return result;
 }
 
 RWM_DEF Mat4 rwm_m4_scalar_mult(float a, Mat4 m) {
-  // TODO(ray): Add intrinsic version
-  Mat4 result = { 0.0f };
+  Mat4 result;
+#if defined(RW_USE_INTRINSICS)
+  __m128 a_m = _mm_set1_ps(a);
+  result.row[0] = _mm_mul_ps(a_m, m.row[0]);
+  result.row[1] = _mm_mul_ps(a_m, m.row[1]);
+  result.row[2] = _mm_mul_ps(a_m, m.row[2]);
+  result.row[3] = _mm_mul_ps(a_m, m.row[3]);
+#else
   result.e00 = a * m.e00;
   result.e01 = a * m.e01;
   result.e02 = a * m.e02;
@@ -1251,13 +1492,20 @@ RWM_DEF Mat4 rwm_m4_scalar_mult(float a, Mat4 m) {
   result.e31 = a * m.e31;
   result.e32 = a * m.e32;
   result.e33 = a * m.e33;
+#endif
   return result;
 }
 
 RWM_DEF Mat4 rwm_m4_multiply(Mat4 a, Mat4 b) {
-  // TODO(ray): Add intrinsic version
-  Mat4 result = { 0.0f };
-
+  Mat4 result;
+#if defined(RW_USE_INTRINSICS)
+  // NOTE(ray): Each row of the result is a linear combination of the rows of b
+  // weighted by the elements of the corresponding row of a
+  result.row[0] = rwm__m4_row_mult(a.row[0], &b);
+  result.row[1] = rwm__m4_row_mult(a.row[1], &b);
+  result.row[2] = rwm__m4_row_mult(a.row[2], &b);
+  result.row[3] = rwm__m4_row_mult(a.row[3], &b);
+#else
   result.e00 = (a.e00 * b.e00) + (a.e01 * b.e10) + (a.e02 * b.e20) + (a.e03 * b.e30);
   result.e01 = (a.e00 * b.e01) + (a.e01 * b.e11) + (a.e02 * b.e21) + (a.e03 * b.e31);
   result.e02 = (a.e00 * b.e02) + (a.e01 * b.e12) + (a.e02 * b.e22) + (a.e03 * b.e32);
@@ -1277,12 +1525,18 @@ RWM_DEF Mat4 rwm_m4_multiply(Mat4 a, Mat4 b) {
   result.e31 = (a.e30 * b.e01) + (a.e31 * b.e11) + (a.e32 * b.e21) + (a.e33 * b.e31);
   result.e32 = (a.e30 * b.e02) + (a.e31 * b.e12) + (a.e32 * b.e22) + (a.e33 * b.e32);
   result.e33 = (a.e30 * b.e03) + (a.e31 * b.e13) + (a.e32 * b.e23) + (a.e33 * b.e33);
-
+#endif
   return result;
 }
 
 RWM_DEF Mat4 rwm_m4_hadamard(Mat4 a, Mat4 b) {
-  Mat4 result = { 0.0f };
+  Mat4 result;
+#if defined(RW_USE_INTRINSICS)
+  result.row[0] = _mm_mul_ps(a.row[0], b.row[0]);
+  result.row[1] = _mm_mul_ps(a.row[1], b.row[1]);
+  result.row[2] = _mm_mul_ps(a.row[2], b.row[2]);
+  result.row[3] = _mm_mul_ps(a.row[3], b.row[3]);
+#else
   result.e00 = a.e00 * b.e00;
   result.e01 = a.e01 * b.e01;
   result.e02 = a.e02 * b.e02;
@@ -1299,13 +1553,93 @@ RWM_DEF Mat4 rwm_m4_hadamard(Mat4 a, Mat4 b) {
   result.e31 = a.e31 * b.e31;
   result.e32 = a.e32 * b.e32;
   result.e33 = a.e33 * b.e33;
+#endif
   return result;
 }
 
-// http://www.euclideanspace.com/Maths/algebra/Matrix/functions/inverse/fourD/index.htm
 RWM_DEF Mat4 rwm_m4_inverse(Mat4 m) {
-  Mat4 result = { 0.0f };
+#if defined(RW_USE_INTRINSICS)
+  // NOTE(ray): Cramer's rule using SSE. Adapted from Intel's
+  // "Streaming SIMD Extensions - Inverse of 4x4 Matrix" (AP-928).
+  // The algorithm wants the columns of m with the halves of columns 1 and 3 swapped.
+  __m128 row0 = m.row[0], row1 = m.row[1], row2 = m.row[2], row3 = m.row[3];
+  _MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+  row1 = _mm_shuffle_ps(row1, row1, 0x4E);
+  row3 = _mm_shuffle_ps(row3, row3, 0x4E);
+
+  __m128 minor0, minor1, minor2, minor3, tmp;
+
+  tmp = _mm_mul_ps(row2, row3);
+  tmp = _mm_shuffle_ps(tmp, tmp, 0xB1);
+  minor0 = _mm_mul_ps(row1, tmp);
+  minor1 = _mm_mul_ps(row0, tmp);
+  tmp = _mm_shuffle_ps(tmp, tmp, 0x4E);
+  minor0 = _mm_sub_ps(_mm_mul_ps(row1, tmp), minor0);
+  minor1 = _mm_sub_ps(_mm_mul_ps(row0, tmp), minor1);
+  minor1 = _mm_shuffle_ps(minor1, minor1, 0x4E);
+
+  tmp = _mm_mul_ps(row1, row2);
+  tmp = _mm_shuffle_ps(tmp, tmp, 0xB1);
+  minor0 = _mm_add_ps(_mm_mul_ps(row3, tmp), minor0);
+  minor3 = _mm_mul_ps(row0, tmp);
+  tmp = _mm_shuffle_ps(tmp, tmp, 0x4E);
+  minor0 = _mm_sub_ps(minor0, _mm_mul_ps(row3, tmp));
+  minor3 = _mm_sub_ps(_mm_mul_ps(row0, tmp), minor3);
+  minor3 = _mm_shuffle_ps(minor3, minor3, 0x4E);
+
+  tmp = _mm_mul_ps(_mm_shuffle_ps(row1, row1, 0x4E), row3);
+  tmp = _mm_shuffle_ps(tmp, tmp, 0xB1);
+  row2 = _mm_shuffle_ps(row2, row2, 0x4E);
+  minor0 = _mm_add_ps(_mm_mul_ps(row2, tmp), minor0);
+  minor2 = _mm_mul_ps(row0, tmp);
+  tmp = _mm_shuffle_ps(tmp, tmp, 0x4E);
+  minor0 = _mm_sub_ps(minor0, _mm_mul_ps(row2, tmp));
+  minor2 = _mm_sub_ps(_mm_mul_ps(row0, tmp), minor2);
+  minor2 = _mm_shuffle_ps(minor2, minor2, 0x4E);
+
+  tmp = _mm_mul_ps(row0, row1);
+  tmp = _mm_shuffle_ps(tmp, tmp, 0xB1);
+  minor2 = _mm_add_ps(_mm_mul_ps(row3, tmp), minor2);
+  minor3 = _mm_sub_ps(_mm_mul_ps(row2, tmp), minor3);
+  tmp = _mm_shuffle_ps(tmp, tmp, 0x4E);
+  minor2 = _mm_sub_ps(_mm_mul_ps(row3, tmp), minor2);
+  minor3 = _mm_sub_ps(minor3, _mm_mul_ps(row2, tmp));
+
+  tmp = _mm_mul_ps(row0, row3);
+  tmp = _mm_shuffle_ps(tmp, tmp, 0xB1);
+  minor1 = _mm_sub_ps(minor1, _mm_mul_ps(row2, tmp));
+  minor2 = _mm_add_ps(_mm_mul_ps(row1, tmp), minor2);
+  tmp = _mm_shuffle_ps(tmp, tmp, 0x4E);
+  minor1 = _mm_add_ps(_mm_mul_ps(row2, tmp), minor1);
+  minor2 = _mm_sub_ps(minor2, _mm_mul_ps(row1, tmp));
+
+  tmp = _mm_mul_ps(row0, row2);
+  tmp = _mm_shuffle_ps(tmp, tmp, 0xB1);
+  minor1 = _mm_add_ps(_mm_mul_ps(row3, tmp), minor1);
+  minor3 = _mm_sub_ps(minor3, _mm_mul_ps(row1, tmp));
+  tmp = _mm_shuffle_ps(tmp, tmp, 0x4E);
+  minor1 = _mm_sub_ps(minor1, _mm_mul_ps(row3, tmp));
+  minor3 = _mm_add_ps(_mm_mul_ps(row1, tmp), minor3);
+
+  // Determinant is the dot product of the first column with its cofactors
+  __m128 det = _mm_mul_ps(row0, minor0);
+  det = _mm_add_ps(_mm_shuffle_ps(det, det, 0x4E), det);
+  det = _mm_add_ss(_mm_shuffle_ps(det, det, 0xB1), det);
+  if (_mm_cvtss_f32(det) == 0.0f) return rwm_m4_identity();
+
+  // NOTE(ray): Use a real divide rather than _mm_rcp_ss so we match the scalar version
+  det = _mm_div_ss(_mm_set_ss(1.0f), det);
+  det = _mm_shuffle_ps(det, det, 0x00);
 
+  Mat4 result;
+  result.row[0] = _mm_mul_ps(det, minor0);
+  result.row[1] = _mm_mul_ps(det, minor1);
+  result.row[2] = _mm_mul_ps(det, minor2);
+  result.row[3] = _mm_mul_ps(det, minor3);
+  return result;
+#else
+  // http://www.euclideanspace.com/Maths/algebra/Matrix/functions/inverse/fourD/index.htm
+  Mat4 result = { 0.0f };
   float det =
     m.e03 * m.e12 * m.e21 * m.e30-m.e02 * m.e13 * m.e21 * m.e30-m.e03 * m.e11 * m.e22 * m.e30+m.e01 * m.e13 * m.e22 * m.e30 +
     m.e02 * m.e11 * m.e23 * m.e30-m.e01 * m.e12 * m.e23 * m.e30-m.e03 * m.e12 * m.e20 * m.e31+m.e02 * m.e13 * m.e20 * m.e31 +
@@ -1335,6 +1669,52 @@ RWM_DEF Mat4 rwm_m4_inverse(Mat4 m) {
   result.e33 = inv_det * (m.e01*m.e12*m.e20 - m.e02*m.e11*m.e20 + m.e02*m.e10*m.e21 - m.e00*m.e12*m.e21 - m.e01*m.e10*m.e22 + m.e00*m.e11*m.e22);
 
   return result;
+#endif
+}
+
+RWM_DEF Mat4 rwm_m4_inverse_affine(Mat4 m) {
+  // NOTE(ray): For M = [A t; 0 1], M^-1 = [A^-1 -A^-1*t; 0 1]
+  // The rows of A^-1 are the cross products of the columns of A over det(A)
+  Vec3 c0 = rwm_v3_init(m.e00, m.e10, m.e20);
+  Vec3 c1 = rwm_v3_init(m.e01, m.e11, m.e21);
+  Vec3 c2 = rwm_v3_init(m.e02, m.e12, m.e22);
+  Vec3 r0 = rwm_v3_cross(c1, c2);
+  Vec3 r1 = rwm_v3_cross(c2, c0);
+  Vec3 r2 = rwm_v3_cross(c0, c1);
+
+  float det = rwm_v3_dot(c0, r0);
+  if (det == 0.0f) return rwm_m4_identity();
+
+  float inv_det = 1.0f/det;
+  r0 = rwm_v3_scalar_mult(inv_det, r0);
+  r1 = rwm_v3_scalar_mult(inv_det, r1);
+  r2 = rwm_v3_scalar_mult(inv_det, r2);
+
+  Vec3 t = rwm_v3_init(m.e03, m.e13, m.e23);
+  Mat4 result = rwm_m4_init_f(
+    r0.x, r0.y, r0.z, -rwm_v3_dot(r0, t),
+    r1.x, r1.y, r1.z, -rwm_v3_dot(r1, t),
+    r2.x, r2.y, r2.z, -rwm_v3_dot(r2, t),
+    0.0f, 0.0f, 0.0f, 1.0f
+  );
+  return result;
+}
+
+RWM_DEF Mat4 rwm_m4_inverse_rigid(Mat4 m) {
+  // NOTE(ray): For M = [R t; 0 1], M^-1 = [R^T -R^T*t; 0 1]
+  Vec3 t = rwm_v3_init(m.e03, m.e13, m.e23);
+  m.e03 = 0.0f;
+  m.e13 = 0.0f;
+  m.e23 = 0.0f;
+  Mat4 result = rwm_m4_transpose(m);
+  result.e03 = -(result.e00*t.x + result.e01*t.y + result.e02*t.z);
+  result.e13 = -(result.e10*t.x + result.e11*t.y + result.e12*t.z);
+  result.e23 = -(result.e20*t.x + result.e21*t.y + result.e22*t.z);
+  return result;
+}
+
+RWM_DEF bool rwm_m4_is_affine(Mat4 m) {
+  return m.e30 == 0.0f && m.e31 == 0.0f && m.e32 == 0.0f && m.e33 == 1.0f;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -1,12 +1,24 @@
 /*
   FILE: rw_memory.h
-  VERSION: 0.2.0
+  VERSION: 0.3.0
   DESCRIPTION: Custom memory allocation.
   AUTHOR: Raymond Wan
+  DEPENDENCIES: rw_th.h (only with RWMEM_CONCURRENT)
   USAGE: Simply including the file will only give you declarations (see __API)
     To include the implementation,
       #define RWMEM_IMPLEMENTATION
 
+    To have every MemoryArena count its allocations, usage and wasted bytes in arena.stats,
+      #define RWMEM_TRACK_STATS
+    before including the file everywhere (it changes the size of MemoryArena).
+
+    MemoryArena and MemoryPool are not thread safe. For allocating from many threads,
+      #define RWMEM_CONCURRENT
+    before including the file to get ConcurrentArena, one arena every thread can allocate
+    from without locking, and MemoryArenaRegistry, a scratch MemoryArena per job system
+    thread that are all reset together, e.g. at the end of a frame.
+    The implementation of rw_th.h must be compiled somewhere in your program.
+
   NOTE(ray): To quickly navigate through the file,
              sections and/or subsections are available to jump to.
   SECTIONS:
@@ -15,7 +27,11 @@
     3. __MACROS
     4. __IMPLEMENTATION
       4.1. __ALIGNED
-      4.2. __ARENA
+      4.2. __VIRTUAL
+      4.3. __ARENA
+      4.4. __POOL
+      4.5. __HEAP
+      4.6. __CONCURRENT
 */
 
 #ifndef __RW_MEMORY_H__
@@ -33,24 +49,166 @@
 // __TYPES
 ///////////////////////////////////////////////////////////////////////////////
 
+#include <stddef.h>
 #include <stdint.h>
+#if defined(RWMEM_CONCURRENT)
+#include "rw_th.h"
+#endif
 
-typedef struct MA_BookkeepingNode {
-  uint8_t *block_ptr;
-  size_t cur_alloc_size;
-  MA_BookkeepingNode *next;
-} MA_BookkeepingNode;
+// NOTE(ray): Stored at the start of every block the arena allocates,
+// so keeping track of blocks never needs memory of its own.
+typedef struct MA_BlockHeader {
+  MA_BlockHeader *next;
+  size_t size; // usable bytes following the header
+} MA_BlockHeader;
+
+typedef struct MA_BlockList {
+  MA_BlockHeader *head;
+  MA_BlockHeader *tail;
+} MA_BlockList;
+
+// Blocks of block_size_bytes and the bigger ones made for large allocations are kept
+// in separate lists so a block can be reused without searching for one that fits
+enum {
+  MA_BLOCK_BUCKET_DEFAULT,
+  MA_BLOCK_BUCKET_LARGE,
+  MA_BLOCK_BUCKET_COUNT
+};
+
+#if defined(RWMEM_TRACK_STATS)
+// Allocation sizes up to 16 bytes, then one bucket per power of 2, the last one has the rest
+#define RWMEM_STATS_HISTOGRAM_COUNT 16
+
+typedef struct MemoryArenaStats {
+  size_t num_allocs;
+  size_t bytes_requested; // total over the arena's lifetime
+  size_t largest_alloc;
+  size_t bytes_in_use;    // requested and padding bytes since the last reset/rewind
+  size_t peak_bytes_in_use;
+  size_t bytes_reserved;  // memory owned by the arena (committed memory for virtual arenas)
+  size_t peak_bytes_reserved;
+  size_t num_blocks_allocated;
+  size_t num_rollovers;   // times an allocation didn't fit and moved to another block
+  size_t tail_bytes_wasted; // left unused at the end of blocks that were rolled over
+  size_t padding_bytes;     // skipped for alignment
+  size_t size_histogram[RWMEM_STATS_HISTOGRAM_COUNT];
+} MemoryArenaStats;
+#endif
 
 typedef struct MemoryArena {
   size_t block_size_bytes;
   size_t cur_block_pos;
   size_t cur_alloc_size;
   uint8_t *cur_block_ptr;
-  // Bookkeeping
-  MA_BookkeepingNode *used_blocks_node;
-  MA_BookkeepingNode *available_blocks_node;
+  // Bookkeeping (most recently used block first)
+  MA_BlockList used_blocks[MA_BLOCK_BUCKET_COUNT];
+  MA_BlockList available_blocks[MA_BLOCK_BUCKET_COUNT];
+  // Only used by virtual arenas (see rwmem_arena_create_virtual), 0 otherwise
+  size_t reserved_bytes;
+  size_t committed_bytes;
+#if defined(RWMEM_TRACK_STATS)
+  MemoryArenaStats stats;
+#endif
 } MemoryArena;
 
+// Saved arena position, see rwmem_arena_mark
+typedef struct MemoryArenaMark {
+  uint8_t *block_ptr;
+  size_t block_pos;
+  MA_BlockHeader *used_heads[MA_BLOCK_BUCKET_COUNT];
+#if defined(RWMEM_TRACK_STATS)
+  size_t bytes_in_use;
+#endif
+} MemoryArenaMark;
+
+// Fixed size elements, freed elements are linked through their own memory.
+// Chunks of elements come from the arena if one is given, otherwise from the heap.
+typedef struct MemoryPool {
+  MemoryArena *arena;
+  size_t element_size;
+  size_t slot_size;
+  size_t alignment;
+  bool handles; // slots also keep an index and generation, see MemoryPoolHandle
+  uint32_t elements_per_chunk;
+  uint32_t num_slots; // carved out of chunks so far
+  uint32_t num_used;
+  uint32_t num_chunks;
+  uint32_t chunk_capacity;
+  uint8_t **chunks;
+  void *free_list;
+} MemoryPool;
+
+// The generation changes every time the element is released so old handles stop resolving.
+// A zeroed handle is never valid.
+typedef struct MemoryPoolHandle {
+  uint32_t index;
+  uint32_t generation;
+} MemoryPoolHandle;
+
+// MemoryHeap blocks stay under 2^(RWMEM_HEAP_MAX_LOG2 - 1) bytes, anything past that in a region goes unused
+#ifndef RWMEM_HEAP_MAX_LOG2
+#define RWMEM_HEAP_MAX_LOG2 32
+#endif
+// Each power of 2 size range is split into 2^RWMEM_HEAP_SL_LOG2 free lists
+#define RWMEM_HEAP_SL_LOG2 4
+#define RWMEM_HEAP_SL_COUNT (1 << RWMEM_HEAP_SL_LOG2)
+// Sizes below this all share the first level, 16 bytes apart
+#define RWMEM_HEAP_SMALL_SIZE (RWMEM_HEAP_SL_COUNT * 16)
+#define RWMEM_HEAP_FL_COUNT (RWMEM_HEAP_MAX_LOG2 - (RWMEM_HEAP_SL_LOG2 + 4) + 1)
+
+// Inline before every MemoryHeap allocation. The blocks of a heap tile its region, so the
+// next block always starts right after this one and prev_phys leads to the one before.
+typedef struct MH_Block {
+  MH_Block *prev_phys; // only valid while the previous block is free
+  size_t size;         // usable bytes, the lowest 2 bits flag this and the previous block as free
+} MH_Block;
+
+// NOTE(ray): Two level segregated fit (TLSF) allocator. The first level splits free blocks by
+// power of 2, the second splits every power of 2 linearly. A bitmap per level finds the first
+// non empty list big enough in O(1), and freeing merges with neighbouring free blocks in O(1).
+typedef struct MemoryHeap {
+  uint32_t fl_bitmap;
+  uint32_t sl_bitmap[RWMEM_HEAP_FL_COUNT];
+  MH_Block *free_lists[RWMEM_HEAP_FL_COUNT][RWMEM_HEAP_SL_COUNT];
+  MH_Block *first_block;
+  size_t used_bytes;
+  size_t free_bytes;
+} MemoryHeap;
+
+typedef struct MemoryHeapStats {
+  size_t used_bytes;
+  size_t free_bytes; // not counting block headers
+  size_t largest_free_block;
+  size_t num_used_blocks;
+  size_t num_free_blocks;
+  // 0 when all free memory is in one block, approaching 1 as it gets split into small ones
+  float fragmentation;
+} MemoryHeapStats;
+
+#if defined(RWMEM_CONCURRENT)
+// Inline at the start of every ConcurrentArena block like MA_BlockHeader
+typedef struct CA_BlockHeader {
+  CA_BlockHeader *next;
+  size_t size;
+  int64_t volatile pos; // bumped by every allocating thread, may run past size
+} CA_BlockHeader;
+
+typedef struct ConcurrentArena {
+  size_t block_size_bytes;
+  CA_BlockHeader * volatile cur_block;
+  // Blocks that filled up and blocks of large allocations, pushed lock free
+  CA_BlockHeader * volatile used_blocks;
+  // Default sized blocks made available by a reset, popped lock free
+  CA_BlockHeader * volatile available_blocks;
+} ConcurrentArena;
+
+// One MemoryArena per job system thread plus one for threads outside of it
+typedef struct MemoryArenaRegistry {
+  MemoryArena *arenas;
+  int num_arenas;
+} MemoryArenaRegistry;
+#endif
+
 ///////////////////////////////////////////////////////////////////////////////
 // __API
 ///////////////////////////////////////////////////////////////////////////////
@@ -65,13 +223,96 @@ RWMEM_DEF void rwmem_aligned_free(void *p);
 
 // __ARENA
 RWMEM_DEF MemoryArena rwmem_arena_create(size_t block_size_bytes);
+// Reserves one contiguous range of address space and commits pages as the arena grows.
+// Allocations never move to another block, they return NULL once reserve_bytes run out.
+// Resetting gives the committed pages (except the first RWMEM_VIRTUAL_COMMIT_BYTES) back to the OS.
+// Falls back to a regular block arena if the range can't be reserved.
+RWMEM_DEF MemoryArena rwmem_arena_create_virtual(size_t reserve_bytes);
+// 16 byte aligned
 RWMEM_DEF void *rwmem_arena_alloc(MemoryArena *arena, size_t bytes);
+// alignment must be a power of 2
+RWMEM_DEF void *rwmem_arena_alloc_aligned(MemoryArena *arena, size_t bytes, size_t alignment);
+// No alignment or padding at all, for byte data like strings
+RWMEM_DEF void *rwmem_arena_alloc_packed(MemoryArena *arena, size_t bytes);
 RWMEM_DEF void rwmem_arena_free(MemoryArena *arena);
 // Reset offset and move all memory from used blocks to available blocks
 RWMEM_DEF void rwmem_arena_reset(MemoryArena *arena);
+// Saves the current position of the arena
+RWMEM_DEF MemoryArenaMark rwmem_arena_mark(MemoryArena *arena);
+// Frees everything allocated since mark was taken. Blocks started since then become available again.
+// Marks must be rewound in reverse order (like a stack) and not across a reset.
+RWMEM_DEF void rwmem_arena_rewind(MemoryArena *arena, MemoryArenaMark mark);
+#if defined(RWMEM_TRACK_STATS)
+// Prints arena->stats along with the smallest power of 2 block size that fits the peak usage
+RWMEM_DEF void rwmem_arena_stats_printf(const char *label, MemoryArena *arena);
+#endif
+
+// __POOL
+// arena can be NULL to get chunks from the heap. Handles cost 8 extra bytes per element.
+RWMEM_DEF MemoryPool rwmem_pool_create(size_t element_size, size_t alignment, uint32_t elements_per_chunk,
+                                       MemoryArena *arena, bool handles);
+// NULL if a new chunk was needed and couldn't be allocated
+RWMEM_DEF void *rwmem_pool_alloc(MemoryPool *pool);
+RWMEM_DEF void rwmem_pool_release(MemoryPool *pool, void *p);
+// Frees the chunks (unless they came from an arena)
+RWMEM_DEF void rwmem_pool_free(MemoryPool *pool);
+// Only for pools created with handles
+RWMEM_DEF MemoryPoolHandle rwmem_pool_alloc_handle(MemoryPool *pool);
+// NULL if the element has been released since
+RWMEM_DEF void *rwmem_pool_get(MemoryPool *pool, MemoryPoolHandle handle);
+// Stale handles are ignored
+RWMEM_DEF void rwmem_pool_release_handle(MemoryPool *pool, MemoryPoolHandle handle);
+
+// __HEAP
+// Manages the memory region it is given (the heap doesn't allocate anything itself).
+// Allocations are 16 byte aligned and cost 16 bytes of bookkeeping, alloc and free
+// take the same bounded time however full or fragmented the heap is.
+RWMEM_DEF MemoryHeap rwmem_heap_create(void *memory, size_t size);
+// NULL if no free block is big enough
+RWMEM_DEF void *rwmem_heap_alloc(MemoryHeap *heap, size_t bytes);
+RWMEM_DEF void rwmem_heap_free(MemoryHeap *heap, void *p);
+// Usable size of an allocation, at least the number of bytes requested
+RWMEM_DEF size_t rwmem_heap_alloc_size(void *p);
+// Walks every block, O(number of blocks)
+RWMEM_DEF MemoryHeapStats rwmem_heap_stats(MemoryHeap *heap);
+
+#if defined(RWMEM_CONCURRENT)
+// __CONCURRENT
+RWMEM_DEF ConcurrentArena rwmem_concurrent_arena_create(size_t block_size_bytes);
+// Safe to call from any number of threads at once. 16 byte aligned.
+RWMEM_DEF void *rwmem_concurrent_arena_alloc(ConcurrentArena *arena, size_t bytes);
+// alignment must be a power of 2
+RWMEM_DEF void *rwmem_concurrent_arena_alloc_aligned(ConcurrentArena *arena, size_t bytes, size_t alignment);
+// Reset and free must not run at the same time as anything else on the arena
+RWMEM_DEF void rwmem_concurrent_arena_reset(ConcurrentArena *arena);
+RWMEM_DEF void rwmem_concurrent_arena_free(ConcurrentArena *arena);
+
+// Call after rwth_jobs_init, it makes an arena for each of its threads
+RWMEM_DEF MemoryArenaRegistry rwmem_arena_registry_create(size_t block_size_bytes);
+// The calling thread's arena. Threads outside the job system share one,
+// so only one of them may use it at a time.
+RWMEM_DEF MemoryArena *rwmem_arena_registry_get(MemoryArenaRegistry *registry);
+// Resets every arena, while no jobs are running
+RWMEM_DEF void rwmem_arena_registry_reset(MemoryArenaRegistry *registry);
+RWMEM_DEF void rwmem_arena_registry_free(MemoryArenaRegistry *registry);
+#endif
 
 #ifdef __cplusplus
 }
+
+// Rewinds the arena to where it was when the scope was created, e.g.
+//   { MemoryArenaScope scratch(&arena); ... temporary allocations ... }
+struct MemoryArenaScope {
+  MemoryArena *arena;
+  MemoryArenaMark mark;
+
+  MemoryArenaScope(MemoryArena *arena) : arena(arena), mark(rwmem_arena_mark(arena)) {}
+  ~MemoryArenaScope() { rwmem_arena_rewind(arena, mark); }
+
+private:
+  MemoryArenaScope(const MemoryArenaScope &);
+  MemoryArenaScope &operator=(const MemoryArenaScope &);
+};
 #endif
 
 
@@ -88,6 +329,31 @@ RWMEM_DEF void rwmem_arena_reset(MemoryArena *arena);
 
 #define DEFAULT_ARENA_BLOCK_SIZE_BYTES 262144
 
+// Granularity virtual arenas commit memory in, must be a multiple of the page size
+#ifndef RWMEM_VIRTUAL_COMMIT_BYTES
+#define RWMEM_VIRTUAL_COMMIT_BYTES 65536
+#endif
+
+#if defined(__cplusplus)
+#define RWMEM_ALIGNOF(type) alignof(type)
+#else
+#define RWMEM_ALIGNOF(type) _Alignof(type)
+#endif
+
+// Allocate with the natural alignment of the type, e.g.
+//   Particle *p = RWMEM_PUSH_ARRAY(&arena, Particle, 256);
+#define RWMEM_PUSH_STRUCT(arena, type) \
+  ((type *) rwmem_arena_alloc_aligned((arena), sizeof(type), RWMEM_ALIGNOF(type)))
+#define RWMEM_PUSH_ARRAY(arena, type, count) \
+  ((type *) rwmem_arena_alloc_aligned((arena), (count) * sizeof(type), RWMEM_ALIGNOF(type)))
+
+// Typed pool without handles, e.g.
+//   MemoryPool particles = RWMEM_POOL_CREATE(Particle, 1024, NULL);
+//   Particle *p = RWMEM_POOL_ALLOC(&particles, Particle);
+#define RWMEM_POOL_CREATE(type, elements_per_chunk, arena) \
+  rwmem_pool_create(sizeof(type), RWMEM_ALIGNOF(type), (elements_per_chunk), (arena), false)
+#define RWMEM_POOL_ALLOC(pool, type) ((type *) rwmem_pool_alloc(pool))
+
 
 ///////////////////////////////////////////////////////////////////////////////
 // __IMPLEMENTATION
@@ -95,12 +361,23 @@ RWMEM_DEF void rwmem_arena_reset(MemoryArena *arena);
 
 #if defined(RWMEM_IMPLEMENTATION) || defined(RWMEM_HEADER_ONLY)
 
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#if defined(RWMEM_TRACK_STATS)
+#include <stdio.h> // printf
+#endif
+
 #if defined(__APPLE__) || defined(__linux__)
 #include <stdlib.h>
+#include <sys/mman.h>
 #define RWMEM_POSIX_MEMALIGN_AVAILABLE
+#define RWMEM_MMAP_AVAILABLE
 #elif defined(_WIN32)
 #include <malloc.h>
+#include <windows.h>
 #define RWMEM_ALIGNED_MALLOC_AVAILABLE
+#define RWMEM_VIRTUALALLOC_AVAILABLE
 #else
 #include <stdlib.h>
 #include <malloc.h>
@@ -129,125 +406,838 @@ RWMEM_DEF void rwmem_aligned_free(void *p) {
 #endif
 }
 
+// x must not be 0
+static inline int rwmem__lsb32(uint32_t x) {
+#if defined(_MSC_VER)
+  unsigned long result;
+  _BitScanForward(&result, x);
+  return (int) result;
+#else
+  return __builtin_ctz(x);
+#endif
+}
+
+static inline int rwmem__msb(size_t x) {
+#if defined(_MSC_VER) && defined(_WIN64)
+  unsigned long result;
+  _BitScanReverse64(&result, x);
+  return (int) result;
+#elif defined(_MSC_VER)
+  unsigned long result;
+  _BitScanReverse(&result, x);
+  return (int) result;
+#else
+  return (int) (sizeof(unsigned long long) * 8 - 1) - __builtin_clzll(x);
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// __VIRTUAL
+///////////////////////////////////////////////////////////////////////////////
+
+// Address space only, nothing is backed by physical memory until committed
+static void *rwmem__vm_reserve(size_t size) {
+#if defined(RWMEM_MMAP_AVAILABLE)
+  void *result = mmap(NULL, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  return result == MAP_FAILED ? NULL : result;
+#elif defined(RWMEM_VIRTUALALLOC_AVAILABLE)
+  return VirtualAlloc(NULL, size, MEM_RESERVE, PAGE_NOACCESS);
+#else
+  (void) size;
+  return NULL;
+#endif
+}
+
+static bool rwmem__vm_commit(void *p, size_t size) {
+#if defined(RWMEM_MMAP_AVAILABLE)
+  return mprotect(p, size, PROT_READ | PROT_WRITE) == 0;
+#elif defined(RWMEM_VIRTUALALLOC_AVAILABLE)
+  return VirtualAlloc(p, size, MEM_COMMIT, PAGE_READWRITE) != NULL;
+#else
+  (void) p; (void) size;
+  return false;
+#endif
+}
+
+// Returns the physical pages to the OS but keeps the address range reserved
+static void rwmem__vm_decommit(void *p, size_t size) {
+#if defined(RWMEM_MMAP_AVAILABLE)
+  madvise(p, size, MADV_DONTNEED);
+  mprotect(p, size, PROT_NONE);
+#elif defined(RWMEM_VIRTUALALLOC_AVAILABLE)
+  VirtualFree(p, size, MEM_DECOMMIT);
+#else
+  (void) p; (void) size;
+#endif
+}
+
+static void rwmem__vm_release(void *p, size_t size) {
+#if defined(RWMEM_MMAP_AVAILABLE)
+  munmap(p, size);
+#elif defined(RWMEM_VIRTUALALLOC_AVAILABLE)
+  (void) size;
+  VirtualFree(p, 0, MEM_RELEASE);
+#else
+  (void) p; (void) size;
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// __ARENA
+///////////////////////////////////////////////////////////////////////////////
+
+#define RWMEM__BLOCK_HEADER_SIZE ALIGN16(sizeof(MA_BlockHeader))
+
+#if defined(RWMEM_TRACK_STATS)
+static inline void rwmem__stats_reserved(MemoryArena *arena, size_t bytes_reserved) {
+  arena->stats.bytes_reserved = bytes_reserved;
+  if (bytes_reserved > arena->stats.peak_bytes_reserved) arena->stats.peak_bytes_reserved = bytes_reserved;
+}
+
+static inline void rwmem__stats_alloc(MemoryArena *arena, size_t bytes, size_t padding) {
+  MemoryArenaStats *stats = &arena->stats;
+  stats->num_allocs++;
+  stats->bytes_requested += bytes;
+  stats->padding_bytes += padding;
+  if (bytes > stats->largest_alloc) stats->largest_alloc = bytes;
+  stats->bytes_in_use += bytes + padding;
+  if (stats->bytes_in_use > stats->peak_bytes_in_use) stats->peak_bytes_in_use = stats->bytes_in_use;
+  int bucket = bytes <= 16 ? 0 : rwmem__msb(bytes - 1) - 3;
+  if (bucket >= RWMEM_STATS_HISTOGRAM_COUNT) bucket = RWMEM_STATS_HISTOGRAM_COUNT - 1;
+  stats->size_histogram[bucket]++;
+}
+#endif
+
+static inline MA_BlockHeader *rwmem__block_header(uint8_t *block_ptr) {
+  return (MA_BlockHeader *) (block_ptr - RWMEM__BLOCK_HEADER_SIZE);
+}
+
+static inline int rwmem__block_bucket(MemoryArena *arena, size_t size) {
+  return size > arena->block_size_bytes ? MA_BLOCK_BUCKET_LARGE : MA_BLOCK_BUCKET_DEFAULT;
+}
+
+static inline void rwmem__block_push(MA_BlockList *list, MA_BlockHeader *block) {
+  block->next = list->head;
+  if (list->head == NULL) list->tail = block;
+  list->head = block;
+}
+
+static inline MA_BlockHeader *rwmem__block_pop(MA_BlockList *list) {
+  MA_BlockHeader *result = list->head;
+  if (result != NULL) {
+    list->head = result->next;
+    if (list->head == NULL) list->tail = NULL;
+  }
+  return result;
+}
+
+// Moves every block of src to the front of dst
+static inline void rwmem__block_splice(MA_BlockList *dst, MA_BlockList *src) {
+  if (src->head == NULL) return;
+  src->tail->next = dst->head;
+  if (dst->head == NULL) dst->tail = src->tail;
+  dst->head = src->head;
+  src->head = NULL;
+  src->tail = NULL;
+}
+
+static void rwmem__block_list_free(MA_BlockList *list) {
+  MA_BlockHeader *block = list->head;
+  while (block) {
+    MA_BlockHeader *next = block->next;
+    rwmem_aligned_free(block);
+    block = next;
+  }
+  list->head = NULL;
+  list->tail = NULL;
+}
+
 RWMEM_DEF MemoryArena rwmem_arena_create(size_t block_size_bytes) {
-  MemoryArena result;
+  MemoryArena result = {};
   result.block_size_bytes = block_size_bytes;
   result.cur_block_pos = 0;
   result.cur_alloc_size = 0;
   result.cur_block_ptr = NULL;
-  result.used_blocks_node = NULL;
-  result.available_blocks_node = NULL;
   return result;
 }
 
-RWMEM_DEF void *rwmem_arena_alloc(MemoryArena *arena, size_t bytes) {
-  // NOTE(ray): Round up requested bytes to align. Safer.
-  bytes = ALIGN16(bytes);
+RWMEM_DEF MemoryArena rwmem_arena_create_virtual(size_t reserve_bytes) {
+  MemoryArena result = rwmem_arena_create(RWMEM_VIRTUAL_COMMIT_BYTES);
+  reserve_bytes = ALIGN_X(reserve_bytes, (size_t) RWMEM_VIRTUAL_COMMIT_BYTES);
+  uint8_t *base = reserve_bytes ? (uint8_t *) rwmem__vm_reserve(reserve_bytes) : NULL;
+  if (base != NULL) {
+    // NOTE(ray): The whole reserved range is the one and only block, it has no header
+    result.cur_block_ptr = base;
+    result.cur_alloc_size = reserve_bytes;
+    result.reserved_bytes = reserve_bytes;
+  }
+  return result;
+}
 
-  if (arena->cur_block_pos + bytes > arena->cur_alloc_size) {
+// Retires the current block and makes a block with at least min_size usable bytes current
+static void rwmem__arena_next_block(MemoryArena *arena, size_t min_size) {
+#if defined(RWMEM_TRACK_STATS)
+  if (arena->cur_block_ptr != NULL) {
+    arena->stats.num_rollovers++;
+    arena->stats.tail_bytes_wasted += arena->cur_alloc_size - arena->cur_block_pos;
+  }
+#endif
+  // Add the current block to the used blocks list
+  if (arena->cur_block_ptr != NULL) {
+    MA_BlockHeader *cur_block = rwmem__block_header(arena->cur_block_ptr);
+    rwmem__block_push(&arena->used_blocks[rwmem__block_bucket(arena, cur_block->size)], cur_block);
+    arena->cur_block_ptr = NULL;
+  }
+
+  // Try to first get a block from the available blocks.
+  // NOTE(ray): Only the front of the list is looked at. Default blocks always fit and
+  // large blocks are reused if the front one is big enough, otherwise a new one is made.
+  // This code path won't be taken unless the arena is reset via rwmem_arena_reset(arena)
+  MA_BlockList *available = &arena->available_blocks[rwmem__block_bucket(arena, min_size)];
+  MA_BlockHeader *block = available->head;
+  if (block != NULL && block->size >= min_size) {
+    rwmem__block_pop(available);
+  } else {
+    size_t size = min_size > arena->block_size_bytes ? min_size : arena->block_size_bytes;
+    block = (MA_BlockHeader *) rwmem_aligned_alloc(RWMEM__BLOCK_HEADER_SIZE + size, 16);
+    block->size = size;
+#if defined(RWMEM_TRACK_STATS)
+    arena->stats.num_blocks_allocated++;
+    rwmem__stats_reserved(arena, arena->stats.bytes_reserved + RWMEM__BLOCK_HEADER_SIZE + size);
+#endif
+  }
+  block->next = NULL;
+
+  arena->cur_block_ptr = (uint8_t *) block + RWMEM__BLOCK_HEADER_SIZE;
+  arena->cur_alloc_size = block->size;
+  arena->cur_block_pos = 0;
+}
+
+RWMEM_DEF void *rwmem_arena_alloc_aligned(MemoryArena *arena, size_t bytes, size_t alignment) {
+  uintptr_t base = (uintptr_t) arena->cur_block_ptr;
+  size_t pos = ALIGN_X(base + arena->cur_block_pos, alignment) - base;
+
+  if (arena->reserved_bytes) {
+    if (pos + bytes > arena->reserved_bytes) return NULL;
+    if (pos + bytes > arena->committed_bytes) {
+      size_t committed = ALIGN_X(pos + bytes, arena->block_size_bytes);
+      if (!rwmem__vm_commit(arena->cur_block_ptr + arena->committed_bytes, committed - arena->committed_bytes)) {
+        return NULL;
+      }
+      arena->committed_bytes = committed;
+#if defined(RWMEM_TRACK_STATS)
+      rwmem__stats_reserved(arena, committed);
+#endif
+    }
+  } else if (arena->cur_block_ptr == NULL || pos + bytes > arena->cur_alloc_size) {
     // The number of bytes we have requested exceed the current block size.
-    // So add this block to the used blocks list
+    // NOTE(ray): Blocks start 16 byte aligned so larger alignments may need some padding
+    rwmem__arena_next_block(arena, bytes + (alignment > 16 ? alignment - 16 : 0));
+    base = (uintptr_t) arena->cur_block_ptr;
+    pos = ALIGN_X(base, alignment) - base;
+  }
+
+  void *result = arena->cur_block_ptr + pos;
+#if defined(RWMEM_TRACK_STATS)
+  rwmem__stats_alloc(arena, bytes, pos - arena->cur_block_pos);
+#endif
+  arena->cur_block_pos = pos + bytes;
+
+  return result;
+}
+
+RWMEM_DEF void *rwmem_arena_alloc(MemoryArena *arena, size_t bytes) {
+  return rwmem_arena_alloc_aligned(arena, bytes, 16);
+}
+
+RWMEM_DEF void *rwmem_arena_alloc_packed(MemoryArena *arena, size_t bytes) {
+  return rwmem_arena_alloc_aligned(arena, bytes, 1);
+}
+
+RWMEM_DEF void rwmem_arena_free(MemoryArena *arena) {
+  if (arena->reserved_bytes) {
+    rwmem__vm_release(arena->cur_block_ptr, arena->reserved_bytes);
+    arena->reserved_bytes = 0;
+    arena->committed_bytes = 0;
+  } else if (arena->cur_block_ptr != NULL) {
+    rwmem_aligned_free(rwmem__block_header(arena->cur_block_ptr));
+  }
+  for (int i = 0; i < MA_BLOCK_BUCKET_COUNT; i++) {
+    rwmem__block_list_free(&arena->used_blocks[i]);
+    rwmem__block_list_free(&arena->available_blocks[i]);
+  }
+  arena->cur_block_ptr = NULL;
+  arena->cur_block_pos = 0;
+  arena->cur_alloc_size = 0;
+#if defined(RWMEM_TRACK_STATS)
+  arena->stats.bytes_in_use = 0;
+  arena->stats.bytes_reserved = 0;
+#endif
+}
+
+// Reset offset and move all memory from used blocks to available blocks
+RWMEM_DEF void rwmem_arena_reset(MemoryArena *arena) {
+  arena->cur_block_pos = 0;
+  if (arena->reserved_bytes && arena->committed_bytes > arena->block_size_bytes) {
+    // NOTE(ray): The first commit step stays so an arena reset every frame doesn't fault on every use
+    rwmem__vm_decommit(arena->cur_block_ptr + arena->block_size_bytes,
+                       arena->committed_bytes - arena->block_size_bytes);
+    arena->committed_bytes = arena->block_size_bytes;
+#if defined(RWMEM_TRACK_STATS)
+    arena->stats.bytes_reserved = arena->committed_bytes;
+#endif
+  }
+#if defined(RWMEM_TRACK_STATS)
+  arena->stats.bytes_in_use = 0;
+#endif
+  for (int i = 0; i < MA_BLOCK_BUCKET_COUNT; i++) {
+    rwmem__block_splice(&arena->available_blocks[i], &arena->used_blocks[i]);
+  }
+}
+
+RWMEM_DEF MemoryArenaMark rwmem_arena_mark(MemoryArena *arena) {
+  MemoryArenaMark result;
+  result.block_ptr = arena->cur_block_ptr;
+  result.block_pos = arena->cur_block_pos;
+  for (int i = 0; i < MA_BLOCK_BUCKET_COUNT; i++) {
+    result.used_heads[i] = arena->used_blocks[i].head;
+  }
+#if defined(RWMEM_TRACK_STATS)
+  result.bytes_in_use = arena->stats.bytes_in_use;
+#endif
+  return result;
+}
+
+RWMEM_DEF void rwmem_arena_rewind(MemoryArena *arena, MemoryArenaMark mark) {
+  if (arena->cur_block_ptr != mark.block_ptr) {
+    // NOTE(ray): Every block retired since the mark sits in front of the saved used list heads.
+    // That includes the marked block itself, which becomes the current block again.
+    MA_BlockHeader *mark_block = mark.block_ptr ? rwmem__block_header(mark.block_ptr) : NULL;
     if (arena->cur_block_ptr != NULL) {
-      // TODO(ray): MAKE THIS NOT USE A LINKED LIST!!!
-      // Traverse to the end of the list so we can add a new node
-      if (arena->used_blocks_node == NULL) {
-        arena->used_blocks_node = (MA_BookkeepingNode *) rwmem_aligned_alloc(sizeof(MA_BookkeepingNode), 16);
-        arena->used_blocks_node->cur_alloc_size = arena->cur_alloc_size;
-        arena->used_blocks_node->block_ptr = arena->cur_block_ptr;
-        arena->used_blocks_node->next = NULL;
-      } else {
-        MA_BookkeepingNode *cur_used_blocks_node = arena->used_blocks_node;
-        while (cur_used_blocks_node->next != NULL) {
-          cur_used_blocks_node = cur_used_blocks_node->next;
-        }
-        cur_used_blocks_node->next = (MA_BookkeepingNode *) rwmem_aligned_alloc(sizeof(MA_BookkeepingNode), 16);
-        cur_used_blocks_node->next->cur_alloc_size = arena->cur_alloc_size;
-        cur_used_blocks_node->next->block_ptr = arena->cur_block_ptr;
-        cur_used_blocks_node->next->next = NULL;
+      MA_BlockHeader *cur_block = rwmem__block_header(arena->cur_block_ptr);
+      rwmem__block_push(&arena->available_blocks[rwmem__block_bucket(arena, cur_block->size)], cur_block);
+    }
+    for (int i = 0; i < MA_BLOCK_BUCKET_COUNT; i++) {
+      while (arena->used_blocks[i].head != mark.used_heads[i]) {
+        MA_BlockHeader *block = rwmem__block_pop(&arena->used_blocks[i]);
+        if (block != mark_block) rwmem__block_push(&arena->available_blocks[i], block);
       }
-      // Set the current block pointer to NULL. Will be creating a new one below.
-      arena->cur_block_ptr = NULL;
     }
+    arena->cur_block_ptr = mark.block_ptr;
+    arena->cur_alloc_size = mark_block ? mark_block->size : 0;
+  }
+  arena->cur_block_pos = mark.block_pos;
+#if defined(RWMEM_TRACK_STATS)
+  arena->stats.bytes_in_use = mark.bytes_in_use;
+#endif
+}
+
+#if defined(RWMEM_TRACK_STATS)
+RWMEM_DEF void rwmem_arena_stats_printf(const char *label, MemoryArena *arena) {
+  MemoryArenaStats *stats = &arena->stats;
+  size_t suggested = 16;
+  while (suggested < stats->peak_bytes_in_use) suggested <<= 1;
+  printf("%s:\n", label);
+  printf("  allocations: %zu, %zu bytes requested, largest %zu\n",
+         stats->num_allocs, stats->bytes_requested, stats->largest_alloc);
+  printf("  in use: %zu bytes, peak %zu\n", stats->bytes_in_use, stats->peak_bytes_in_use);
+  printf("  reserved: %zu bytes, peak %zu, %zu blocks of %zu allocated\n",
+         stats->bytes_reserved, stats->peak_bytes_reserved, stats->num_blocks_allocated, arena->block_size_bytes);
+  printf("  rollovers: %zu, tail bytes wasted %zu, padding bytes %zu\n",
+         stats->num_rollovers, stats->tail_bytes_wasted, stats->padding_bytes);
+  printf("  block size that fits the peak: %zu\n", suggested);
+  printf("  allocation sizes:\n");
+  for (int i = 0; i < RWMEM_STATS_HISTOGRAM_COUNT; i++) {
+    if (stats->size_histogram[i] == 0) continue;
+    if (i == RWMEM_STATS_HISTOGRAM_COUNT - 1) {
+      printf("    > %zu: %zu\n", (size_t) 16 << (i - 1), stats->size_histogram[i]);
+    } else {
+      printf("    <= %zu: %zu\n", (size_t) 16 << i, stats->size_histogram[i]);
+    }
+  }
+}
+#endif
 
-    // Try to first get a block from the available blocks
-    // NOTE(ray): This code path won't be taken unless the arena is reset via rwmem_arena_reset(arena)
-    MA_BookkeepingNode *cur_available_blocks_node = arena->available_blocks_node;
-    MA_BookkeepingNode *prev_available_blocks_node = NULL;
-    while (cur_available_blocks_node != NULL) {
-      // TODO(ray): MAKE THIS NOT USE A LINKED LIST!!!
-      // Find the first available block that can hold requested bytes
-      if (cur_available_blocks_node->cur_alloc_size >= bytes) {
-        arena->cur_alloc_size = cur_available_blocks_node->cur_alloc_size;
-        arena->cur_block_ptr = cur_available_blocks_node->block_ptr;
-        // Remove this block from the available blocks list and free
-        if (prev_available_blocks_node != NULL) { // Delete middle
-          prev_available_blocks_node->next = cur_available_blocks_node->next;
-        } else if (cur_available_blocks_node->next) { // Delete front
-          arena->available_blocks_node = cur_available_blocks_node->next;
-        } else { // Only 1 element
-          arena->available_blocks_node = NULL;
-        }
-        rwmem_aligned_free(cur_available_blocks_node);
-        break;
+///////////////////////////////////////////////////////////////////////////////
+// __POOL
+///////////////////////////////////////////////////////////////////////////////
+
+// Kept right after the element in every slot of a pool with handles
+typedef struct MP_SlotInfo {
+  uint32_t index;
+  uint32_t generation;
+} MP_SlotInfo;
+
+static inline size_t rwmem__pool_info_offset(MemoryPool *pool) {
+  size_t size = pool->element_size > sizeof(void *) ? pool->element_size : sizeof(void *);
+  return ALIGN_X(size, RWMEM_ALIGNOF(MP_SlotInfo));
+}
+
+static inline MP_SlotInfo *rwmem__pool_info(MemoryPool *pool, void *p) {
+  return (MP_SlotInfo *) ((uint8_t *) p + rwmem__pool_info_offset(pool));
+}
+
+static inline uint8_t *rwmem__pool_slot(MemoryPool *pool, uint32_t index) {
+  return pool->chunks[index / pool->elements_per_chunk] +
+         (size_t) (index % pool->elements_per_chunk) * pool->slot_size;
+}
+
+RWMEM_DEF MemoryPool rwmem_pool_create(size_t element_size, size_t alignment, uint32_t elements_per_chunk,
+                                       MemoryArena *arena, bool handles) {
+  MemoryPool result = {};
+  result.arena = arena;
+  result.element_size = element_size;
+  // NOTE(ray): Free slots hold the free list pointer
+  result.alignment = alignment > sizeof(void *) ? alignment : sizeof(void *);
+  result.handles = handles;
+  result.elements_per_chunk = elements_per_chunk > 0 ? elements_per_chunk : 1;
+  size_t size = handles ? rwmem__pool_info_offset(&result) + sizeof(MP_SlotInfo) :
+                element_size > sizeof(void *) ? element_size : sizeof(void *);
+  result.slot_size = ALIGN_X(size, result.alignment);
+  return result;
+}
+
+RWMEM_DEF void *rwmem_pool_alloc(MemoryPool *pool) {
+  void *result = pool->free_list;
+  if (result != NULL) {
+    pool->free_list = *(void **) result;
+  } else {
+    // Carve the next slot out of the newest chunk, making a new chunk when it is full
+    if (pool->num_slots == pool->num_chunks * pool->elements_per_chunk) {
+      size_t chunk_bytes = pool->slot_size * pool->elements_per_chunk;
+      uint8_t *chunk = pool->arena ? (uint8_t *) rwmem_arena_alloc_aligned(pool->arena, chunk_bytes, pool->alignment) :
+                                     (uint8_t *) rwmem_aligned_alloc(chunk_bytes, pool->alignment);
+      if (chunk == NULL) return NULL;
+      if (pool->num_chunks == pool->chunk_capacity) {
+        pool->chunk_capacity = pool->chunk_capacity ? pool->chunk_capacity * 2 : 8;
+        pool->chunks = (uint8_t **) realloc(pool->chunks, pool->chunk_capacity * sizeof(uint8_t *));
       }
-      prev_available_blocks_node = cur_available_blocks_node;
-      cur_available_blocks_node = cur_available_blocks_node->next;
+      pool->chunks[pool->num_chunks++] = chunk;
     }
+    uint32_t index = pool->num_slots++;
+    result = rwmem__pool_slot(pool, index);
+    if (pool->handles) {
+      MP_SlotInfo *info = rwmem__pool_info(pool, result);
+      info->index = index;
+      info->generation = 1;
+    }
+  }
+  pool->num_used++;
+  return result;
+}
+
+RWMEM_DEF void rwmem_pool_release(MemoryPool *pool, void *p) {
+  if (p == NULL) return;
+  if (pool->handles) {
+    MP_SlotInfo *info = rwmem__pool_info(pool, p);
+    if (++info->generation == 0) info->generation = 1;
+  }
+  *(void **) p = pool->free_list;
+  pool->free_list = p;
+  pool->num_used--;
+}
 
-    if (arena->cur_block_ptr == NULL) {
-      arena->cur_alloc_size = bytes > arena->block_size_bytes ? bytes : arena->block_size_bytes;
-      arena->cur_block_ptr = (uint8_t *) rwmem_aligned_alloc(arena->cur_alloc_size, 16);
+RWMEM_DEF void rwmem_pool_free(MemoryPool *pool) {
+  if (pool->arena == NULL) {
+    for (uint32_t i = 0; i < pool->num_chunks; i++) {
+      rwmem_aligned_free(pool->chunks[i]);
     }
+  }
+  free(pool->chunks);
+  pool->chunks = NULL;
+  pool->num_chunks = 0;
+  pool->chunk_capacity = 0;
+  pool->num_slots = 0;
+  pool->num_used = 0;
+  pool->free_list = NULL;
+}
+
+RWMEM_DEF MemoryPoolHandle rwmem_pool_alloc_handle(MemoryPool *pool) {
+  MemoryPoolHandle result = {};
+  void *p = rwmem_pool_alloc(pool);
+  if (p != NULL) {
+    MP_SlotInfo *info = rwmem__pool_info(pool, p);
+    result.index = info->index;
+    result.generation = info->generation;
+  }
+  return result;
+}
+
+RWMEM_DEF void *rwmem_pool_get(MemoryPool *pool, MemoryPoolHandle handle) {
+  if (handle.generation == 0 || handle.index >= pool->num_slots) return NULL;
+  uint8_t *p = rwmem__pool_slot(pool, handle.index);
+  return rwmem__pool_info(pool, p)->generation == handle.generation ? p : NULL;
+}
+
+RWMEM_DEF void rwmem_pool_release_handle(MemoryPool *pool, MemoryPoolHandle handle) {
+  rwmem_pool_release(pool, rwmem_pool_get(pool, handle));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// __HEAP
+///////////////////////////////////////////////////////////////////////////////
+
+#define RWMEM__HEAP_HEADER_SIZE ALIGN16(sizeof(MH_Block))
+#define RWMEM__HEAP_BLOCK_FREE ((size_t) 1)
+#define RWMEM__HEAP_PREV_FREE ((size_t) 2)
+#define RWMEM__HEAP_FLAGS (RWMEM__HEAP_BLOCK_FREE | RWMEM__HEAP_PREV_FREE)
+// Free blocks keep their list links in their first bytes
+#define RWMEM__HEAP_MIN_SIZE ALIGN16(2 * sizeof(MH_Block *))
+// Largest block, it has to stay under the last first level list
+#define RWMEM__HEAP_MAX_ALLOC ((((size_t) 1) << (RWMEM_HEAP_MAX_LOG2 - 1)) - 16)
+
+typedef struct MH_FreeLinks {
+  MH_Block *next;
+  MH_Block *prev;
+} MH_FreeLinks;
+
+static inline size_t rwmem__heap_size(MH_Block *block) {
+  return block->size & ~RWMEM__HEAP_FLAGS;
+}
 
-    arena->cur_block_pos = 0;
+static inline MH_FreeLinks *rwmem__heap_links(MH_Block *block) {
+  return (MH_FreeLinks *) ((uint8_t *) block + RWMEM__HEAP_HEADER_SIZE);
+}
+
+static inline MH_Block *rwmem__heap_next_phys(MH_Block *block) {
+  return (MH_Block *) ((uint8_t *) block + RWMEM__HEAP_HEADER_SIZE + rwmem__heap_size(block));
+}
+
+static inline void rwmem__heap_mapping(size_t size, int *fl, int *sl) {
+  if (size < RWMEM_HEAP_SMALL_SIZE) {
+    *fl = 0;
+    *sl = (int) (size / 16);
+  } else {
+    int msb = rwmem__msb(size);
+    *sl = (int) (size >> (msb - RWMEM_HEAP_SL_LOG2)) ^ RWMEM_HEAP_SL_COUNT;
+    *fl = msb - (RWMEM_HEAP_SL_LOG2 + 4) + 1;
+  }
+}
+
+static void rwmem__heap_insert(MemoryHeap *heap, MH_Block *block) {
+  int fl, sl;
+  rwmem__heap_mapping(rwmem__heap_size(block), &fl, &sl);
+  MH_FreeLinks *links = rwmem__heap_links(block);
+  links->prev = NULL;
+  links->next = heap->free_lists[fl][sl];
+  if (links->next != NULL) rwmem__heap_links(links->next)->prev = block;
+  heap->free_lists[fl][sl] = block;
+  heap->fl_bitmap |= 1u << fl;
+  heap->sl_bitmap[fl] |= 1u << sl;
+}
+
+static void rwmem__heap_remove(MemoryHeap *heap, MH_Block *block) {
+  int fl, sl;
+  rwmem__heap_mapping(rwmem__heap_size(block), &fl, &sl);
+  MH_FreeLinks *links = rwmem__heap_links(block);
+  if (links->prev != NULL) rwmem__heap_links(links->prev)->next = links->next;
+  else heap->free_lists[fl][sl] = links->next;
+  if (links->next != NULL) rwmem__heap_links(links->next)->prev = links->prev;
+  if (heap->free_lists[fl][sl] == NULL) {
+    heap->sl_bitmap[fl] &= ~(1u << sl);
+    if (heap->sl_bitmap[fl] == 0) heap->fl_bitmap &= ~(1u << fl);
   }
+}
+
+RWMEM_DEF MemoryHeap rwmem_heap_create(void *memory, size_t size) {
+  MemoryHeap result = {};
+  uint8_t *start = (uint8_t *) ALIGN16((uintptr_t) memory);
+  uint8_t *end = (uint8_t *) ((uintptr_t) ((uint8_t *) memory + size) & ~(uintptr_t) 15);
+  // NOTE(ray): One free block spanning the region followed by an empty used block,
+  // which stops the last real block from trying to merge with whatever comes after
+  if (end <= start || (size_t) (end - start) < 3 * RWMEM__HEAP_HEADER_SIZE + RWMEM__HEAP_MIN_SIZE) return result;
+  size_t block_size = (size_t) (end - start) - 2 * RWMEM__HEAP_HEADER_SIZE;
+  if (block_size > RWMEM__HEAP_MAX_ALLOC) block_size = RWMEM__HEAP_MAX_ALLOC;
 
-  void *result = arena->cur_block_ptr + arena->cur_block_pos;
-  arena->cur_block_pos += bytes;
+  MH_Block *block = (MH_Block *) start;
+  block->prev_phys = NULL;
+  block->size = block_size | RWMEM__HEAP_BLOCK_FREE;
+  MH_Block *sentinel = rwmem__heap_next_phys(block);
+  sentinel->prev_phys = block;
+  sentinel->size = RWMEM__HEAP_PREV_FREE;
 
+  result.first_block = block;
+  result.free_bytes = block_size;
+  rwmem__heap_insert(&result, block);
   return result;
 }
 
-RWMEM_DEF void rwmem_arena_free(MemoryArena *arena) {
-  rwmem_aligned_free(arena->cur_block_ptr);
-  MA_BookkeepingNode *cur_used_blocks_node = arena->used_blocks_node;
-  while (cur_used_blocks_node) {
-    MA_BookkeepingNode *next = cur_used_blocks_node->next;
-    // Free the block's memory
-    rwmem_aligned_free(cur_used_blocks_node->block_ptr);
-    // Free bookkeeping node
-    rwmem_aligned_free(cur_used_blocks_node);
-    cur_used_blocks_node = next;
-  }
-  MA_BookkeepingNode *cur_available_blocks_node = arena->available_blocks_node;
-  while (cur_available_blocks_node) {
-    MA_BookkeepingNode *next = cur_available_blocks_node->next;
-    // Free the block's memory
-    rwmem_aligned_free(cur_available_blocks_node->block_ptr);
-    // Free bookkeeping node
-    rwmem_aligned_free(cur_available_blocks_node);
-    cur_available_blocks_node = next;
+RWMEM_DEF void *rwmem_heap_alloc(MemoryHeap *heap, size_t bytes) {
+  // NOTE(ray): Checked before rounding up, which would wrap around for sizes near SIZE_MAX
+  if (bytes > RWMEM__HEAP_MAX_ALLOC) return NULL;
+  size_t size = bytes < RWMEM__HEAP_MIN_SIZE ? RWMEM__HEAP_MIN_SIZE : ALIGN16(bytes);
+
+  // Round up to the next list so any block in it is big enough
+  size_t search_size = size;
+  if (search_size >= RWMEM_HEAP_SMALL_SIZE) {
+    search_size += ((size_t) 1 << (rwmem__msb(search_size) - RWMEM_HEAP_SL_LOG2)) - 1;
   }
+  int fl, sl;
+  rwmem__heap_mapping(search_size, &fl, &sl);
+  if (fl >= RWMEM_HEAP_FL_COUNT) return NULL;
+
+  MH_Block *block = NULL;
+  uint32_t sl_map = heap->sl_bitmap[fl] & (~0u << sl);
+  if (sl_map == 0) {
+    uint32_t fl_map = fl + 1 < 32 ? heap->fl_bitmap & (~0u << (fl + 1)) : 0;
+    if (fl_map != 0) {
+      fl = rwmem__lsb32(fl_map);
+      sl_map = heap->sl_bitmap[fl];
+    }
+  }
+  if (sl_map != 0) {
+    block = heap->free_lists[fl][rwmem__lsb32(sl_map)];
+  } else {
+    // NOTE(ray): Nothing in the bigger lists, but the first block of the request's own list
+    // might still fit (e.g. when asking for all the memory that is left)
+    rwmem__heap_mapping(size, &fl, &sl);
+    block = heap->free_lists[fl][sl];
+    if (block == NULL || rwmem__heap_size(block) < size) return NULL;
+  }
+  rwmem__heap_remove(heap, block);
+
+  // Split off what isn't needed if it's big enough to be a block of its own
+  size_t block_size = rwmem__heap_size(block);
+  MH_Block *next = rwmem__heap_next_phys(block);
+  if (block_size >= size + RWMEM__HEAP_HEADER_SIZE + RWMEM__HEAP_MIN_SIZE) {
+    MH_Block *rest = (MH_Block *) ((uint8_t *) block + RWMEM__HEAP_HEADER_SIZE + size);
+    rest->prev_phys = block;
+    rest->size = (block_size - size - RWMEM__HEAP_HEADER_SIZE) | RWMEM__HEAP_BLOCK_FREE;
+    next->prev_phys = rest;
+    rwmem__heap_insert(heap, rest);
+    block->size = size | (block->size & RWMEM__HEAP_PREV_FREE);
+    heap->free_bytes -= RWMEM__HEAP_HEADER_SIZE;
+    block_size = size;
+  } else {
+    block->size &= ~RWMEM__HEAP_BLOCK_FREE;
+    next->size &= ~RWMEM__HEAP_PREV_FREE;
+  }
+  heap->used_bytes += block_size;
+  heap->free_bytes -= block_size;
+
+  return (uint8_t *) block + RWMEM__HEAP_HEADER_SIZE;
 }
 
-// Reset offset and move all memory from used blocks to available blocks
-RWMEM_DEF void rwmem_arena_reset(MemoryArena *arena) {
-  arena->cur_block_pos = 0;
-  MA_BookkeepingNode *cur_used_blocks_node = arena->used_blocks_node;
-  if (cur_used_blocks_node == NULL) {
-    cur_used_blocks_node = arena->available_blocks_node;
+RWMEM_DEF void rwmem_heap_free(MemoryHeap *heap, void *p) {
+  if (p == NULL) return;
+  MH_Block *block = (MH_Block *) ((uint8_t *) p - RWMEM__HEAP_HEADER_SIZE);
+  size_t size = rwmem__heap_size(block);
+  heap->used_bytes -= size;
+  heap->free_bytes += size;
+
+  if (block->size & RWMEM__HEAP_PREV_FREE) {
+    MH_Block *prev = block->prev_phys;
+    rwmem__heap_remove(heap, prev);
+    prev->size += RWMEM__HEAP_HEADER_SIZE + size;
+    heap->free_bytes += RWMEM__HEAP_HEADER_SIZE;
+    block = prev;
   } else {
-    // Go to the end of used_blocks_nodes and attach available_blocks_nodes
-    while (cur_used_blocks_node->next != NULL) {
-      cur_used_blocks_node = cur_used_blocks_node->next;
+    block->size |= RWMEM__HEAP_BLOCK_FREE;
+  }
+  MH_Block *next = rwmem__heap_next_phys(block);
+  if (next->size & RWMEM__HEAP_BLOCK_FREE) {
+    rwmem__heap_remove(heap, next);
+    block->size += RWMEM__HEAP_HEADER_SIZE + rwmem__heap_size(next);
+    heap->free_bytes += RWMEM__HEAP_HEADER_SIZE;
+    next = rwmem__heap_next_phys(block);
+  }
+  next->prev_phys = block;
+  next->size |= RWMEM__HEAP_PREV_FREE;
+  rwmem__heap_insert(heap, block);
+}
+
+RWMEM_DEF size_t rwmem_heap_alloc_size(void *p) {
+  return rwmem__heap_size((MH_Block *) ((uint8_t *) p - RWMEM__HEAP_HEADER_SIZE));
+}
+
+RWMEM_DEF MemoryHeapStats rwmem_heap_stats(MemoryHeap *heap) {
+  MemoryHeapStats result = {};
+  result.used_bytes = heap->used_bytes;
+  result.free_bytes = heap->free_bytes;
+  MH_Block *block = heap->first_block;
+  while (block != NULL && rwmem__heap_size(block) > 0) {
+    size_t size = rwmem__heap_size(block);
+    if (block->size & RWMEM__HEAP_BLOCK_FREE) {
+      result.num_free_blocks++;
+      if (size > result.largest_free_block) result.largest_free_block = size;
+    } else {
+      result.num_used_blocks++;
     }
-    cur_used_blocks_node->next = arena->available_blocks_node;
+    block = rwmem__heap_next_phys(block);
+  }
+  if (result.free_bytes > 0) {
+    result.fragmentation = 1.0f - (float) result.largest_free_block / (float) result.free_bytes;
+  }
+  return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// __CONCURRENT
+///////////////////////////////////////////////////////////////////////////////
+
+#if defined(RWMEM_CONCURRENT)
+
+#define RWMEM__CA_HEADER_SIZE ALIGN16(sizeof(CA_BlockHeader))
+
+static inline uint8_t *rwmem__ca_block_data(CA_BlockHeader *block) {
+  return (uint8_t *) block + RWMEM__CA_HEADER_SIZE;
+}
+
+// NOTE(ray): Pushing onto a lock free stack is safe from any thread. Popping is only done
+// on available_blocks and nothing is pushed there until a reset, so it can't suffer from ABA.
+static void rwmem__ca_push(CA_BlockHeader * volatile *list, CA_BlockHeader *block) {
+  CA_BlockHeader *head = (CA_BlockHeader *) rwth_atomic_load_ptr((void * volatile *) list, RWTH_RELAXED);
+  for (;;) {
+    block->next = head;
+    CA_BlockHeader *prev = (CA_BlockHeader *) rwth_atomic_cas_ptr_explicit((void * volatile *) list, head, block, RWTH_RELEASE);
+    if (prev == head) return;
+    head = prev;
   }
-  // Set available_block_nodes pointer to be the start of used_block_nodes
-  arena->available_blocks_node = arena->used_blocks_node;
-  arena->used_blocks_node = NULL;
 }
 
+static CA_BlockHeader *rwmem__ca_pop(CA_BlockHeader * volatile *list) {
+  CA_BlockHeader *head = (CA_BlockHeader *) rwth_atomic_load_ptr((void * volatile *) list, RWTH_ACQUIRE);
+  while (head != NULL) {
+    CA_BlockHeader *prev = (CA_BlockHeader *) rwth_atomic_cas_ptr_explicit((void * volatile *) list, head, head->next, RWTH_ACQUIRE);
+    if (prev == head) break;
+    head = prev;
+  }
+  return head;
+}
+
+static CA_BlockHeader *rwmem__ca_new_block(size_t size) {
+  CA_BlockHeader *block = (CA_BlockHeader *) rwmem_aligned_alloc(RWMEM__CA_HEADER_SIZE + size, 16);
+  if (block != NULL) {
+    block->next = NULL;
+    block->size = size;
+  }
+  return block;
+}
+
+RWMEM_DEF ConcurrentArena rwmem_concurrent_arena_create(size_t block_size_bytes) {
+  ConcurrentArena result = {};
+  result.block_size_bytes = block_size_bytes;
+  return result;
+}
+
+RWMEM_DEF void *rwmem_concurrent_arena_alloc_aligned(ConcurrentArena *arena, size_t bytes, size_t alignment) {
+  // NOTE(ray): Every allocation takes a multiple of 16 bytes so the position a thread gets
+  // is already 16 byte aligned, bigger alignments reserve enough to align within it.
+  size_t size = ALIGN16(bytes + (alignment > 16 ? alignment - 16 : 0));
+
+  // Large allocations get their own block so they don't waste the rest of the current one
+  if (size > arena->block_size_bytes / 4) {
+    CA_BlockHeader *block = rwmem__ca_new_block(size);
+    if (block == NULL) return NULL;
+    block->pos = size;
+    rwmem__ca_push(&arena->used_blocks, block);
+    return (void *) ALIGN_X((uintptr_t) rwmem__ca_block_data(block), alignment);
+  }
+
+  CA_BlockHeader *spare = NULL;
+  void *result = NULL;
+  while (result == NULL) {
+    CA_BlockHeader *block = (CA_BlockHeader *) rwth_atomic_load_ptr((void * volatile *) &arena->cur_block, RWTH_ACQUIRE);
+    if (block != NULL) {
+      int64_t pos = rwth_atomic_add_i64_explicit(&block->pos, (int64_t) size, RWTH_RELAXED);
+      if ((size_t) pos + size <= block->size) {
+        result = rwmem__ca_block_data(block) + pos;
+        break;
+      }
+    }
+
+    // Block is full, try to replace it with one where this allocation comes first.
+    // Only the thread whose CAS succeeds retires the old block.
+    CA_BlockHeader *next = spare;
+    spare = NULL;
+    if (next == NULL) next = rwmem__ca_pop(&arena->available_blocks);
+    if (next == NULL) next = rwmem__ca_new_block(arena->block_size_bytes);
+    if (next == NULL) break;
+    next->pos = (int64_t) size;
+    void *prev = rwth_atomic_cas_ptr_explicit((void * volatile *) &arena->cur_block, block, next, RWTH_ACQ_REL);
+    if (prev == block) {
+      if (block != NULL) rwmem__ca_push(&arena->used_blocks, block);
+      result = rwmem__ca_block_data(next);
+    } else {
+      // Another thread got there first, keep the block for when that one is full too
+      spare = next;
+    }
+  }
+  // NOTE(ray): Pushing it back to available_blocks could cause ABA for the threads popping,
+  // so an unused spare sits with the used blocks until the next reset
+  if (spare != NULL) rwmem__ca_push(&arena->used_blocks, spare);
+
+  return result ? (void *) ALIGN_X((uintptr_t) result, alignment) : NULL;
+}
+
+RWMEM_DEF void *rwmem_concurrent_arena_alloc(ConcurrentArena *arena, size_t bytes) {
+  return rwmem_concurrent_arena_alloc_aligned(arena, bytes, 16);
+}
+
+RWMEM_DEF void rwmem_concurrent_arena_reset(ConcurrentArena *arena) {
+  CA_BlockHeader *block = arena->used_blocks;
+  while (block) {
+    CA_BlockHeader *next = block->next;
+    if (block->size == arena->block_size_bytes) {
+      block->next = arena->available_blocks;
+      arena->available_blocks = block;
+    } else {
+      rwmem_aligned_free(block);
+    }
+    block = next;
+  }
+  arena->used_blocks = NULL;
+  if (arena->cur_block != NULL) arena->cur_block->pos = 0;
+  rwth_atomic_thread_fence(RWTH_RELEASE);
+}
+
+RWMEM_DEF void rwmem_concurrent_arena_free(ConcurrentArena *arena) {
+  rwmem_concurrent_arena_reset(arena);
+  CA_BlockHeader *block = arena->available_blocks;
+  while (block) {
+    CA_BlockHeader *next = block->next;
+    rwmem_aligned_free(block);
+    block = next;
+  }
+  if (arena->cur_block != NULL) rwmem_aligned_free(arena->cur_block);
+  arena->cur_block = NULL;
+  arena->available_blocks = NULL;
+}
+
+RWMEM_DEF MemoryArenaRegistry rwmem_arena_registry_create(size_t block_size_bytes) {
+  MemoryArenaRegistry result = {};
+  result.num_arenas = rwth_jobs_num_threads() + 1;
+  result.arenas = (MemoryArena *) malloc(result.num_arenas * sizeof(MemoryArena));
+  for (int i = 0; i < result.num_arenas; i++) {
+    result.arenas[i] = rwmem_arena_create(block_size_bytes);
+  }
+  return result;
+}
+
+RWMEM_DEF MemoryArena *rwmem_arena_registry_get(MemoryArenaRegistry *registry) {
+  // NOTE(ray): The last arena is for threads outside the job system (index -1)
+  int index = rwth_jobs_worker_index();
+  if (index < 0 || index >= registry->num_arenas - 1) index = registry->num_arenas - 1;
+  return &registry->arenas[index];
+}
+
+RWMEM_DEF void rwmem_arena_registry_reset(MemoryArenaRegistry *registry) {
+  for (int i = 0; i < registry->num_arenas; i++) {
+    rwmem_arena_reset(&registry->arenas[i]);
+  }
+}
+
+RWMEM_DEF void rwmem_arena_registry_free(MemoryArenaRegistry *registry) {
+  for (int i = 0; i < registry->num_arenas; i++) {
+    rwmem_arena_free(&registry->arenas[i]);
+  }
+  free(registry->arenas);
+  registry->arenas = NULL;
+  registry->num_arenas = 0;
+}
+
+#endif // #if defined(RWMEM_CONCURRENT)
+
 #endif // #if defined(RWMEM_IMPLEMENTATION) || defined(RWMEM_HEADER_ONLY)
 
 #endif // #ifndef __RW_MEMORY_H__
@@ -0,0 +1,463 @@
+/*
+  FILE: rw_prof.h
+  VERSION: 0.1.0
+  DESCRIPTION: Instrumentation profiler (zones, per frame aggregation, Chrome trace export).
+  AUTHOR: Raymond Wan
+  DEPENDENCIES: rw_time.h, rw_th.h
+  USAGE: Simply including the file will only give you declarations (see __API)
+    To include the implementation,
+      #define RWPF_IMPLEMENTATION
+
+    Mark the code to measure with zones. Zones nest and can be used from any thread,
+    every thread writes begin/end events into its own ring buffer without locking, e.g.
+
+      void update_physics() {
+        RWPF_FUNCTION();
+        RWPF_ZONE_BEGIN("broadphase");
+        ...
+        RWPF_ZONE_END();
+      }
+
+    Once per frame (on one thread) call rwpf_frame_mark. It adds up the zones that ended
+    since the previous mark into a tree, one entry per zone name under each parent,
+    which rwpf_frame_zones returns. rwpf_write_chrome_trace writes all the events still in
+    the buffers as JSON that chrome://tracing or https://ui.perfetto.dev can open.
+
+    Every thread takes one of RWPF_MAX_THREADS buffers the first time it records something.
+    A thread that is about to exit calls rwpf_thread_shutdown (with its zones ended) so its
+    buffer can be reused, otherwise threads past the limit record nothing.
+
+    Zone names are stored by pointer so they must live for the whole program (string literals).
+    The implementations of rw_time.h and rw_th.h must be compiled somewhere in your program.
+    Call rwtm_init at startup so the first zone doesn't pay for starting the timer.
+    To compile all the zones out,
+      #define RWPF_DISABLE
+
+  NOTE(ray): To quickly navigate through the file,
+             sections and/or subsections are available to jump to.
+  SECTIONS:
+    1. __TYPES
+    2. __API
+    3. __MACROS
+    4. __IMPLEMENTATION
+      4.1. __ZONES
+      4.2. __FRAMES
+      4.3. __CHROME_TRACE
+*/
+
+#ifndef __RW_PROF_H__
+#define __RW_PROF_H__
+
+#if defined(RWPF_STATIC)
+  #define RWPF_DEF static
+#elif defined(RWPF_HEADER_ONLY)
+  #define RWPF_DEF static inline
+#else
+  #define RWPF_DEF extern
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// __TYPES
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+#include <stdio.h>
+#include "rw_time.h"
+#include "rw_th.h"
+
+// Events kept per thread, older ones are overwritten
+#ifndef RWPF_EVENTS_PER_THREAD
+#define RWPF_EVENTS_PER_THREAD 16384
+#endif
+#ifndef RWPF_MAX_THREADS
+#define RWPF_MAX_THREADS 64
+#endif
+#define RWPF_MAX_DEPTH 64
+// Entries in the tree built by rwpf_frame_mark
+#define RWPF_MAX_FRAME_ZONES 512
+
+// One zone of the last frame. Entries are unique per (name, parent), so the same zone
+// called from two places shows up twice. Parents always come before their children.
+typedef struct rwpf_zone_stats {
+  const char *name;
+  int parent; // index into the same array, -1 for top level zones
+  int depth;
+  uint32_t count;
+  uint64_t total_ns;
+  uint64_t self_ns; // total_ns minus the time spent in child zones
+  uint64_t max_ns;
+} rwpf_zone_stats;
+
+///////////////////////////////////////////////////////////////////////////////
+// __API
+///////////////////////////////////////////////////////////////////////////////
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// __ZONES
+// Use the macros (see __MACROS) so zones can be compiled out
+RWPF_DEF void rwpf_zone_begin(const char *name);
+// Ends the most recently begun zone of the calling thread
+RWPF_DEF void rwpf_zone_end();
+// Shown as the thread's name in the Chrome trace, name is copied.
+// Returns false if all RWPF_MAX_THREADS buffers are taken and the thread won't be recorded.
+RWPF_DEF bool rwpf_set_thread_name(const char *name);
+// Gives the calling thread's buffer back for a later thread, call it before the thread exits.
+// Its events are still aggregated and written to the trace until they are overwritten.
+RWPF_DEF void rwpf_thread_shutdown();
+
+// __FRAMES
+// Ends the frame and aggregates it, returns its duration in nanoseconds.
+// Must always be called from the same thread.
+RWPF_DEF uint64_t rwpf_frame_mark();
+// Zones of the frame ended by the last rwpf_frame_mark, returns how many there are
+RWPF_DEF int rwpf_frame_zones(const rwpf_zone_stats **zones);
+
+// __CHROME_TRACE
+// Writes every complete zone still in the thread buffers. Not thread safe with rwpf_frame_mark.
+RWPF_DEF bool rwpf_write_chrome_trace(FILE *f);
+
+#ifdef __cplusplus
+}
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// __MACROS
+///////////////////////////////////////////////////////////////////////////////
+
+#define RWPF__CONCAT2(a, b) a##b
+#define RWPF__CONCAT(a, b) RWPF__CONCAT2(a, b)
+
+#if defined(RWPF_DISABLE)
+#define RWPF_ZONE_BEGIN(name)
+#define RWPF_ZONE_END()
+#define RWPF_ZONE(name)
+#define RWPF_FUNCTION()
+#else
+#define RWPF_ZONE_BEGIN(name) rwpf_zone_begin(name)
+#define RWPF_ZONE_END() rwpf_zone_end()
+
+#if defined(__cplusplus)
+// Zone that ends with the enclosing scope
+struct rwpf_scoped_zone {
+  rwpf_scoped_zone(const char *name) { rwpf_zone_begin(name); }
+  ~rwpf_scoped_zone() { rwpf_zone_end(); }
+};
+#define RWPF_ZONE(name) rwpf_scoped_zone RWPF__CONCAT(rwpf__zone_, __LINE__)(name)
+#define RWPF_FUNCTION() RWPF_ZONE(__FUNCTION__)
+#endif
+#endif // #if defined(RWPF_DISABLE)
+
+
+///////////////////////////////////////////////////////////////////////////////
+// __IMPLEMENTATION
+///////////////////////////////////////////////////////////////////////////////
+
+#if defined(RWPF_IMPLEMENTATION) || defined(RWPF_HEADER_ONLY)
+
+#include <string.h> // strncpy
+
+#if defined(__GNUC__) || defined(__GNUG__) || defined(__clang__)
+#define RWPF__THREAD_LOCAL __thread
+#else
+#define RWPF__THREAD_LOCAL __declspec(thread)
+#endif
+
+// End events have no name
+typedef struct rwpf__Event {
+  uint64_t time_ns;
+  const char *name;
+} rwpf__Event;
+
+// An open zone while aggregating a thread's events
+typedef struct rwpf__OpenZone {
+  const char *name;
+  uint64_t begin_ns;
+  uint64_t child_ns;
+  int stats_index; // only valid if stats_frame is the current frame
+  uint64_t stats_frame;
+} rwpf__OpenZone;
+
+enum {
+  RWPF__SLOT_UNUSED = 0,
+  RWPF__SLOT_OWNED,
+  RWPF__SLOT_FREE // owner shut down, can be taken by another thread
+};
+
+typedef struct rwpf__ThreadBuffer {
+  rwpf__Event events[RWPF_EVENTS_PER_THREAD];
+  int64_t volatile write_pos; // only written by the owning thread
+  int32_t volatile state; // RWPF__SLOT_*
+  char name[32];
+  // Only touched by rwpf_frame_mark
+  int64_t read_pos;
+  int depth;
+  int skipped; // zones begun past RWPF_MAX_DEPTH
+  rwpf__OpenZone stack[RWPF_MAX_DEPTH];
+} rwpf__ThreadBuffer;
+
+typedef struct rwpf__Profiler {
+  rwpf__ThreadBuffer threads[RWPF_MAX_THREADS];
+  int32_t volatile num_threads; // buffers ever taken, never more than RWPF_MAX_THREADS
+  // Frame aggregation
+  uint64_t frame;
+  uint64_t frame_start_ns;
+  int num_zones;
+  rwpf_zone_stats zones[RWPF_MAX_FRAME_ZONES];
+  rwpf__Event scratch[RWPF_EVENTS_PER_THREAD];
+} rwpf__Profiler;
+
+// NOTE(ray): Large but zero initialized, so untouched thread buffers never get backed by memory
+static rwpf__Profiler rwpf__profiler;
+static RWPF__THREAD_LOCAL rwpf__ThreadBuffer *rwpf__thread;
+static RWPF__THREAD_LOCAL bool rwpf__thread_registered;
+
+///////////////////////////////////////////////////////////////////////////////
+// __ZONES
+///////////////////////////////////////////////////////////////////////////////
+
+// Index of a buffer that was given back or was never used, -1 if there is none
+static int32_t rwpf__claim_slot() {
+  rwpf__Profiler *p = &rwpf__profiler;
+  int32_t num_threads = rwth_atomic_load_i32(&p->num_threads, RWTH_ACQUIRE);
+  for (int32_t i = 0; i < num_threads; i++) {
+    int32_t volatile *state = &p->threads[i].state;
+    if (rwth_atomic_load_i32(state, RWTH_RELAXED) == RWPF__SLOT_FREE &&
+        rwth_atomic_cas_i32_explicit(state, RWPF__SLOT_FREE, RWPF__SLOT_OWNED, RWTH_ACQUIRE) == RWPF__SLOT_FREE) {
+      return i;
+    }
+  }
+  // NOTE(ray): CAS rather than add so the count stops at the limit instead of wrapping around
+  while (num_threads < RWPF_MAX_THREADS) {
+    int32_t prev = rwth_atomic_cas_i32_explicit(&p->num_threads, num_threads, num_threads + 1, RWTH_RELAXED);
+    if (prev == num_threads) return num_threads;
+    num_threads = prev;
+  }
+  return -1;
+}
+
+static rwpf__ThreadBuffer *rwpf__get_thread() {
+  if (rwpf__thread == NULL && !rwpf__thread_registered) {
+    rwpf__thread_registered = true;
+    int32_t index = rwpf__claim_slot();
+    if (index >= 0) {
+      rwpf__ThreadBuffer *thread = &rwpf__profiler.threads[index];
+      snprintf(thread->name, sizeof(thread->name), "thread %d", (int) index);
+      // NOTE(ray): write_pos carries on from the previous owner so readers don't need to know
+      rwth_atomic_store_i32(&thread->state, RWPF__SLOT_OWNED, RWTH_RELEASE);
+      rwpf__thread = thread;
+    }
+  }
+  return rwpf__thread;
+}
+
+static inline void rwpf__push_event(const char *name) {
+  rwpf__ThreadBuffer *thread = rwpf__get_thread();
+  if (thread == NULL) return;
+  int64_t pos = thread->write_pos;
+  rwpf__Event *event = &thread->events[pos % RWPF_EVENTS_PER_THREAD];
+  event->time_ns = rwtm_now();
+  event->name = name;
+  // Readers only look at events before write_pos
+  rwth_atomic_store_i64(&thread->write_pos, pos + 1, RWTH_RELEASE);
+}
+
+RWPF_DEF void rwpf_zone_begin(const char *name) {
+  rwpf__push_event(name);
+}
+
+RWPF_DEF void rwpf_zone_end() {
+  rwpf__push_event(NULL);
+}
+
+RWPF_DEF bool rwpf_set_thread_name(const char *name) {
+  rwpf__ThreadBuffer *thread = rwpf__get_thread();
+  if (thread == NULL) return false;
+  strncpy(thread->name, name, sizeof(thread->name) - 1);
+  thread->name[sizeof(thread->name) - 1] = '\0';
+  return true;
+}
+
+RWPF_DEF void rwpf_thread_shutdown() {
+  if (rwpf__thread != NULL) {
+    rwth_atomic_store_i32(&rwpf__thread->state, RWPF__SLOT_FREE, RWTH_RELEASE);
+  }
+  rwpf__thread = NULL;
+  rwpf__thread_registered = false;
+}
+
+// Copies the events of [*from, write_pos) that weren't overwritten into rwpf__profiler.scratch.
+// *from is moved up to the first event copied, returns the number of events copied.
+static int rwpf__read_events(rwpf__ThreadBuffer *thread, int64_t *from) {
+  int64_t end = rwth_atomic_load_i64(&thread->write_pos, RWTH_ACQUIRE);
+  int64_t start = *from;
+  if (start < end - RWPF_EVENTS_PER_THREAD) start = end - RWPF_EVENTS_PER_THREAD;
+  for (int64_t i = start; i < end; i++) {
+    rwpf__profiler.scratch[i - start] = thread->events[i % RWPF_EVENTS_PER_THREAD];
+  }
+  // NOTE(ray): The thread kept going while copying, whatever it wrapped around onto is garbage
+  rwth_atomic_thread_fence(RWTH_ACQUIRE);
+  int64_t overwritten = rwth_atomic_load_i64(&thread->write_pos, RWTH_RELAXED) - RWPF_EVENTS_PER_THREAD;
+  int skip = overwritten > start ? (int) (overwritten - start) : 0;
+  if (skip > end - start) skip = (int) (end - start);
+  if (skip > 0) {
+    memmove(rwpf__profiler.scratch, rwpf__profiler.scratch + skip, (size_t) (end - start - skip) * sizeof(rwpf__Event));
+  }
+  *from = start + skip;
+  return (int) (end - start - skip);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// __FRAMES
+///////////////////////////////////////////////////////////////////////////////
+
+static int rwpf__find_zone(const char *name, int parent, int depth) {
+  rwpf__Profiler *p = &rwpf__profiler;
+  for (int i = parent + 1; i < p->num_zones; i++) {
+    if (p->zones[i].name == name && p->zones[i].parent == parent) return i;
+  }
+  if (p->num_zones == RWPF_MAX_FRAME_ZONES) return -1;
+  rwpf_zone_stats *zone = &p->zones[p->num_zones];
+  memset(zone, 0, sizeof(*zone));
+  zone->name = name;
+  zone->parent = parent;
+  zone->depth = depth;
+  return p->num_zones++;
+}
+
+// Stats entry of the zone open at level of the stack, made if this frame doesn't have one yet
+static int rwpf__zone_index(rwpf__ThreadBuffer *thread, int level) {
+  rwpf__OpenZone *open = &thread->stack[level];
+  if (open->stats_frame != rwpf__profiler.frame) {
+    int parent = level > 0 ? rwpf__zone_index(thread, level - 1) : -1;
+    open->stats_index = level > 0 && parent < 0 ? -1 : rwpf__find_zone(open->name, parent, level);
+    open->stats_frame = rwpf__profiler.frame;
+  }
+  return open->stats_index;
+}
+
+static void rwpf__aggregate_thread(rwpf__ThreadBuffer *thread) {
+  int64_t from = thread->read_pos;
+  int count = rwpf__read_events(thread, &from);
+  if (from != thread->read_pos) {
+    // Events were lost so the open zones can't be trusted anymore
+    thread->depth = 0;
+    thread->skipped = 0;
+  }
+  thread->read_pos = from + count;
+
+  for (int i = 0; i < count; i++) {
+    rwpf__Event *event = &rwpf__profiler.scratch[i];
+    if (event->name != NULL) {
+      if (thread->depth == RWPF_MAX_DEPTH) {
+        thread->skipped++;
+        continue;
+      }
+      rwpf__OpenZone *open = &thread->stack[thread->depth++];
+      open->name = event->name;
+      open->begin_ns = event->time_ns;
+      open->child_ns = 0;
+      open->stats_frame = UINT64_MAX;
+    } else if (thread->skipped > 0) {
+      thread->skipped--;
+    } else if (thread->depth > 0) {
+      int level = thread->depth - 1;
+      rwpf__OpenZone *open = &thread->stack[level];
+      uint64_t duration = rwtm_diff(event->time_ns, open->begin_ns);
+      int index = rwpf__zone_index(thread, level);
+      if (index >= 0) {
+        rwpf_zone_stats *zone = &rwpf__profiler.zones[index];
+        zone->count++;
+        zone->total_ns += duration;
+        zone->self_ns += duration > open->child_ns ? duration - open->child_ns : 0;
+        if (duration > zone->max_ns) zone->max_ns = duration;
+      }
+      if (level > 0) thread->stack[level - 1].child_ns += duration;
+      thread->depth--;
+    }
+  }
+}
+
+RWPF_DEF uint64_t rwpf_frame_mark() {
+  rwpf__Profiler *p = &rwpf__profiler;
+  uint64_t now = rwtm_now();
+  uint64_t frame_ns = rwtm_diff(now, p->frame_start_ns);
+  p->frame_start_ns = now;
+  p->frame++;
+  p->num_zones = 0;
+
+  int num_threads = rwth_atomic_load_i32(&p->num_threads, RWTH_ACQUIRE);
+  for (int i = 0; i < num_threads; i++) {
+    rwpf__ThreadBuffer *thread = &p->threads[i];
+    if (rwth_atomic_load_i32(&thread->state, RWTH_ACQUIRE) != RWPF__SLOT_UNUSED) rwpf__aggregate_thread(thread);
+  }
+  return frame_ns;
+}
+
+RWPF_DEF int rwpf_frame_zones(const rwpf_zone_stats **zones) {
+  *zones = rwpf__profiler.zones;
+  return rwpf__profiler.num_zones;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// __CHROME_TRACE
+///////////////////////////////////////////////////////////////////////////////
+
+static void rwpf__write_json_string(FILE *f, const char *s) {
+  fputc('"', f);
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\') fputc('\\', f);
+    if ((unsigned char) *s >= 0x20) fputc(*s, f);
+  }
+  fputc('"', f);
+}
+
+RWPF_DEF bool rwpf_write_chrome_trace(FILE *f) {
+  rwpf__Profiler *p = &rwpf__profiler;
+  bool first = true;
+  fputs("{\"traceEvents\":[\n", f);
+
+  int num_threads = rwth_atomic_load_i32(&p->num_threads, RWTH_ACQUIRE);
+  for (int t = 0; t < num_threads; t++) {
+    rwpf__ThreadBuffer *thread = &p->threads[t];
+    if (rwth_atomic_load_i32(&thread->state, RWTH_ACQUIRE) == RWPF__SLOT_UNUSED) continue;
+
+    fprintf(f, "%s{\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"name\":\"thread_name\",\"args\":{\"name\":", first ? "" : ",\n", t);
+    rwpf__write_json_string(f, thread->name);
+    fputs("}}", f);
+    first = false;
+
+    // NOTE(ray): Zones are written as complete events when they end. Ends whose begin has
+    // already been overwritten and zones that are still open are left out.
+    int64_t from = 0;
+    int count = rwpf__read_events(thread, &from);
+    const char *names[RWPF_MAX_DEPTH];
+    uint64_t begins[RWPF_MAX_DEPTH];
+    int depth = 0, skipped = 0;
+    for (int i = 0; i < count; i++) {
+      rwpf__Event *event = &p->scratch[i];
+      if (event->name != NULL) {
+        if (depth == RWPF_MAX_DEPTH) { skipped++; continue; }
+        names[depth] = event->name;
+        begins[depth++] = event->time_ns;
+      } else if (skipped > 0) {
+        skipped--;
+      } else if (depth > 0) {
+        depth--;
+        fprintf(f, ",\n{\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"name\":", t,
+                rwtm_to_us(begins[depth]), rwtm_to_us(rwtm_diff(event->time_ns, begins[depth])));
+        rwpf__write_json_string(f, names[depth]);
+        fputc('}', f);
+      }
+    }
+  }
+
+  fputs("\n]}\n", f);
+  return ferror(f) == 0;
+}
+
+#endif // #if defined(RWPF_IMPLEMENTATION) || defined(RWPF_HEADER_ONLY)
+
+#endif // #ifndef __RW_PROF_H__
@@ -1,18 +1,43 @@
 /*
   FILE: rw_th.h
-  VERSION: 0.1.0
+  VERSION: 0.3.0
   DESCRIPTION: Multithreading related functions.
   AUTHOR: Raymond Wan
   USAGE: Simply including the file will only give you declarations (see __API)
     To include the implementation,
       #define RWTH_IMPLEMENTATION
 
+    Job system: a fixed pool of worker threads, each with its own work stealing queue.
+    Jobs are queued from the thread that called rwth_jobs_init or from other jobs,
+    and rwth_jobs_wait runs queued jobs while it waits instead of blocking, e.g.
+
+      rwth_jobs_init(0); // one thread per cpu
+      rwth_counter counter = {};
+      for (int i = 0; i < n; i++) rwth_jobs_run(my_job, &my_data[i], &counter);
+      rwth_jobs_wait(&counter);
+      rwth_parallel_for(0, num_items, 64, my_range_fn, my_items);
+      rwth_jobs_shutdown();
+
+    Queues: bounded, lock free rings of fixed size elements (copied in and out).
+    Use the most specific one that fits, e.g. rwth_spsc_queue between a game and render thread,
+    rwth_mpsc_queue for many threads feeding one loader thread, rwth_mpmc_queue otherwise.
+
+      rwth_mpmc_queue q = rwth_mpmc_queue_create(1024, sizeof(MyCommand));
+      if (!rwth_mpmc_queue_push(&q, &cmd)) { ... full ... }
+      while (rwth_mpmc_queue_pop(&q, &cmd)) { ... }
+      rwth_mpmc_queue_free(&q);
+
   NOTE(ray): To quickly navigate through the file,
              sections and/or subsections are available to jump to.
   SECTIONS:
     1. __TYPES
     2. __API
+      2.1. __ATOMICS
+    3. __MACROS
     4. __IMPLEMENTATION
+      4.1. __THREAD
+      4.2. __JOBS
+      4.3. __QUEUES
 */
 
 #ifndef __RW_TH_H__
@@ -39,6 +64,97 @@
 
 #include <stdint.h>
 
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#define RWTH_CACHE_LINE_SIZE 64
+
+#if defined(NOT_MSCV)
+#define RWTH_ALIGN16 __attribute__((aligned(16)))
+#else
+#define RWTH_ALIGN16 __declspec(align(16))
+#endif
+
+// NOTE(ray): Same meaning as C11/C++11 memory orders. Loads take relaxed, acquire or seq_cst,
+// stores take relaxed, release or seq_cst, read-modify-write operations take any of them.
+typedef enum rwth_memory_order {
+#if defined(NOT_MSCV)
+  RWTH_RELAXED = __ATOMIC_RELAXED,
+  RWTH_ACQUIRE = __ATOMIC_ACQUIRE,
+  RWTH_RELEASE = __ATOMIC_RELEASE,
+  RWTH_ACQ_REL = __ATOMIC_ACQ_REL,
+  RWTH_SEQ_CST = __ATOMIC_SEQ_CST
+#else
+  RWTH_RELAXED,
+  RWTH_ACQUIRE,
+  RWTH_RELEASE,
+  RWTH_ACQ_REL,
+  RWTH_SEQ_CST
+#endif
+} rwth_memory_order;
+
+// 128 bit value for rwth_atomic_cas_128, e.g. a pointer plus an ABA tag
+typedef struct RWTH_ALIGN16 rwth_u128 {
+  uint64_t lo;
+  uint64_t hi;
+} rwth_u128;
+
+typedef void *(*rwth_thread_fn)(void *arg);
+
+typedef struct rwth_thread {
+#if defined(_WIN32)
+  HANDLE handle;
+#else
+  pthread_t handle;
+#endif
+  rwth_thread_fn fn;
+  void *arg;
+} rwth_thread;
+
+typedef void (*rwth_job_fn)(void *data);
+typedef void (*rwth_parallel_for_fn)(void *data, int start, int end);
+
+// Number of jobs that haven't finished yet. Zero initialize before use.
+typedef struct rwth_counter {
+  int64_t volatile value;
+} rwth_counter;
+
+// NOTE(ray): Dmitry Vyukov's bounded MPMC queue. Every cell has a sequence number that tells
+// producers and consumers whose turn it is, so each side only has to CAS its own position.
+// The positions are a cache line apart so producers and consumers don't false share.
+typedef struct rwth_mpmc_queue {
+  uint8_t *cells;
+  int64_t mask;
+  size_t element_size;
+  size_t cell_size;
+  uint8_t pad0[RWTH_CACHE_LINE_SIZE];
+  int64_t volatile tail; // next position to push
+  uint8_t pad1[RWTH_CACHE_LINE_SIZE - sizeof(int64_t)];
+  int64_t volatile head; // next position to pop
+  uint8_t pad2[RWTH_CACHE_LINE_SIZE - sizeof(int64_t)];
+} rwth_mpmc_queue;
+
+// Same layout, the single consumer just doesn't need a CAS
+typedef rwth_mpmc_queue rwth_mpsc_queue;
+
+// NOTE(ray): Single producer single consumer ring. Each side keeps a cached copy of the
+// other side's position and only reloads it when the ring looks full/empty.
+typedef struct rwth_spsc_queue {
+  uint8_t *data;
+  int64_t mask;
+  size_t element_size;
+  uint8_t pad0[RWTH_CACHE_LINE_SIZE];
+  int64_t volatile tail;
+  int64_t head_cache; // producer's copy of head
+  uint8_t pad1[RWTH_CACHE_LINE_SIZE - 2 * sizeof(int64_t)];
+  int64_t volatile head;
+  int64_t tail_cache; // consumer's copy of tail
+  uint8_t pad2[RWTH_CACHE_LINE_SIZE - 2 * sizeof(int64_t)];
+} rwth_spsc_queue;
+
 ///////////////////////////////////////////////////////////////////////////////
 // __API
 ///////////////////////////////////////////////////////////////////////////////
@@ -47,54 +163,814 @@
 extern "C" {
 #endif
 
+// seq_cst 64 bit atomics, see __ATOMICS for other sizes and memory orders
 RWTH_DEF int64_t rwth_atomic_add_i64(int64_t volatile *val, int64_t addend);
 RWTH_DEF int64_t rwth_atomic_exchange_i64(int64_t volatile *val, int64_t new_val);
 RWTH_DEF int64_t rwth_atomic_cas_i64(int64_t volatile *val, int64_t expected, int64_t new_val);
 
+// Starts a thread running fn(arg). t must stay alive until rwth_thread_join(t) is called.
+RWTH_DEF bool rwth_thread_create(rwth_thread *t, rwth_thread_fn fn, void *arg);
+RWTH_DEF void rwth_thread_join(rwth_thread *t);
+// Gives up the rest of the calling thread's time slice
+RWTH_DEF void rwth_thread_yield();
+// Number of logical processors available
+RWTH_DEF int rwth_num_cpus();
+
+// __JOBS
+// Starts num_threads - 1 worker threads (<= 0 -> one thread per cpu). The calling thread
+// is the remaining one, it runs jobs whenever it waits.
+RWTH_DEF void rwth_jobs_init(int num_threads);
+// Stops and joins the workers. Jobs that are still queued are dropped.
+RWTH_DEF void rwth_jobs_shutdown();
+// Number of threads running jobs, 0 if the job system isn't running
+RWTH_DEF int rwth_jobs_num_threads();
+// Index of the calling thread in [0, rwth_jobs_num_threads()), -1 outside of the job system
+RWTH_DEF int rwth_jobs_worker_index();
+// Queues fn(data). counter (if not NULL) is incremented now and decremented after the job ran.
+// NOTE(ray): Called from a thread outside of the job system, the job just runs immediately.
+RWTH_DEF void rwth_jobs_run(rwth_job_fn fn, void *data, rwth_counter *counter);
+// Runs queued jobs until counter reaches zero
+RWTH_DEF void rwth_jobs_wait(rwth_counter *counter);
+// Calls fn(data, s, e) for consecutive ranges of at most grain_size covering [start, end)
+// on all threads and returns once every range is done
+RWTH_DEF void rwth_parallel_for(int start, int end, int grain_size, rwth_parallel_for_fn fn, void *data);
+
+// __QUEUES
+// capacity is rounded up to a power of 2. push returns false if the queue is full,
+// pop returns false if it is empty. Elements are element_size bytes copied with memcpy.
+RWTH_DEF rwth_mpmc_queue rwth_mpmc_queue_create(int capacity, size_t element_size);
+RWTH_DEF void rwth_mpmc_queue_free(rwth_mpmc_queue *q);
+RWTH_DEF bool rwth_mpmc_queue_push(rwth_mpmc_queue *q, const void *element);
+RWTH_DEF bool rwth_mpmc_queue_pop(rwth_mpmc_queue *q, void *element);
+
+RWTH_DEF rwth_mpsc_queue rwth_mpsc_queue_create(int capacity, size_t element_size);
+RWTH_DEF void rwth_mpsc_queue_free(rwth_mpsc_queue *q);
+RWTH_DEF bool rwth_mpsc_queue_push(rwth_mpsc_queue *q, const void *element);
+// Must only be called from one thread at a time
+RWTH_DEF bool rwth_mpsc_queue_pop(rwth_mpsc_queue *q, void *element);
+
+// push must only be called from one thread and pop from one (other) thread
+RWTH_DEF rwth_spsc_queue rwth_spsc_queue_create(int capacity, size_t element_size);
+RWTH_DEF void rwth_spsc_queue_free(rwth_spsc_queue *q);
+RWTH_DEF bool rwth_spsc_queue_push(rwth_spsc_queue *q, const void *element);
+RWTH_DEF bool rwth_spsc_queue_pop(rwth_spsc_queue *q, void *element);
+
+///////////////////////////////////////////////////////////////////////////////
+// __ATOMICS
+///////////////////////////////////////////////////////////////////////////////
+
+// NOTE(ray): These are always defined in the header (static inline) so a constant memory
+// order compiles down to the single instruction it needs instead of a call.
+// cas returns the value val held before the operation, it succeeded if that equals expected.
+// The variants without an order are seq_cst.
+
+#if defined(NOT_MSCV)
+
+static inline int rwth__cas_failure_order(rwth_memory_order order) {
+  return order == RWTH_RELEASE ? RWTH_RELAXED : (order == RWTH_ACQ_REL ? RWTH_ACQUIRE : order);
+}
+
+static inline int32_t rwth_atomic_load_i32(int32_t volatile *val, rwth_memory_order order) {
+  return __atomic_load_n(val, order);
+}
+static inline int64_t rwth_atomic_load_i64(int64_t volatile *val, rwth_memory_order order) {
+  return __atomic_load_n(val, order);
+}
+static inline void *rwth_atomic_load_ptr(void * volatile *val, rwth_memory_order order) {
+  return __atomic_load_n(val, order);
+}
+
+static inline void rwth_atomic_store_i32(int32_t volatile *val, int32_t new_val, rwth_memory_order order) {
+  __atomic_store_n(val, new_val, order);
+}
+static inline void rwth_atomic_store_i64(int64_t volatile *val, int64_t new_val, rwth_memory_order order) {
+  __atomic_store_n(val, new_val, order);
+}
+static inline void rwth_atomic_store_ptr(void * volatile *val, void *new_val, rwth_memory_order order) {
+  __atomic_store_n(val, new_val, order);
+}
+
+// Returns the value prior to adding
+static inline int32_t rwth_atomic_add_i32_explicit(int32_t volatile *val, int32_t addend, rwth_memory_order order) {
+  return __atomic_fetch_add(val, addend, order);
+}
+static inline int64_t rwth_atomic_add_i64_explicit(int64_t volatile *val, int64_t addend, rwth_memory_order order) {
+  return __atomic_fetch_add(val, addend, order);
+}
+
+static inline int32_t rwth_atomic_exchange_i32_explicit(int32_t volatile *val, int32_t new_val, rwth_memory_order order) {
+  return __atomic_exchange_n(val, new_val, order);
+}
+static inline int64_t rwth_atomic_exchange_i64_explicit(int64_t volatile *val, int64_t new_val, rwth_memory_order order) {
+  return __atomic_exchange_n(val, new_val, order);
+}
+static inline void *rwth_atomic_exchange_ptr_explicit(void * volatile *val, void *new_val, rwth_memory_order order) {
+  return __atomic_exchange_n(val, new_val, order);
+}
+
+static inline int32_t rwth_atomic_cas_i32_explicit(int32_t volatile *val, int32_t expected, int32_t new_val, rwth_memory_order order) {
+  __atomic_compare_exchange_n(val, &expected, new_val, false, order, rwth__cas_failure_order(order));
+  return expected;
+}
+static inline int64_t rwth_atomic_cas_i64_explicit(int64_t volatile *val, int64_t expected, int64_t new_val, rwth_memory_order order) {
+  __atomic_compare_exchange_n(val, &expected, new_val, false, order, rwth__cas_failure_order(order));
+  return expected;
+}
+static inline void *rwth_atomic_cas_ptr_explicit(void * volatile *val, void *expected, void *new_val, rwth_memory_order order) {
+  __atomic_compare_exchange_n(val, &expected, new_val, false, order, rwth__cas_failure_order(order));
+  return expected;
+}
+
+// Double width CAS (always seq_cst). val must be 16 byte aligned.
+// Returns true on success, otherwise expected is set to the current value.
+static inline bool rwth_atomic_cas_128(rwth_u128 volatile *val, rwth_u128 *expected, rwth_u128 new_val) {
+#if defined(__x86_64__)
+  // NOTE(ray): Inline asm so -mcx16 or libatomic aren't needed
+  bool result;
+  __asm__ __volatile__(
+    "lock cmpxchg16b %1\n\t"
+    "setz %0"
+    : "=q" (result), "+m" (*val), "+a" (expected->lo), "+d" (expected->hi)
+    : "b" (new_val.lo), "c" (new_val.hi)
+    : "cc", "memory");
+  return result;
+#else
+  // NOTE(ray): May need to link with -latomic
+  return __atomic_compare_exchange((unsigned __int128 volatile *) val, (unsigned __int128 *) expected,
+                                   (unsigned __int128 *) &new_val, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static inline void rwth_atomic_thread_fence(rwth_memory_order order) {
+  __atomic_thread_fence(order);
+}
+// Only stops the compiler from reordering memory accesses
+static inline void rwth_atomic_compiler_fence() {
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+}
+// Hint for spin loops
+static inline void rwth_cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+  _mm_pause();
+#elif defined(__aarch64__)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+#else // MSVC (x86/x64)
+
+// NOTE(ray): Interlocked functions are full barriers and plain x86 loads/stores already
+// have acquire/release semantics, so only the compiler needs to be held back.
+
+static inline int32_t rwth_atomic_load_i32(int32_t volatile *val, rwth_memory_order order) {
+  int32_t result = *val;
+  _ReadWriteBarrier();
+  return result;
+}
+static inline int64_t rwth_atomic_load_i64(int64_t volatile *val, rwth_memory_order order) {
+  int64_t result = *val;
+  _ReadWriteBarrier();
+  return result;
+}
+static inline void *rwth_atomic_load_ptr(void * volatile *val, rwth_memory_order order) {
+  void *result = *val;
+  _ReadWriteBarrier();
+  return result;
+}
+
+static inline void rwth_atomic_store_i32(int32_t volatile *val, int32_t new_val, rwth_memory_order order) {
+  if (order == RWTH_SEQ_CST) {
+    _InterlockedExchange((long volatile *) val, new_val);
+  } else {
+    _ReadWriteBarrier();
+    *val = new_val;
+  }
+}
+static inline void rwth_atomic_store_i64(int64_t volatile *val, int64_t new_val, rwth_memory_order order) {
+  if (order == RWTH_SEQ_CST) {
+    _InterlockedExchange64(val, new_val);
+  } else {
+    _ReadWriteBarrier();
+    *val = new_val;
+  }
+}
+static inline void rwth_atomic_store_ptr(void * volatile *val, void *new_val, rwth_memory_order order) {
+  if (order == RWTH_SEQ_CST) {
+    _InterlockedExchangePointer(val, new_val);
+  } else {
+    _ReadWriteBarrier();
+    *val = new_val;
+  }
+}
+
+static inline int32_t rwth_atomic_add_i32_explicit(int32_t volatile *val, int32_t addend, rwth_memory_order order) {
+  return _InterlockedExchangeAdd((long volatile *) val, addend);
+}
+static inline int64_t rwth_atomic_add_i64_explicit(int64_t volatile *val, int64_t addend, rwth_memory_order order) {
+  return _InterlockedExchangeAdd64(val, addend);
+}
+
+static inline int32_t rwth_atomic_exchange_i32_explicit(int32_t volatile *val, int32_t new_val, rwth_memory_order order) {
+  return _InterlockedExchange((long volatile *) val, new_val);
+}
+static inline int64_t rwth_atomic_exchange_i64_explicit(int64_t volatile *val, int64_t new_val, rwth_memory_order order) {
+  return _InterlockedExchange64(val, new_val);
+}
+static inline void *rwth_atomic_exchange_ptr_explicit(void * volatile *val, void *new_val, rwth_memory_order order) {
+  return _InterlockedExchangePointer(val, new_val);
+}
+
+static inline int32_t rwth_atomic_cas_i32_explicit(int32_t volatile *val, int32_t expected, int32_t new_val, rwth_memory_order order) {
+  return _InterlockedCompareExchange((long volatile *) val, new_val, expected);
+}
+static inline int64_t rwth_atomic_cas_i64_explicit(int64_t volatile *val, int64_t expected, int64_t new_val, rwth_memory_order order) {
+  return _InterlockedCompareExchange64(val, new_val, expected);
+}
+static inline void *rwth_atomic_cas_ptr_explicit(void * volatile *val, void *expected, void *new_val, rwth_memory_order order) {
+  return _InterlockedCompareExchangePointer(val, new_val, expected);
+}
+
+static inline bool rwth_atomic_cas_128(rwth_u128 volatile *val, rwth_u128 *expected, rwth_u128 new_val) {
+  return _InterlockedCompareExchange128((__int64 volatile *) val, (__int64) new_val.hi, (__int64) new_val.lo, (__int64 *) expected) != 0;
+}
+
+static inline void rwth_atomic_thread_fence(rwth_memory_order order) {
+  if (order == RWTH_SEQ_CST) {
+    MemoryBarrier();
+  } else {
+    _ReadWriteBarrier();
+  }
+}
+static inline void rwth_atomic_compiler_fence() {
+  _ReadWriteBarrier();
+}
+static inline void rwth_cpu_relax() {
+  _mm_pause();
+}
+
+#endif // #if defined(NOT_MSCV)
+
+static inline int32_t rwth_atomic_add_i32(int32_t volatile *val, int32_t addend) {
+  return rwth_atomic_add_i32_explicit(val, addend, RWTH_SEQ_CST);
+}
+static inline int32_t rwth_atomic_exchange_i32(int32_t volatile *val, int32_t new_val) {
+  return rwth_atomic_exchange_i32_explicit(val, new_val, RWTH_SEQ_CST);
+}
+static inline void *rwth_atomic_exchange_ptr(void * volatile *val, void *new_val) {
+  return rwth_atomic_exchange_ptr_explicit(val, new_val, RWTH_SEQ_CST);
+}
+static inline int32_t rwth_atomic_cas_i32(int32_t volatile *val, int32_t expected, int32_t new_val) {
+  return rwth_atomic_cas_i32_explicit(val, expected, new_val, RWTH_SEQ_CST);
+}
+static inline void *rwth_atomic_cas_ptr(void * volatile *val, void *expected, void *new_val) {
+  return rwth_atomic_cas_ptr_explicit(val, expected, new_val, RWTH_SEQ_CST);
+}
+
 #ifdef __cplusplus
 }
 #endif
 
 
+///////////////////////////////////////////////////////////////////////////////
+// __MACROS
+///////////////////////////////////////////////////////////////////////////////
+
+// Capacity of each thread's job queue (power of 2). Jobs queued past it run immediately.
+#if !defined(RWTH_JOB_QUEUE_SIZE)
+#define RWTH_JOB_QUEUE_SIZE 4096
+#endif
+
+
 ///////////////////////////////////////////////////////////////////////////////
 // __IMPLEMENTATION
 ///////////////////////////////////////////////////////////////////////////////
 
 #if defined(RWTH_IMPLEMENTATION) || defined(RWTH_HEADER_ONLY)
 
-RWTH_DEF int64_t rwth_atomic_add_i64(int64_t volatile *val, int64_t addend) {
-  int64_t result;
+#include <stdlib.h> // malloc
+#include <string.h> // memcpy
+#if !defined(_WIN32)
+#include <unistd.h> // sysconf
+#include <sched.h> // sched_yield
+#endif
+
 #if defined(NOT_MSCV)
-  result = __sync_fetch_and_add(val, addend);
+#define RWTH__THREAD_LOCAL __thread
 #else
-  // NOTE(ray): This returns the value prior to adding
-  result = _InterlockedExchangeAdd64(val, addend);
+#define RWTH__THREAD_LOCAL __declspec(thread)
 #endif
-  return result;
+
+RWTH_DEF int64_t rwth_atomic_add_i64(int64_t volatile *val, int64_t addend) {
+  return rwth_atomic_add_i64_explicit(val, addend, RWTH_SEQ_CST);
 }
 
 RWTH_DEF int64_t rwth_atomic_exchange_i64(int64_t volatile *val, int64_t new_val) {
-  int64_t result;
-#if defined(NOT_MSCV)
-  result = __sync_lock_test_and_set(val, new_val);
+  return rwth_atomic_exchange_i64_explicit(val, new_val, RWTH_SEQ_CST);
+}
+
+RWTH_DEF int64_t rwth_atomic_cas_i64(int64_t volatile *val, int64_t expected, int64_t new_val) {
+  return rwth_atomic_cas_i64_explicit(val, expected, new_val, RWTH_SEQ_CST);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// __THREAD
+///////////////////////////////////////////////////////////////////////////////
+
+#if defined(_WIN32)
+static DWORD WINAPI rwth__thread_proc(LPVOID param) {
+  rwth_thread *t = (rwth_thread *) param;
+  t->fn(t->arg);
+  return 0;
+}
+#endif
+
+RWTH_DEF bool rwth_thread_create(rwth_thread *t, rwth_thread_fn fn, void *arg) {
+  t->fn = fn;
+  t->arg = arg;
+#if defined(_WIN32)
+  t->handle = CreateThread(NULL, 0, rwth__thread_proc, t, 0, NULL);
+  return t->handle != NULL;
+#else
+  return pthread_create(&t->handle, NULL, fn, arg) == 0;
+#endif
+}
+
+RWTH_DEF void rwth_thread_join(rwth_thread *t) {
+#if defined(_WIN32)
+  WaitForSingleObject(t->handle, INFINITE);
+  CloseHandle(t->handle);
+#else
+  pthread_join(t->handle, NULL);
+#endif
+}
+
+RWTH_DEF void rwth_thread_yield() {
+#if defined(_WIN32)
+  SwitchToThread();
 #else
-  // NOTE(ray): This returns the value prior to exchange
-  result = _InterlockedExchange64(val, new_val);
+  sched_yield();
 #endif
+}
+
+RWTH_DEF int rwth_num_cpus() {
+#if defined(_WIN32)
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return (int) info.dwNumberOfProcessors;
+#else
+  long result = sysconf(_SC_NPROCESSORS_ONLN);
+  return result > 0 ? (int) result : 1;
+#endif
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// __JOBS
+///////////////////////////////////////////////////////////////////////////////
+
+typedef struct rwth__Job {
+  rwth_job_fn fn;
+  void *data;
+  rwth_counter *counter;
+} rwth__Job;
+
+// NOTE(ray): Chase-Lev work stealing deque with a fixed capacity. The owning thread pushes
+// and pops at the bottom (LIFO, cache friendly), other threads steal from the top (FIFO).
+// Jobs are stored by value. A thief only keeps what it read if its CAS on top succeeds,
+// and the owner can't have overwritten that slot while top was unchanged.
+typedef struct rwth__JobQueue {
+  int64_t volatile top;
+  uint8_t pad0[RWTH_CACHE_LINE_SIZE - sizeof(int64_t)];
+  int64_t volatile bottom;
+  uint8_t pad1[RWTH_CACHE_LINE_SIZE - sizeof(int64_t)];
+  rwth__Job jobs[RWTH_JOB_QUEUE_SIZE];
+} rwth__JobQueue;
+
+typedef struct rwth__JobSystem {
+  int num_threads;
+  bool volatile running;
+  rwth__JobQueue *queues;
+  rwth_thread *threads;
+  bool *started;
+  // Jobs sitting in queues and workers waiting for some
+  int64_t volatile num_queued;
+  int64_t volatile num_sleeping;
+#if defined(_WIN32)
+  CRITICAL_SECTION lock;
+  CONDITION_VARIABLE wake;
+#else
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+#endif
+} rwth__JobSystem;
+
+typedef struct rwth__ParallelFor {
+  rwth_parallel_for_fn fn;
+  void *data;
+  int64_t end;
+  int64_t grain_size;
+  int64_t volatile next;
+} rwth__ParallelFor;
+
+static rwth__JobSystem rwth__jobs;
+static RWTH__THREAD_LOCAL int rwth__worker_index = -1;
+static RWTH__THREAD_LOCAL uint32_t rwth__rng_state;
+
+static void rwth__lock() {
+#if defined(_WIN32)
+  EnterCriticalSection(&rwth__jobs.lock);
+#else
+  pthread_mutex_lock(&rwth__jobs.lock);
+#endif
+}
+
+static void rwth__unlock() {
+#if defined(_WIN32)
+  LeaveCriticalSection(&rwth__jobs.lock);
+#else
+  pthread_mutex_unlock(&rwth__jobs.lock);
+#endif
+}
+
+// Must hold the lock
+static void rwth__sleep() {
+#if defined(_WIN32)
+  SleepConditionVariableCS(&rwth__jobs.wake, &rwth__jobs.lock, INFINITE);
+#else
+  pthread_cond_wait(&rwth__jobs.wake, &rwth__jobs.lock);
+#endif
+}
+
+static void rwth__wake(bool all) {
+  rwth__lock();
+#if defined(_WIN32)
+  if (all) WakeAllConditionVariable(&rwth__jobs.wake);
+  else WakeConditionVariable(&rwth__jobs.wake);
+#else
+  if (all) pthread_cond_broadcast(&rwth__jobs.wake);
+  else pthread_cond_signal(&rwth__jobs.wake);
+#endif
+  rwth__unlock();
+}
+
+static bool rwth__queue_push(rwth__JobQueue *q, rwth__Job job) {
+  int64_t b = rwth_atomic_load_i64(&q->bottom, RWTH_RELAXED);
+  int64_t t = rwth_atomic_load_i64(&q->top, RWTH_ACQUIRE);
+  if (b - t >= RWTH_JOB_QUEUE_SIZE) return false;
+  q->jobs[b & (RWTH_JOB_QUEUE_SIZE - 1)] = job;
+  // Publish the job before the new bottom
+  rwth_atomic_thread_fence(RWTH_RELEASE);
+  rwth_atomic_store_i64(&q->bottom, b + 1, RWTH_RELAXED);
+  return true;
+}
+
+static bool rwth__queue_pop(rwth__JobQueue *q, rwth__Job *job) {
+  int64_t b = rwth_atomic_load_i64(&q->bottom, RWTH_RELAXED) - 1;
+  rwth_atomic_store_i64(&q->bottom, b, RWTH_RELAXED);
+  // NOTE(ray): The one full fence on the owner's side. Thieves must either see the lower
+  // bottom or we must see their increment of top.
+  rwth_atomic_thread_fence(RWTH_SEQ_CST);
+  int64_t t = rwth_atomic_load_i64(&q->top, RWTH_RELAXED);
+  if (t > b) {
+    rwth_atomic_store_i64(&q->bottom, b + 1, RWTH_RELAXED);
+    return false;
+  }
+  *job = q->jobs[b & (RWTH_JOB_QUEUE_SIZE - 1)];
+  if (t == b) {
+    // Last job, race the thieves for it
+    bool won = rwth_atomic_cas_i64_explicit(&q->top, t, t + 1, RWTH_SEQ_CST) == t;
+    rwth_atomic_store_i64(&q->bottom, b + 1, RWTH_RELAXED);
+    return won;
+  }
+  return true;
+}
+
+static bool rwth__queue_steal(rwth__JobQueue *q, rwth__Job *job) {
+  int64_t t = rwth_atomic_load_i64(&q->top, RWTH_ACQUIRE);
+  rwth_atomic_thread_fence(RWTH_SEQ_CST);
+  int64_t b = rwth_atomic_load_i64(&q->bottom, RWTH_ACQUIRE);
+  if (t >= b) return false;
+  *job = q->jobs[t & (RWTH_JOB_QUEUE_SIZE - 1)];
+  return rwth_atomic_cas_i64_explicit(&q->top, t, t + 1, RWTH_SEQ_CST) == t;
+}
+
+// Pops from the calling thread's queue, otherwise tries to steal starting at a random victim
+static bool rwth__get_job(rwth__Job *job) {
+  int index = rwth__worker_index;
+  bool result = rwth__queue_pop(&rwth__jobs.queues[index], job);
+  if (!result) {
+    // xorshift32
+    rwth__rng_state ^= rwth__rng_state << 13;
+    rwth__rng_state ^= rwth__rng_state >> 17;
+    rwth__rng_state ^= rwth__rng_state << 5;
+    int n = rwth__jobs.num_threads;
+    int victim = (int) (rwth__rng_state % (uint32_t) n);
+    for (int i = 0; i < n && !result; i++, victim = (victim + 1) % n) {
+      if (victim == index) continue;
+      result = rwth__queue_steal(&rwth__jobs.queues[victim], job);
+    }
+  }
+  if (result) rwth_atomic_add_i64_explicit(&rwth__jobs.num_queued, -1, RWTH_RELAXED);
   return result;
 }
 
-RWTH_DEF int64_t rwth_atomic_cas_i64(int64_t volatile *val, int64_t expected, int64_t new_val) {
-  int64_t result;
-#if defined(NOT_MSCV)
-  result = __sync_val_compare_and_swap(val, expected, new_val);
+static void rwth__execute(rwth__Job *job) {
+  job->fn(job->data);
+  // Release so whoever sees the counter drop also sees what the job wrote
+  if (job->counter) rwth_atomic_add_i64_explicit(&job->counter->value, -1, RWTH_RELEASE);
+}
+
+static void rwth__init_worker(int index) {
+  rwth__worker_index = index;
+  rwth__rng_state = 2654435761u * (uint32_t) (index + 1);
+}
+
+static void *rwth__worker_main(void *arg) {
+  rwth__init_worker((int) (intptr_t) arg);
+  while (rwth__jobs.running) {
+    rwth__Job job;
+    if (rwth__get_job(&job)) {
+      rwth__execute(&job);
+      continue;
+    }
+    // NOTE(ray): Sleep until something is queued. num_sleeping is raised before num_queued is
+    // checked and rwth_jobs_run does the opposite, so one of them always sees the other.
+    rwth__lock();
+    rwth_atomic_add_i64(&rwth__jobs.num_sleeping, 1);
+    while (rwth__jobs.running && rwth_atomic_load_i64(&rwth__jobs.num_queued, RWTH_SEQ_CST) <= 0) {
+      rwth__sleep();
+    }
+    rwth_atomic_add_i64(&rwth__jobs.num_sleeping, -1);
+    rwth__unlock();
+  }
+  rwth__worker_index = -1;
+  return NULL;
+}
+
+static void rwth__parallel_for_job(void *data) {
+  rwth__ParallelFor *pf = (rwth__ParallelFor *) data;
+  for (;;) {
+    int64_t start = rwth_atomic_add_i64_explicit(&pf->next, pf->grain_size, RWTH_RELAXED);
+    if (start >= pf->end) break;
+    int64_t end = start + pf->grain_size < pf->end ? start + pf->grain_size : pf->end;
+    pf->fn(pf->data, (int) start, (int) end);
+  }
+}
+
+RWTH_DEF void rwth_jobs_init(int num_threads) {
+  if (num_threads <= 0) num_threads = rwth_num_cpus();
+  rwth__jobs.num_threads = num_threads;
+  rwth__jobs.running = true;
+  rwth__jobs.num_queued = 0;
+  rwth__jobs.num_sleeping = 0;
+  rwth__jobs.queues = (rwth__JobQueue *) calloc(num_threads, sizeof(rwth__JobQueue));
+  rwth__jobs.threads = (rwth_thread *) malloc(num_threads * sizeof(rwth_thread));
+  rwth__jobs.started = (bool *) calloc(num_threads, sizeof(bool));
+#if defined(_WIN32)
+  InitializeCriticalSection(&rwth__jobs.lock);
+  InitializeConditionVariable(&rwth__jobs.wake);
+#else
+  pthread_mutex_init(&rwth__jobs.lock, NULL);
+  pthread_cond_init(&rwth__jobs.wake, NULL);
+#endif
+
+  rwth__init_worker(0);
+  for (int i = 1; i < num_threads; i++) {
+    rwth__jobs.started[i] = rwth_thread_create(&rwth__jobs.threads[i], rwth__worker_main, (void *) (intptr_t) i);
+  }
+}
+
+RWTH_DEF void rwth_jobs_shutdown() {
+  if (rwth__jobs.num_threads == 0) return;
+  rwth__lock();
+  rwth__jobs.running = false;
+  rwth__unlock();
+  rwth__wake(true);
+  for (int i = 1; i < rwth__jobs.num_threads; i++) {
+    if (rwth__jobs.started[i]) rwth_thread_join(&rwth__jobs.threads[i]);
+  }
+#if defined(_WIN32)
+  DeleteCriticalSection(&rwth__jobs.lock);
 #else
-  // NOTE(ray): This returns the value prior to exchange
-  result = _InterlockedCompareExchange64(val, expected, new_val);
+  pthread_mutex_destroy(&rwth__jobs.lock);
+  pthread_cond_destroy(&rwth__jobs.wake);
 #endif
+  free(rwth__jobs.queues);
+  free(rwth__jobs.threads);
+  free(rwth__jobs.started);
+  rwth__jobs.queues = NULL;
+  rwth__jobs.threads = NULL;
+  rwth__jobs.started = NULL;
+  rwth__jobs.num_threads = 0;
+  rwth__worker_index = -1;
+}
+
+RWTH_DEF int rwth_jobs_num_threads() {
+  return rwth__jobs.num_threads;
+}
+
+RWTH_DEF int rwth_jobs_worker_index() {
+  return rwth__worker_index;
+}
+
+RWTH_DEF void rwth_jobs_run(rwth_job_fn fn, void *data, rwth_counter *counter) {
+  rwth__Job job;
+  job.fn = fn;
+  job.data = data;
+  job.counter = counter;
+  if (counter) rwth_atomic_add_i64_explicit(&counter->value, 1, RWTH_RELAXED);
+
+  int index = rwth__worker_index;
+  if (index < 0) {
+    rwth__execute(&job);
+    return;
+  }
+  rwth_atomic_add_i64(&rwth__jobs.num_queued, 1);
+  if (!rwth__queue_push(&rwth__jobs.queues[index], job)) {
+    // NOTE(ray): Queue is full, run it now rather than block
+    rwth_atomic_add_i64(&rwth__jobs.num_queued, -1);
+    rwth__execute(&job);
+    return;
+  }
+  if (rwth_atomic_load_i64(&rwth__jobs.num_sleeping, RWTH_SEQ_CST) > 0) rwth__wake(false);
+}
+
+RWTH_DEF void rwth_jobs_wait(rwth_counter *counter) {
+  while (rwth_atomic_load_i64(&counter->value, RWTH_ACQUIRE) > 0) {
+    rwth__Job job;
+    if (rwth__worker_index >= 0 && rwth__get_job(&job)) {
+      rwth__execute(&job);
+    } else {
+      rwth_thread_yield();
+    }
+  }
+}
+
+RWTH_DEF void rwth_parallel_for(int start, int end, int grain_size, rwth_parallel_for_fn fn, void *data) {
+  if (start >= end) return;
+  if (grain_size < 1) grain_size = 1;
+  rwth__ParallelFor pf;
+  pf.fn = fn;
+  pf.data = data;
+  pf.end = end;
+  pf.grain_size = grain_size;
+  pf.next = start;
+
+  // NOTE(ray): One job per thread that keeps grabbing the next range until there are none
+  // left. The calling thread takes part as well, so one less job is queued.
+  int64_t num_ranges = ((int64_t) end - start + grain_size - 1) / grain_size;
+  int num_jobs = (num_ranges < rwth__jobs.num_threads ? (int) num_ranges : rwth__jobs.num_threads) - 1;
+  rwth_counter counter = {};
+  for (int i = 0; i < num_jobs; i++) {
+    rwth_jobs_run(rwth__parallel_for_job, &pf, &counter);
+  }
+  rwth__parallel_for_job(&pf);
+  rwth_jobs_wait(&counter);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// __QUEUES
+///////////////////////////////////////////////////////////////////////////////
+
+static int64_t rwth__queue_capacity(int capacity) {
+  int64_t result = 2;
+  while (result < capacity) result *= 2;
+  return result;
+}
+
+RWTH_DEF rwth_mpmc_queue rwth_mpmc_queue_create(int capacity, size_t element_size) {
+  rwth_mpmc_queue result = {};
+  int64_t count = rwth__queue_capacity(capacity);
+  result.mask = count - 1;
+  result.element_size = element_size;
+  // NOTE(ray): Sequence number followed by the element, rounded up to keep the next one aligned
+  result.cell_size = (sizeof(int64_t) + element_size + 7) & ~(size_t) 7;
+  result.cells = (uint8_t *) malloc(count * result.cell_size);
+  for (int64_t i = 0; i < count; i++) {
+    *(int64_t *) (result.cells + i * result.cell_size) = i;
+  }
+  result.tail = 0;
+  result.head = 0;
   return result;
 }
 
+RWTH_DEF void rwth_mpmc_queue_free(rwth_mpmc_queue *q) {
+  free(q->cells);
+  q->cells = NULL;
+}
+
+RWTH_DEF bool rwth_mpmc_queue_push(rwth_mpmc_queue *q, const void *element) {
+  uint8_t *cell;
+  int64_t pos = rwth_atomic_load_i64(&q->tail, RWTH_RELAXED);
+  for (;;) {
+    cell = q->cells + (pos & q->mask) * q->cell_size;
+    int64_t seq = rwth_atomic_load_i64((int64_t volatile *) cell, RWTH_ACQUIRE);
+    int64_t diff = seq - pos;
+    if (diff == 0) {
+      // Cell is free for this position, try to claim it
+      int64_t prev = rwth_atomic_cas_i64_explicit(&q->tail, pos, pos + 1, RWTH_RELAXED);
+      if (prev == pos) break;
+      pos = prev;
+    } else if (diff < 0) {
+      // Cell still holds the element from one lap ago
+      return false;
+    } else {
+      // Another producer got here first
+      pos = rwth_atomic_load_i64(&q->tail, RWTH_RELAXED);
+    }
+  }
+  memcpy(cell + sizeof(int64_t), element, q->element_size);
+  rwth_atomic_store_i64((int64_t volatile *) cell, pos + 1, RWTH_RELEASE);
+  return true;
+}
+
+RWTH_DEF bool rwth_mpmc_queue_pop(rwth_mpmc_queue *q, void *element) {
+  uint8_t *cell;
+  int64_t pos = rwth_atomic_load_i64(&q->head, RWTH_RELAXED);
+  for (;;) {
+    cell = q->cells + (pos & q->mask) * q->cell_size;
+    int64_t seq = rwth_atomic_load_i64((int64_t volatile *) cell, RWTH_ACQUIRE);
+    int64_t diff = seq - (pos + 1);
+    if (diff == 0) {
+      int64_t prev = rwth_atomic_cas_i64_explicit(&q->head, pos, pos + 1, RWTH_RELAXED);
+      if (prev == pos) break;
+      pos = prev;
+    } else if (diff < 0) {
+      // Nothing has been pushed here yet
+      return false;
+    } else {
+      pos = rwth_atomic_load_i64(&q->head, RWTH_RELAXED);
+    }
+  }
+  memcpy(element, cell + sizeof(int64_t), q->element_size);
+  // Free the cell for the push one lap later
+  rwth_atomic_store_i64((int64_t volatile *) cell, pos + q->mask + 1, RWTH_RELEASE);
+  return true;
+}
+
+RWTH_DEF rwth_mpsc_queue rwth_mpsc_queue_create(int capacity, size_t element_size) {
+  return rwth_mpmc_queue_create(capacity, element_size);
+}
+
+RWTH_DEF void rwth_mpsc_queue_free(rwth_mpsc_queue *q) {
+  rwth_mpmc_queue_free(q);
+}
+
+RWTH_DEF bool rwth_mpsc_queue_push(rwth_mpsc_queue *q, const void *element) {
+  return rwth_mpmc_queue_push(q, element);
+}
+
+RWTH_DEF bool rwth_mpsc_queue_pop(rwth_mpsc_queue *q, void *element) {
+  int64_t pos = rwth_atomic_load_i64(&q->head, RWTH_RELAXED);
+  uint8_t *cell = q->cells + (pos & q->mask) * q->cell_size;
+  int64_t seq = rwth_atomic_load_i64((int64_t volatile *) cell, RWTH_ACQUIRE);
+  if (seq != pos + 1) return false;
+  memcpy(element, cell + sizeof(int64_t), q->element_size);
+  rwth_atomic_store_i64((int64_t volatile *) cell, pos + q->mask + 1, RWTH_RELEASE);
+  rwth_atomic_store_i64(&q->head, pos + 1, RWTH_RELAXED);
+  return true;
+}
+
+RWTH_DEF rwth_spsc_queue rwth_spsc_queue_create(int capacity, size_t element_size) {
+  rwth_spsc_queue result = {};
+  int64_t count = rwth__queue_capacity(capacity);
+  result.mask = count - 1;
+  result.element_size = element_size;
+  result.data = (uint8_t *) malloc(count * element_size);
+  result.tail = 0;
+  result.head_cache = 0;
+  result.head = 0;
+  result.tail_cache = 0;
+  return result;
+}
+
+RWTH_DEF void rwth_spsc_queue_free(rwth_spsc_queue *q) {
+  free(q->data);
+  q->data = NULL;
+}
+
+RWTH_DEF bool rwth_spsc_queue_push(rwth_spsc_queue *q, const void *element) {
+  int64_t t = rwth_atomic_load_i64(&q->tail, RWTH_RELAXED);
+  if (t - q->head_cache > q->mask) {
+    q->head_cache = rwth_atomic_load_i64(&q->head, RWTH_ACQUIRE);
+    if (t - q->head_cache > q->mask) return false;
+  }
+  memcpy(q->data + (t & q->mask) * q->element_size, element, q->element_size);
+  rwth_atomic_store_i64(&q->tail, t + 1, RWTH_RELEASE);
+  return true;
+}
+
+RWTH_DEF bool rwth_spsc_queue_pop(rwth_spsc_queue *q, void *element) {
+  int64_t h = rwth_atomic_load_i64(&q->head, RWTH_RELAXED);
+  if (h == q->tail_cache) {
+    q->tail_cache = rwth_atomic_load_i64(&q->tail, RWTH_ACQUIRE);
+    if (h == q->tail_cache) return false;
+  }
+  memcpy(element, q->data + (h & q->mask) * q->element_size, q->element_size);
+  rwth_atomic_store_i64(&q->head, h + 1, RWTH_RELEASE);
+  return true;
+}
+
 #endif // #ifdef RWTH_IMPLEMENTATION
 
 #endif // #ifndef __RW_TH_H__
@@ -1,12 +1,32 @@
 /*
   FILE: rw_time.h
-  VERSION: 0.2.0
+  VERSION: 0.3.0
   DESCRIPTION: High resolution timer (nanoseconds) and related utilities
   AUTHOR: Raymond Wan
   USAGE: Simply including the file will only give you declarations (see __API)
     To include the implementation,
       #define RWTM_IMPLEMENTATION
 
+    The timer is started once and shared by every thread, so their times can be compared.
+    NOTE(ray): With RWTM_STATIC or RWTM_HEADER_ONLY every translation unit gets its own timer
+    starting at its own zero. To compare times across translation units, define
+    RWTM_IMPLEMENTATION in exactly one of them instead.
+
+    For a cheaper rwtm_now (a few nanoseconds instead of an OS call) on x86,
+      #define RWTM_USE_TSC
+    rwtm_init then checks the CPU has an invariant time stamp counter and measures its
+    frequency against the OS clock (taking RWTM_TSC_CALIBRATION_MS). Without one,
+    the OS clock is used as usual. Call rwtm_init at startup, otherwise whichever rwtm_now
+    (or profiler zone, benchmark, ...) comes first busy waits through the calibration while
+    every other thread that wants the time waits for it.
+
+    Windows keep the last RWTM_WINDOW_SIZE samples of something (e.g. frame times) and
+    report their average, min, max, standard deviation and percentiles. Named windows
+    make that a single call, e.g. once per frame
+
+      uint64_t frame_ns = rwtm_mark("frame");
+      rwtm_window_stats stats = rwtm_window_get_stats(rwtm_named_window("frame"));
+
   NOTE(ray): To quickly navigate through the file,
              sections and/or subsections are available to jump to.
   SECTIONS:
@@ -14,10 +34,12 @@
     2. __API
     3. __MACROS
     4. __IMPLEMENTATION
-      4.1. __INIT
-      4.2. __CORE
-      4.3. __UTILITY
-      4.4. __CONVERSION
+      4.1. __CLOCKS
+      4.2. __INIT
+      4.3. __CORE
+      4.4. __UTILITY
+      4.5. __WINDOW
+      4.6. __CONVERSION
 */
 
 #ifndef __RW_TIME_H__
@@ -46,6 +68,22 @@
   #include <time.h>
 #endif
 
+#if defined(RWTM_USE_TSC) && (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86))
+  #define RWTM__TSC_AVAILABLE
+  #if defined(_MSC_VER)
+    #include <intrin.h>
+  #else
+    #include <x86intrin.h>
+    #include <cpuid.h>
+  #endif
+#endif
+
+#ifndef RWTM_TSC_CALIBRATION_MS
+#define RWTM_TSC_CALIBRATION_MS 10
+#endif
+// Bracketed reads tried at each end of the calibration
+#define RWTM__TSC_SAMPLE_TRIES 16
+
 typedef struct rwtm_timer {
 #if defined(__APPLE__) && defined(__MACH__)
   mach_timebase_info_data_t timebase;
@@ -56,9 +94,50 @@ typedef struct rwtm_timer {
 #else
   uint64_t start_ns;
 #endif
+#if defined(RWTM__TSC_AVAILABLE)
+  bool use_tsc;
+  uint64_t start_tsc;
+  uint64_t tsc_start_ns; // rwtm_now at start_tsc
+  uint64_t ns_per_tsc;   // 32.32 fixed point
+#endif
 } rwtm_timer;
 
-static rwtm_timer _timer;
+#ifndef RWTM_WINDOW_SIZE
+#define RWTM_WINDOW_SIZE 128
+#endif
+// Named windows available to rwtm_named_window
+#ifndef RWTM_MAX_NAMED_WINDOWS
+#define RWTM_MAX_NAMED_WINDOWS 32
+#endif
+
+// Last RWTM_WINDOW_SIZE samples. Zero initialize before use.
+// NOTE(ray): The sums and the min/max queues are updated as samples come and go so
+// everything except the percentiles is O(1). Percentiles are only computed when asked for.
+typedef struct rwtm_window {
+  uint64_t samples[RWTM_WINDOW_SIZE];
+  uint64_t num_samples; // ever added, samples[i % RWTM_WINDOW_SIZE] holds sample i
+  uint64_t sum;
+  double sum_sq;
+  // Sample numbers with increasing (min) or decreasing (max) values, the front is the min/max
+  uint64_t min_queue[RWTM_WINDOW_SIZE];
+  uint64_t max_queue[RWTM_WINDOW_SIZE];
+  uint64_t min_head, min_tail;
+  uint64_t max_head, max_tail;
+  // Only used by named windows
+  const char *name;
+  uint64_t last_mark;
+} rwtm_window;
+
+typedef struct rwtm_window_stats {
+  int count; // samples in the window
+  uint64_t avg;
+  uint64_t min;
+  uint64_t max;
+  double stddev;
+  uint64_t p50;
+  uint64_t p95;
+  uint64_t p99;
+} rwtm_window_stats;
 
 ///////////////////////////////////////////////////////////////////////////////
 // __MACROS
@@ -78,21 +157,34 @@ extern "C" {
 
 // __INIT
 
-// Initialize the internal timer
+// Starts the timer. Optional, rwtm_now starts it on first use. Timer state is shared by
+// every thread, and by every translation unit when only one defines RWTM_IMPLEMENTATION
+// (with RWTM_STATIC/RWTM_HEADER_ONLY each translation unit has a timer of its own).
+// With RWTM_USE_TSC the first call busy waits RWTM_TSC_CALIBRATION_MS, so call it at startup.
 RWTM_DEF void rwtm_init();
+// Whether rwtm_now reads the time stamp counter (see RWTM_USE_TSC)
+RWTM_DEF bool rwtm_using_tsc();
 
 // __TIMER
 
-// Returns the current time since intializing the timer (in nanoseconds)
+// Returns the current time since intializing the timer (in nanoseconds).
+// Starts the timer if rwtm_init wasn't called, see rwtm_init for what that costs.
 RWTM_DEF uint64_t rwtm_now();
 
 // __UTILITY
 RWTM_DEF uint64_t rwtm_diff(int64_t end, int64_t start);
 RWTM_DEF uint64_t rwtm_since(int64_t start);
 
-// TODO(ray): Implement these
-RWTM_DEF uint64_t rwtm_mark();
-RWTM_DEF uint64_t rwtm_window_avg();
+// __WINDOW
+RWTM_DEF void rwtm_window_add(rwtm_window *window, uint64_t sample);
+RWTM_DEF rwtm_window_stats rwtm_window_get_stats(rwtm_window *window);
+// The window called name, made the first time it is asked for. NULL if there are
+// already RWTM_MAX_NAMED_WINDOWS. Named windows are not thread safe.
+RWTM_DEF rwtm_window *rwtm_named_window(const char *name);
+// Adds the time since the previous mark of name to its window and returns it (0 the first time)
+RWTM_DEF uint64_t rwtm_mark(const char *name);
+// Average of the window called name, 0 if there is none
+RWTM_DEF uint64_t rwtm_window_avg(const char *name);
 
 // __CONVERSION
 RWTM_DEF double rwtm_to_sec(uint64_t ns);
@@ -109,32 +201,12 @@ RWTM_DEF double rwtm_to_us(uint64_t ns);
 
 #if defined(RWTM_IMPLEMENTATION) || defined(RWTM_HEADER_ONLY)
 
-///////////////////////////////////////////////////////////////////////////////
-// __INIT
-///////////////////////////////////////////////////////////////////////////////
-
-RWTM_DEF void rwtm_init() {
-#if defined(__APPLE__) && defined(__MACH__)
-  mach_timebase_info(&_timer.timebase);
-  _timer.start_ticks = mach_absolute_time();
-#elif defined(_WIN32)
-  // NOTE(ray): QueryPerformanceFrequency returns counts per second
-  // https://msdn.microsoft.com/en-us/library/windows/desktop/ms644904(v=vs.85).aspx
-  // https://msdn.microsoft.com/en-us/library/windows/desktop/ms644905(v=vs.85).aspx
-  // The frequncy returned is in COUNTS PER SECOND
-  QueryPerformanceFrequency(&_timer.freq);
-  QueryPerformanceCounter(&_timer.start_counter);
-#else
-  // NOTE(ray): https://linux.die.net/man/3/clock_gettime
-  struct timespec tp;
-  clock_gettime(CLOCK_MONOTONIC, &tp);
-  // Store the highest resolution time we can i.e nanoseconds
-	_timer.start_ns = SECS_TO_NANO(tp.tv_sec) + tp.tv_nsec;
-#endif
-}
+#include <math.h> // sqrt
+#include <stdlib.h> // qsort
+#include <string.h> // memcpy, strcmp
 
 ///////////////////////////////////////////////////////////////////////////////
-// __CORE
+// __CLOCKS
 ///////////////////////////////////////////////////////////////////////////////
 
 static int64_t rwtm__mul_div_i64(int64_t t, int64_t numer, int64_t denom) {
@@ -150,24 +222,196 @@ static int64_t rwtm__mul_div_i64(int64_t t, int64_t numer, int64_t denom) {
   return (q * numer) + (r * numer) / denom;
 }
 
-RWTM_DEF uint64_t rwtm_now() {
+// Nanoseconds since the timer started according to the OS clock
+static uint64_t rwtm__os_now(const rwtm_timer *timer) {
   uint64_t cur_time;
 #if defined(__APPLE__) && defined(__MACH__)
   // NOTE(ray): https://shiftedbits.org/2008/10/01/mach_absolute_time-on-the-iphone/
-  cur_time = rwtm__mul_div_i64(mach_absolute_time() - _timer.start_ticks, _timer.timebase.numer, _timer.timebase.denom);
+  cur_time = rwtm__mul_div_i64(mach_absolute_time() - timer->start_ticks, timer->timebase.numer, timer->timebase.denom);
 #elif defined(_WIN32)
   // NOTE(ray): https://docs.microsoft.com/en-us/windows/desktop/SysInfo/acquiring-high-resolution-time-stamps
   LARGE_INTEGER count;
   QueryPerformanceCounter(&count);
-  cur_time = rwtm__mul_div_i64(count.QuadPart - _timer.start_counter.QuadPart, 1000000000 /* ns/sec */, _timer.freq.QuadPart);
+  cur_time = rwtm__mul_div_i64(count.QuadPart - timer->start_counter.QuadPart, 1000000000 /* ns/sec */, timer->freq.QuadPart);
 #else
   struct timespec tp;
   clock_gettime(CLOCK_MONOTONIC, &tp);
-  cur_time = (SECS_TO_NANO(tp.tv_sec) + tp.tv_nsec) - _timer.start_ns;
+  cur_time = (SECS_TO_NANO(tp.tv_sec) + tp.tv_nsec) - timer->start_ns;
 #endif
   return cur_time;
 }
 
+#if defined(RWTM__TSC_AVAILABLE)
+// NOTE(ray): Only an invariant TSC ticks at a constant rate through frequency
+// and power state changes, and in sync on every core (CPUID.80000007H:EDX[8])
+static bool rwtm__invariant_tsc() {
+#if defined(_MSC_VER)
+  int regs[4];
+  __cpuid(regs, 0x80000000);
+  if ((unsigned) regs[0] < 0x80000007) return false;
+  __cpuid(regs, 0x80000007);
+  return (regs[3] & (1 << 8)) != 0;
+#else
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) return false;
+  return (edx & (1 << 8)) != 0;
+#endif
+}
+
+// Reads the TSC between two reads of the OS clock and sets *ns to the middle of them.
+// NOTE(ray): Being preempted between the reads would skew the calibration for the whole
+// process, so the tightest of a few tries is kept.
+static uint64_t rwtm__tsc_sample(const rwtm_timer *timer, uint64_t *ns) {
+  uint64_t best_width = UINT64_MAX, best_tsc = 0;
+  for (int i = 0; i < RWTM__TSC_SAMPLE_TRIES; i++) {
+    uint64_t before = rwtm__os_now(timer);
+    uint64_t tsc = __rdtsc();
+    uint64_t after = rwtm__os_now(timer);
+    if (after - before < best_width) {
+      best_width = after - before;
+      best_tsc = tsc;
+      *ns = before + best_width / 2;
+    }
+  }
+  return best_tsc;
+}
+
+// Measures how many nanoseconds a tick takes against the OS clock
+static void rwtm__calibrate_tsc(rwtm_timer *timer) {
+  uint64_t start_ns, end_ns;
+  uint64_t start_tsc = rwtm__tsc_sample(timer, &start_ns);
+  while (rwtm__os_now(timer) - start_ns < RWTM_TSC_CALIBRATION_MS * 1000000ull) {}
+  uint64_t end_tsc = rwtm__tsc_sample(timer, &end_ns);
+  if (end_tsc <= start_tsc || end_ns <= start_ns) return;
+  timer->ns_per_tsc = ((end_ns - start_ns) << 32) / (end_tsc - start_tsc);
+  timer->start_tsc = end_tsc;
+  timer->tsc_start_ns = end_ns;
+  timer->use_tsc = timer->ns_per_tsc > 0;
+}
+
+// (ticks * ns_per_tsc) >> 32 without overflowing
+static inline uint64_t rwtm__tsc_to_ns(const rwtm_timer *timer, uint64_t ticks) {
+#if defined(__SIZEOF_INT128__)
+  return (uint64_t) (((unsigned __int128) ticks * timer->ns_per_tsc) >> 32);
+#elif defined(_MSC_VER) && defined(_M_X64)
+  uint64_t hi;
+  uint64_t lo = _umul128(ticks, timer->ns_per_tsc, &hi);
+  return __shiftright128(lo, hi, 32);
+#else
+  return (uint64_t) rwtm__mul_div_i64((int64_t) ticks, (int64_t) timer->ns_per_tsc, 1ll << 32);
+#endif
+}
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// __INIT
+///////////////////////////////////////////////////////////////////////////////
+
+#if defined(_WIN32)
+#define RWTM__THREAD_LOCAL __declspec(thread)
+#else
+#include <sched.h> // sched_yield
+#define RWTM__THREAD_LOCAL __thread
+#endif
+
+// NOTE(ray): One timebase so times from any thread compare. It is static, so with
+// RWTM_STATIC/RWTM_HEADER_ONLY there is one per translation unit.
+// It is written once by whichever thread gets to initialize it and only read after that,
+// so every thread keeps its own copy to read from.
+enum {
+  RWTM__TIMER_UNINITIALIZED,
+  RWTM__TIMER_INITIALIZING,
+  RWTM__TIMER_READY
+};
+static rwtm_timer rwtm__timer;
+static long volatile rwtm__timer_state;
+static RWTM__THREAD_LOCAL rwtm_timer rwtm__thread_timer;
+static RWTM__THREAD_LOCAL bool rwtm__thread_timer_ready;
+
+static void rwtm__start_timer(rwtm_timer *timer) {
+#if defined(__APPLE__) && defined(__MACH__)
+  mach_timebase_info(&timer->timebase);
+  timer->start_ticks = mach_absolute_time();
+#elif defined(_WIN32)
+  // NOTE(ray): QueryPerformanceFrequency returns counts per second
+  // https://msdn.microsoft.com/en-us/library/windows/desktop/ms644904(v=vs.85).aspx
+  // https://msdn.microsoft.com/en-us/library/windows/desktop/ms644905(v=vs.85).aspx
+  // The frequncy returned is in COUNTS PER SECOND
+  QueryPerformanceFrequency(&timer->freq);
+  QueryPerformanceCounter(&timer->start_counter);
+#else
+  // NOTE(ray): https://linux.die.net/man/3/clock_gettime
+  struct timespec tp;
+  clock_gettime(CLOCK_MONOTONIC, &tp);
+  // Store the highest resolution time we can i.e nanoseconds
+	timer->start_ns = SECS_TO_NANO(tp.tv_sec) + tp.tv_nsec;
+#endif
+#if defined(RWTM__TSC_AVAILABLE)
+  timer->use_tsc = false;
+  if (rwtm__invariant_tsc()) rwtm__calibrate_tsc(timer);
+#endif
+}
+
+// The process wide timer, started by the first thread to get here
+static const rwtm_timer *rwtm__get_timer() {
+#if defined(_MSC_VER)
+  if (InterlockedCompareExchange(&rwtm__timer_state, 0, 0) != RWTM__TIMER_READY) {
+    if (InterlockedCompareExchange(&rwtm__timer_state, RWTM__TIMER_INITIALIZING, RWTM__TIMER_UNINITIALIZED) == RWTM__TIMER_UNINITIALIZED) {
+      rwtm__start_timer(&rwtm__timer);
+      InterlockedExchange(&rwtm__timer_state, RWTM__TIMER_READY);
+    } else {
+      while (InterlockedCompareExchange(&rwtm__timer_state, 0, 0) != RWTM__TIMER_READY) SwitchToThread();
+    }
+  }
+#else
+  if (__atomic_load_n(&rwtm__timer_state, __ATOMIC_ACQUIRE) != RWTM__TIMER_READY) {
+    long expected = RWTM__TIMER_UNINITIALIZED;
+    if (__atomic_compare_exchange_n(&rwtm__timer_state, &expected, RWTM__TIMER_INITIALIZING,
+                                    false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+      rwtm__start_timer(&rwtm__timer);
+      __atomic_store_n(&rwtm__timer_state, RWTM__TIMER_READY, __ATOMIC_RELEASE);
+    } else {
+      while (__atomic_load_n(&rwtm__timer_state, __ATOMIC_ACQUIRE) != RWTM__TIMER_READY) sched_yield();
+    }
+  }
+#endif
+  return &rwtm__timer;
+}
+
+static inline const rwtm_timer *rwtm__get_thread_timer() {
+  if (!rwtm__thread_timer_ready) {
+    rwtm__thread_timer = *rwtm__get_timer();
+    rwtm__thread_timer_ready = true;
+  }
+  return &rwtm__thread_timer;
+}
+
+RWTM_DEF void rwtm_init() {
+  rwtm__get_thread_timer();
+}
+
+RWTM_DEF bool rwtm_using_tsc() {
+#if defined(RWTM__TSC_AVAILABLE)
+  return rwtm__get_thread_timer()->use_tsc;
+#else
+  return false;
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// __CORE
+///////////////////////////////////////////////////////////////////////////////
+
+RWTM_DEF uint64_t rwtm_now() {
+  const rwtm_timer *timer = rwtm__get_thread_timer();
+#if defined(RWTM__TSC_AVAILABLE)
+  if (timer->use_tsc) {
+    return timer->tsc_start_ns + rwtm__tsc_to_ns(timer, __rdtsc() - timer->start_tsc);
+  }
+#endif
+  return rwtm__os_now(timer);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // __UTILITY
 ///////////////////////////////////////////////////////////////////////////////
@@ -180,6 +424,119 @@ RWTM_DEF uint64_t rwtm_since(int64_t start) {
   return rwtm_diff(rwtm_now(), start);
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// __WINDOW
+///////////////////////////////////////////////////////////////////////////////
+
+static rwtm_window rwtm__named_windows[RWTM_MAX_NAMED_WINDOWS];
+static int rwtm__num_named_windows;
+
+RWTM_DEF void rwtm_window_add(rwtm_window *window, uint64_t sample) {
+  uint64_t n = window->num_samples;
+  uint64_t *slot = &window->samples[n % RWTM_WINDOW_SIZE];
+  if (n >= RWTM_WINDOW_SIZE) {
+    window->sum -= *slot;
+    window->sum_sq -= (double) *slot * (double) *slot;
+  }
+  *slot = sample;
+  window->sum += sample;
+  window->sum_sq += (double) sample * (double) sample;
+  window->num_samples = n + 1;
+
+  // Samples that left the window, then the ones that can never be the min/max again
+  uint64_t oldest = n + 1 > RWTM_WINDOW_SIZE ? n + 1 - RWTM_WINDOW_SIZE : 0;
+  if (window->min_head < window->min_tail && window->min_queue[window->min_head % RWTM_WINDOW_SIZE] < oldest) window->min_head++;
+  if (window->max_head < window->max_tail && window->max_queue[window->max_head % RWTM_WINDOW_SIZE] < oldest) window->max_head++;
+  while (window->min_head < window->min_tail &&
+         window->samples[window->min_queue[(window->min_tail - 1) % RWTM_WINDOW_SIZE] % RWTM_WINDOW_SIZE] >= sample) {
+    window->min_tail--;
+  }
+  window->min_queue[window->min_tail++ % RWTM_WINDOW_SIZE] = n;
+  while (window->max_head < window->max_tail &&
+         window->samples[window->max_queue[(window->max_tail - 1) % RWTM_WINDOW_SIZE] % RWTM_WINDOW_SIZE] <= sample) {
+    window->max_tail--;
+  }
+  window->max_queue[window->max_tail++ % RWTM_WINDOW_SIZE] = n;
+
+  // NOTE(ray): Adding and subtracting squares slowly loses precision, so start over once per window
+  if ((n + 1) % RWTM_WINDOW_SIZE == 0) {
+    window->sum_sq = 0.0;
+    for (int i = 0; i < RWTM_WINDOW_SIZE; i++) window->sum_sq += (double) window->samples[i] * (double) window->samples[i];
+  }
+}
+
+static int rwtm__compare_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+  return x < y ? -1 : x > y;
+}
+
+// Nearest rank
+static uint64_t rwtm__percentile(uint64_t *sorted, int count, int percent) {
+  int rank = (percent * count + 99) / 100;
+  return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+RWTM_DEF rwtm_window_stats rwtm_window_get_stats(rwtm_window *window) {
+  rwtm_window_stats result = {};
+  int count = window->num_samples < RWTM_WINDOW_SIZE ? (int) window->num_samples : RWTM_WINDOW_SIZE;
+  if (count == 0) return result;
+  result.count = count;
+  result.avg = window->sum / count;
+  result.min = window->samples[window->min_queue[window->min_head % RWTM_WINDOW_SIZE] % RWTM_WINDOW_SIZE];
+  result.max = window->samples[window->max_queue[window->max_head % RWTM_WINDOW_SIZE] % RWTM_WINDOW_SIZE];
+  double mean = (double) window->sum / count;
+  double variance = window->sum_sq / count - mean * mean;
+  result.stddev = variance > 0.0 ? sqrt(variance) : 0.0;
+
+  uint64_t sorted[RWTM_WINDOW_SIZE];
+  memcpy(sorted, window->samples, count * sizeof(uint64_t));
+  qsort(sorted, count, sizeof(uint64_t), rwtm__compare_u64);
+  result.p50 = rwtm__percentile(sorted, count, 50);
+  result.p95 = rwtm__percentile(sorted, count, 95);
+  result.p99 = rwtm__percentile(sorted, count, 99);
+  return result;
+}
+
+// The window called name, NULL if there isn't one yet
+static rwtm_window *rwtm__find_named_window(const char *name) {
+  for (int i = 0; i < rwtm__num_named_windows; i++) {
+    rwtm_window *window = &rwtm__named_windows[i];
+    if (window->name == name || strcmp(window->name, name) == 0) return window;
+  }
+  return NULL;
+}
+
+RWTM_DEF rwtm_window *rwtm_named_window(const char *name) {
+  rwtm_window *found = rwtm__find_named_window(name);
+  if (found != NULL) return found;
+  if (rwtm__num_named_windows == RWTM_MAX_NAMED_WINDOWS) return NULL;
+  rwtm_window *window = &rwtm__named_windows[rwtm__num_named_windows++];
+  window->name = name;
+  return window;
+}
+
+RWTM_DEF uint64_t rwtm_mark(const char *name) {
+  rwtm_window *window = rwtm_named_window(name);
+  if (window == NULL) return 0;
+  uint64_t now = rwtm_now();
+  uint64_t result = 0;
+  if (window->last_mark != 0) {
+    result = rwtm_diff(now, window->last_mark);
+    rwtm_window_add(window, result);
+  }
+  // NOTE(ray): 0 means never marked
+  window->last_mark = now ? now : 1;
+  return result;
+}
+
+RWTM_DEF uint64_t rwtm_window_avg(const char *name) {
+  // NOTE(ray): Only looks, asking about a name that was never marked doesn't use up a window
+  rwtm_window *window = rwtm__find_named_window(name);
+  if (window == NULL || window->num_samples == 0) return 0;
+  int count = window->num_samples < RWTM_WINDOW_SIZE ? (int) window->num_samples : RWTM_WINDOW_SIZE;
+  return window->sum / count;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // __CONVERSION
 ///////////////////////////////////////////////////////////////////////////////
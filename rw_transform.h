@@ -1,6 +1,6 @@
 /*
   FILE: rw_transform.h
-  VERSION: 0.1.0
+  VERSION: 0.3.0
   DESCRIPTION: Matrix transformation data structure and functions.
   AUTHOR: Raymond Wan
   DEPENDENCIES: rw_math.h
@@ -15,6 +15,7 @@
     2. __API
     3. __MACROS
     4. __IMPLEMENTATION
+      4.1. __BATCH
 */
 
 #ifndef __RW_TRANSFORM_H__
@@ -43,6 +44,7 @@
 // __TYPES
 ///////////////////////////////////////////////////////////////////////////////
 
+#include <stddef.h>
 #include "rw_math.h"
 
 typedef enum RWTR_AXIS {
@@ -60,7 +62,10 @@ typedef enum RWTR_AXIS {
 extern "C" {
 #endif
 
+// NOTE(ray): Uses the cheaper affine inverse when the last row of m is (0, 0, 0, 1)
 RWTR_DEF Transform rwtr_init_m4(Mat4 *m);
+// m must only contain a rotation and a translation
+RWTR_DEF Transform rwtr_init_m4_rigid(Mat4 *m);
 RWTR_DEF Transform rwtr_init_translate(float x, float y, float z);
 RWTR_DEF Transform rwtr_init_scale(float x, float y, float z);
 RWTR_DEF Transform rwtr_init_rotate_x(float degrees);
@@ -82,6 +87,19 @@ RWTR_DEF Vec3 rwtr_pt3_apply_inv(Transform *tr, Point3 p);
 RWTR_DEF Vec4 rwtr_v4_apply_inv(Transform *tr, Vec4 v);
 RWTR_DEF Rect3 rwtr_r3_apply_inv(Transform *tr, Rect3 r);
 
+// NOTE(ray): Array versions of the above. in and out may be the same array.
+// The _strided versions read/write the Vec3 found every stride bytes which allows
+// transforming e.g. the position of an interleaved vertex buffer in place.
+RWTR_DEF void rwtr_v3_apply_n(Transform *tr, Vec3 *in, Vec3 *out, int count);
+RWTR_DEF void rwtr_pt3_apply_n(Transform *tr, Point3 *in, Point3 *out, int count);
+RWTR_DEF void rwtr_n3_apply_n(Transform *tr, Normal3 *in, Normal3 *out, int count);
+RWTR_DEF void rwtr_v4_apply_n(Transform *tr, Vec4 *in, Vec4 *out, int count);
+RWTR_DEF void rwtr_r3_apply_n(Transform *tr, Rect3 *in, Rect3 *out, int count);
+RWTR_DEF void rwtr_r3_apply_inv_n(Transform *tr, Rect3 *in, Rect3 *out, int count);
+RWTR_DEF void rwtr_v3_apply_strided(Transform *tr, void *in, size_t in_stride, void *out, size_t out_stride, int count);
+RWTR_DEF void rwtr_pt3_apply_strided(Transform *tr, void *in, size_t in_stride, void *out, size_t out_stride, int count);
+RWTR_DEF void rwtr_n3_apply_strided(Transform *tr, void *in, size_t in_stride, void *out, size_t out_stride, int count);
+
 #ifdef __cplusplus
 }
 #endif
@@ -98,7 +116,18 @@ RWTR_DEF Rect3 rwtr_r3_apply_inv(Transform *tr, Rect3 r);
 RWTR_DEF Transform rwtr_init_m4(Mat4 *m) {
   Transform result;
   result.t = *m;
-  result.t_inv = rwm_m4_inverse(*m);
+  if (rwm_m4_is_affine(*m)) {
+    result.t_inv = rwm_m4_inverse_affine(*m);
+  } else {
+    result.t_inv = rwm_m4_inverse(*m);
+  }
+  return result;
+}
+
+RWTR_DEF Transform rwtr_init_m4_rigid(Mat4 *m) {
+  Transform result;
+  result.t = *m;
+  result.t_inv = rwm_m4_inverse_rigid(*m);
   return result;
 }
 
@@ -320,18 +349,29 @@ RWTR_DEF Vec4 rwtr_v4_apply(Transform *tr, Vec4 v) {
   return result;
 }
 
-RWTR_DEF Rect3 rwtr_r3_apply(Transform *tr, Rect3 r) {
-  Rect3 result = rwm_r3_init_p(rwtr_pt3_apply(tr, r.min_p));
-  result = rwm_r3_union(result, rwm_r3_init_p(rwtr_pt3_apply(tr, rwm_v3_init(r.min_px, r.min_py, r.max_pz))));
-  result = rwm_r3_union(result, rwm_r3_init_p(rwtr_pt3_apply(tr, rwm_v3_init(r.min_px, r.max_py, r.min_pz))));
-  result = rwm_r3_union(result, rwm_r3_init_p(rwtr_pt3_apply(tr, rwm_v3_init(r.min_px, r.max_py, r.max_pz))));
-  result = rwm_r3_union(result, rwm_r3_init_p(rwtr_pt3_apply(tr, rwm_v3_init(r.max_px, r.min_py, r.min_pz))));
-  result = rwm_r3_union(result, rwm_r3_init_p(rwtr_pt3_apply(tr, rwm_v3_init(r.max_px, r.min_py, r.max_pz))));
-  result = rwm_r3_union(result, rwm_r3_init_p(rwtr_pt3_apply(tr, rwm_v3_init(r.max_px, r.max_py, r.min_pz))));
-  result = rwm_r3_union(result, rwm_r3_init_p(rwtr_pt3_apply(tr, rwm_v3_init(r.max_px, r.max_py, r.max_pz))));
+// NOTE(ray): Arvo, "Transforming Axis-Aligned Bounding Boxes" (Graphics Gems, 1990).
+// Each axis of the result is the translation plus, for every input axis, the smaller
+// (or larger) of the matrix element times the min and max extent of the box.
+// Gives the same box as transforming all 8 corners, at a fraction of the cost.
+static Rect3 rwtr__m4_apply_r3(Mat4 *m, Rect3 r) {
+  Rect3 result;
+  for (int i = 0; i < 3; i++) {
+    result.p[0].e[i] = m->e[i][3];
+    result.p[1].e[i] = m->e[i][3];
+    for (int j = 0; j < 3; j++) {
+      float a = m->e[i][j] * r.p[0].e[j];
+      float b = m->e[i][j] * r.p[1].e[j];
+      result.p[0].e[i] += MIN(a, b);
+      result.p[1].e[i] += MAX(a, b);
+    }
+  }
   return result;
 }
 
+RWTR_DEF Rect3 rwtr_r3_apply(Transform *tr, Rect3 r) {
+  return rwtr__m4_apply_r3(&tr->t, r);
+}
+
 RWTR_DEF Vec3 rwtr_v3_apply_inv(Transform *tr, Vec3 v) {
   Vec3 result;
   result.x = tr->t_inv.e[0][0]*v.x + tr->t_inv.e[0][1]*v.y + tr->t_inv.e[0][2]*v.z;
@@ -358,15 +398,169 @@ RWTR_DEF Vec4 rwtr_v4_apply_inv(Transform *tr, Vec4 v) {
 }
 
 RWTR_DEF Rect3 rwtr_r3_apply_inv(Transform *tr, Rect3 r) {
-  Rect3 result = rwm_r3_init_p(rwtr_pt3_apply_inv(tr, r.min_p));
-  result = rwm_r3_union(result, rwm_r3_init_p(rwtr_pt3_apply_inv(tr, rwm_v3_init(r.min_px, r.min_py, r.max_pz))));
-  result = rwm_r3_union(result, rwm_r3_init_p(rwtr_pt3_apply_inv(tr, rwm_v3_init(r.min_px, r.max_py, r.min_pz))));
-  result = rwm_r3_union(result, rwm_r3_init_p(rwtr_pt3_apply_inv(tr, rwm_v3_init(r.min_px, r.max_py, r.max_pz))));
-  result = rwm_r3_union(result, rwm_r3_init_p(rwtr_pt3_apply_inv(tr, rwm_v3_init(r.max_px, r.min_py, r.min_pz))));
-  result = rwm_r3_union(result, rwm_r3_init_p(rwtr_pt3_apply_inv(tr, rwm_v3_init(r.max_px, r.min_py, r.max_pz))));
-  result = rwm_r3_union(result, rwm_r3_init_p(rwtr_pt3_apply_inv(tr, rwm_v3_init(r.max_px, r.max_py, r.min_pz))));
-  result = rwm_r3_union(result, rwm_r3_init_p(rwtr_pt3_apply_inv(tr, rwm_v3_init(r.max_px, r.max_py, r.max_pz))));
-  return result;
+  return rwtr__m4_apply_r3(&tr->t_inv, r);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// __BATCH
+///////////////////////////////////////////////////////////////////////////////
+
+#if defined(RW_USE_INTRINSICS)
+// Loads 4 Vec3s and transposes them into x, y, z lanes
+static inline void rwtr__load_v3x4(uint8_t *in, size_t stride, __m128 *x, __m128 *y, __m128 *z) {
+  if (stride == sizeof(Vec3)) {
+    // NOTE(ray): a = x0y0z0x1, b = y1z1x2y2, c = z2x3y3z3
+    float *p = (float *) in;
+    __m128 a = _mm_loadu_ps(p);
+    __m128 b = _mm_loadu_ps(p + 4);
+    __m128 c = _mm_loadu_ps(p + 8);
+    *x = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+    *y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+    *z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+  } else {
+    Vec3 *v0 = (Vec3 *) in;
+    Vec3 *v1 = (Vec3 *) (in + stride);
+    Vec3 *v2 = (Vec3 *) (in + 2*stride);
+    Vec3 *v3 = (Vec3 *) (in + 3*stride);
+    *x = _mm_setr_ps(v0->x, v1->x, v2->x, v3->x);
+    *y = _mm_setr_ps(v0->y, v1->y, v2->y, v3->y);
+    *z = _mm_setr_ps(v0->z, v1->z, v2->z, v3->z);
+  }
+}
+
+// Inverse of rwtr__load_v3x4
+static inline void rwtr__store_v3x4(uint8_t *out, size_t stride, __m128 x, __m128 y, __m128 z) {
+  if (stride == sizeof(Vec3)) {
+    float *p = (float *) out;
+    _mm_storeu_ps(p, _mm_shuffle_ps(_mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 0, 0, 0)), _mm_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0)));
+    _mm_storeu_ps(p + 4, _mm_shuffle_ps(_mm_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1)), _mm_shuffle_ps(x, y, _MM_SHUFFLE(2, 2, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0)));
+    _mm_storeu_ps(p + 8, _mm_shuffle_ps(_mm_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2)), _mm_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0)));
+  } else {
+    float xs[4], ys[4], zs[4];
+    _mm_storeu_ps(xs, x);
+    _mm_storeu_ps(ys, y);
+    _mm_storeu_ps(zs, z);
+    for (int i = 0; i < 4; i++) {
+      Vec3 *v = (Vec3 *) (out + i*stride);
+      v->x = xs[i];
+      v->y = ys[i];
+      v->z = zs[i];
+    }
+  }
+}
+#endif
+
+// NOTE(ray): Applies the upper 3x4 of m to count Vec3s. The translation column
+// is scaled by w, so w = 1 transforms points and w = 0 transforms vectors.
+static void rwtr__m4_apply_v3_n(Mat4 *m, float w, uint8_t *in, size_t in_stride, uint8_t *out, size_t out_stride, int count) {
+  int i = 0;
+#if defined(RW_USE_INTRINSICS)
+  // Keep the whole matrix in registers for the duration of the loop
+  __m128 m00 = _mm_set1_ps(m->e[0][0]), m01 = _mm_set1_ps(m->e[0][1]), m02 = _mm_set1_ps(m->e[0][2]), m03 = _mm_set1_ps(w*m->e[0][3]);
+  __m128 m10 = _mm_set1_ps(m->e[1][0]), m11 = _mm_set1_ps(m->e[1][1]), m12 = _mm_set1_ps(m->e[1][2]), m13 = _mm_set1_ps(w*m->e[1][3]);
+  __m128 m20 = _mm_set1_ps(m->e[2][0]), m21 = _mm_set1_ps(m->e[2][1]), m22 = _mm_set1_ps(m->e[2][2]), m23 = _mm_set1_ps(w*m->e[2][3]);
+  for (; i + 4 <= count; i += 4) {
+    __m128 x, y, z;
+    rwtr__load_v3x4(in + i*in_stride, in_stride, &x, &y, &z);
+    __m128 rx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m00, x), _mm_mul_ps(m01, y)), _mm_add_ps(_mm_mul_ps(m02, z), m03));
+    __m128 ry = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m10, x), _mm_mul_ps(m11, y)), _mm_add_ps(_mm_mul_ps(m12, z), m13));
+    __m128 rz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m20, x), _mm_mul_ps(m21, y)), _mm_add_ps(_mm_mul_ps(m22, z), m23));
+    rwtr__store_v3x4(out + i*out_stride, out_stride, rx, ry, rz);
+  }
+#endif
+  for (; i < count; i++) {
+    Vec3 v = *((Vec3 *) (in + i*in_stride));
+    Vec3 *result = (Vec3 *) (out + i*out_stride);
+    result->x = m->e[0][0]*v.x + m->e[0][1]*v.y + m->e[0][2]*v.z + w*m->e[0][3];
+    result->y = m->e[1][0]*v.x + m->e[1][1]*v.y + m->e[1][2]*v.z + w*m->e[1][3];
+    result->z = m->e[2][0]*v.x + m->e[2][1]*v.y + m->e[2][2]*v.z + w*m->e[2][3];
+  }
+}
+
+RWTR_DEF void rwtr_v3_apply_n(Transform *tr, Vec3 *in, Vec3 *out, int count) {
+  rwtr__m4_apply_v3_n(&tr->t, 0.0f, (uint8_t *) in, sizeof(Vec3), (uint8_t *) out, sizeof(Vec3), count);
+}
+
+RWTR_DEF void rwtr_pt3_apply_n(Transform *tr, Point3 *in, Point3 *out, int count) {
+  rwtr__m4_apply_v3_n(&tr->t, 1.0f, (uint8_t *) in, sizeof(Point3), (uint8_t *) out, sizeof(Point3), count);
+}
+
+RWTR_DEF void rwtr_n3_apply_n(Transform *tr, Normal3 *in, Normal3 *out, int count) {
+  // NOTE(ray): See rwtr_n3_apply
+  Mat4 inv_transpose = rwm_m4_transpose(tr->t_inv);
+  rwtr__m4_apply_v3_n(&inv_transpose, 0.0f, (uint8_t *) in, sizeof(Normal3), (uint8_t *) out, sizeof(Normal3), count);
+}
+
+RWTR_DEF void rwtr_v4_apply_n(Transform *tr, Vec4 *in, Vec4 *out, int count) {
+#if defined(RW_USE_INTRINSICS)
+  // NOTE(ray): result = col0*x + col1*y + col2*z + col3*w
+  Mat4 cols = rwm_m4_transpose(tr->t);
+  for (int i = 0; i < count; i++) {
+    __m128 v = in[i].m;
+    __m128 result = _mm_mul_ps(cols.row[0], _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)));
+    result = _mm_add_ps(result, _mm_mul_ps(cols.row[1], _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1))));
+    result = _mm_add_ps(result, _mm_mul_ps(cols.row[2], _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2))));
+    result = _mm_add_ps(result, _mm_mul_ps(cols.row[3], _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3))));
+    out[i].m = result;
+  }
+#else
+  for (int i = 0; i < count; i++) {
+    out[i] = rwtr_v4_apply(tr, in[i]);
+  }
+#endif
+}
+
+static void rwtr__m4_apply_r3_n(Mat4 *m, Rect3 *in, Rect3 *out, int count) {
+#if defined(RW_USE_INTRINSICS)
+  // NOTE(ray): Same as rwtr__m4_apply_r3 but a whole column of the matrix at a time
+  Mat4 cols = rwm_m4_transpose(*m);
+  for (int i = 0; i < count; i++) {
+    Rect3 r = in[i];
+    __m128 a = _mm_mul_ps(cols.row[0], _mm_set1_ps(r.min_px));
+    __m128 b = _mm_mul_ps(cols.row[0], _mm_set1_ps(r.max_px));
+    __m128 min_p = _mm_add_ps(cols.row[3], _mm_min_ps(a, b));
+    __m128 max_p = _mm_add_ps(cols.row[3], _mm_max_ps(a, b));
+    a = _mm_mul_ps(cols.row[1], _mm_set1_ps(r.min_py));
+    b = _mm_mul_ps(cols.row[1], _mm_set1_ps(r.max_py));
+    min_p = _mm_add_ps(min_p, _mm_min_ps(a, b));
+    max_p = _mm_add_ps(max_p, _mm_max_ps(a, b));
+    a = _mm_mul_ps(cols.row[2], _mm_set1_ps(r.min_pz));
+    b = _mm_mul_ps(cols.row[2], _mm_set1_ps(r.max_pz));
+    min_p = _mm_add_ps(min_p, _mm_min_ps(a, b));
+    max_p = _mm_add_ps(max_p, _mm_max_ps(a, b));
+
+    float mins[4], maxs[4];
+    _mm_storeu_ps(mins, min_p);
+    _mm_storeu_ps(maxs, max_p);
+    out[i].min_p = rwm_v3_init(mins[0], mins[1], mins[2]);
+    out[i].max_p = rwm_v3_init(maxs[0], maxs[1], maxs[2]);
+  }
+#else
+  for (int i = 0; i < count; i++) {
+    out[i] = rwtr__m4_apply_r3(m, in[i]);
+  }
+#endif
+}
+
+RWTR_DEF void rwtr_r3_apply_n(Transform *tr, Rect3 *in, Rect3 *out, int count) {
+  rwtr__m4_apply_r3_n(&tr->t, in, out, count);
+}
+
+RWTR_DEF void rwtr_r3_apply_inv_n(Transform *tr, Rect3 *in, Rect3 *out, int count) {
+  rwtr__m4_apply_r3_n(&tr->t_inv, in, out, count);
+}
+
+RWTR_DEF void rwtr_v3_apply_strided(Transform *tr, void *in, size_t in_stride, void *out, size_t out_stride, int count) {
+  rwtr__m4_apply_v3_n(&tr->t, 0.0f, (uint8_t *) in, in_stride, (uint8_t *) out, out_stride, count);
+}
+
+RWTR_DEF void rwtr_pt3_apply_strided(Transform *tr, void *in, size_t in_stride, void *out, size_t out_stride, int count) {
+  rwtr__m4_apply_v3_n(&tr->t, 1.0f, (uint8_t *) in, in_stride, (uint8_t *) out, out_stride, count);
+}
+
+RWTR_DEF void rwtr_n3_apply_strided(Transform *tr, void *in, size_t in_stride, void *out, size_t out_stride, int count) {
+  Mat4 inv_transpose = rwm_m4_transpose(tr->t_inv);
+  rwtr__m4_apply_v3_n(&inv_transpose, 0.0f, (uint8_t *) in, in_stride, (uint8_t *) out, out_stride, count);
 }
 
 #endif // #ifdef RWTR_IMPLEMENTATION
@@ -1,6 +1,6 @@
 /*
   FILE: rw_type.h
-  VERSION: 0.1.0
+  VERSION: 0.2.0
   DESCRIPTION: Define or redefines common types.
   AUTHOR: Raymond Wan
   USAGE: Just include this file
@@ -90,6 +90,14 @@ typedef union Vec4 {
 #endif
 } Vec4;
 
+// NOTE(ray): Structure of arrays view over a stream of Vec3s.
+// Each pointer refers to count floats owned by the caller.
+typedef struct Vec3Batch {
+  float *x;
+  float *y;
+  float *z;
+} Vec3Batch;
+
 typedef Vec2 Point2;
 typedef Vec3 Point3;
 typedef Vec4 Point4;
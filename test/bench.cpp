@@ -0,0 +1,335 @@
+// Microbenchmarks of the rw_math.h, rw_transform.h and rw_memory.h hot paths.
+// e.g. make bench, or ./rw_bench --filter m4/ --json results.json
+#include <stdio.h>
+#include <stdlib.h>
+#include "../rw_types.h"
+#define RWM_IMPLEMENTATION
+#include "../rw_math.h"
+#define RWTR_IMPLEMENTATION
+#include "../rw_transform.h"
+#define RWMEM_IMPLEMENTATION
+#include "../rw_memory.h"
+#define RWTM_IMPLEMENTATION
+#define RWTM_USE_TSC
+#include "../rw_time.h"
+#define RWBN_IMPLEMENTATION
+#include "../rw_bench.h"
+
+// Inputs are cycled through so the compiler can't hoist the work out of the loop
+#define BENCH_N 256
+#define BENCH_MASK (BENCH_N - 1)
+#define BENCH_ARENA_ALLOCS 1024
+
+struct BenchData {
+  Vec3 v3[BENCH_N];
+  Vec4 v4[BENCH_N];
+  Mat4 m4[BENCH_N];
+  Quaternion q[BENCH_N];
+  Transform tr[BENCH_N];
+  Point3 pt3_out[BENCH_N];
+  MemoryArena arena;
+  MemoryPool pool;
+  MemoryHeap heap;
+  void *heap_memory;
+  void *ptrs[BENCH_ARENA_ALLOCS];
+};
+
+static BenchData bench_data;
+
+static float bench_rand() {
+  return (float) rand() / RAND_MAX * 2.0f - 1.0f;
+}
+
+static void bench_init(BenchData *d) {
+  srand(1);
+  for (int i = 0; i < BENCH_N; i++) {
+    d->v3[i] = rwm_v3_init(bench_rand(), bench_rand(), bench_rand());
+    d->v4[i] = rwm_v4_init(bench_rand(), bench_rand(), bench_rand(), bench_rand());
+    Vec3 axis = rwm_v3_normalize(rwm_v3_init(bench_rand(), bench_rand(), bench_rand() + 2.0f));
+    d->q[i] = rwm_q_init_rotation(axis, bench_rand() * 3.0f);
+    d->tr[i] = rwtr_trs(d->v3[i], rwm_v3_init(1.0f, 2.0f, 3.0f), i % 3, bench_rand() * 180.0f);
+    d->m4[i] = d->tr[i].t;
+  }
+  d->arena = rwmem_arena_create(64 * BENCH_ARENA_ALLOCS);
+  d->pool = RWMEM_POOL_CREATE(Mat4, BENCH_ARENA_ALLOCS, NULL);
+  size_t heap_size = 256 * BENCH_ARENA_ALLOCS;
+  d->heap_memory = malloc(heap_size);
+  d->heap = rwmem_heap_create(d->heap_memory, heap_size);
+}
+
+// __VEC
+
+static void bench_v3_add(void *user_data, uint64_t iterations) {
+  BenchData *d = (BenchData *) user_data;
+  for (uint64_t i = 0; i < iterations; i++) {
+    Vec3 r = rwm_v3_add(d->v3[i & BENCH_MASK], d->v3[(i + 1) & BENCH_MASK]);
+    RWBN_DO_NOT_OPTIMIZE(r);
+  }
+}
+
+static void bench_v3_dot(void *user_data, uint64_t iterations) {
+  BenchData *d = (BenchData *) user_data;
+  for (uint64_t i = 0; i < iterations; i++) {
+    float r = rwm_v3_dot(d->v3[i & BENCH_MASK], d->v3[(i + 1) & BENCH_MASK]);
+    RWBN_DO_NOT_OPTIMIZE(r);
+  }
+}
+
+static void bench_v3_cross(void *user_data, uint64_t iterations) {
+  BenchData *d = (BenchData *) user_data;
+  for (uint64_t i = 0; i < iterations; i++) {
+    Vec3 r = rwm_v3_cross(d->v3[i & BENCH_MASK], d->v3[(i + 1) & BENCH_MASK]);
+    RWBN_DO_NOT_OPTIMIZE(r);
+  }
+}
+
+static void bench_v3_normalize(void *user_data, uint64_t iterations) {
+  BenchData *d = (BenchData *) user_data;
+  for (uint64_t i = 0; i < iterations; i++) {
+    Vec3 r = rwm_v3_normalize(d->v3[i & BENCH_MASK]);
+    RWBN_DO_NOT_OPTIMIZE(r);
+  }
+}
+
+static void bench_v4_add(void *user_data, uint64_t iterations) {
+  BenchData *d = (BenchData *) user_data;
+  for (uint64_t i = 0; i < iterations; i++) {
+    Vec4 r = rwm_v4_add(d->v4[i & BENCH_MASK], d->v4[(i + 1) & BENCH_MASK]);
+    RWBN_DO_NOT_OPTIMIZE(r);
+  }
+}
+
+static void bench_v4_dot(void *user_data, uint64_t iterations) {
+  BenchData *d = (BenchData *) user_data;
+  for (uint64_t i = 0; i < iterations; i++) {
+    float r = rwm_v4_dot(d->v4[i & BENCH_MASK], d->v4[(i + 1) & BENCH_MASK]);
+    RWBN_DO_NOT_OPTIMIZE(r);
+  }
+}
+
+static void bench_v4_normalize(void *user_data, uint64_t iterations) {
+  BenchData *d = (BenchData *) user_data;
+  for (uint64_t i = 0; i < iterations; i++) {
+    Vec4 r = rwm_v4_normalize(d->v4[i & BENCH_MASK]);
+    RWBN_DO_NOT_OPTIMIZE(r);
+  }
+}
+
+// __MAT4
+
+static void bench_m4_multiply(void *user_data, uint64_t iterations) {
+  BenchData *d = (BenchData *) user_data;
+  for (uint64_t i = 0; i < iterations; i++) {
+    Mat4 r = rwm_m4_multiply(d->m4[i & BENCH_MASK], d->m4[(i + 1) & BENCH_MASK]);
+    RWBN_DO_NOT_OPTIMIZE(r);
+  }
+}
+
+static void bench_m4_transpose(void *user_data, uint64_t iterations) {
+  BenchData *d = (BenchData *) user_data;
+  for (uint64_t i = 0; i < iterations; i++) {
+    Mat4 r = rwm_m4_transpose(d->m4[i & BENCH_MASK]);
+    RWBN_DO_NOT_OPTIMIZE(r);
+  }
+}
+
+static void bench_m4_inverse(void *user_data, uint64_t iterations) {
+  BenchData *d = (BenchData *) user_data;
+  for (uint64_t i = 0; i < iterations; i++) {
+    Mat4 r = rwm_m4_inverse(d->m4[i & BENCH_MASK]);
+    RWBN_DO_NOT_OPTIMIZE(r);
+  }
+}
+
+static void bench_m4_inverse_affine(void *user_data, uint64_t iterations) {
+  BenchData *d = (BenchData *) user_data;
+  for (uint64_t i = 0; i < iterations; i++) {
+    Mat4 r = rwm_m4_inverse_affine(d->m4[i & BENCH_MASK]);
+    RWBN_DO_NOT_OPTIMIZE(r);
+  }
+}
+
+// __QUATERNION
+
+static void bench_q_mult(void *user_data, uint64_t iterations) {
+  BenchData *d = (BenchData *) user_data;
+  for (uint64_t i = 0; i < iterations; i++) {
+    Quaternion r = rwm_q_mult(d->q[i & BENCH_MASK], d->q[(i + 1) & BENCH_MASK]);
+    RWBN_DO_NOT_OPTIMIZE(r);
+  }
+}
+
+static void bench_q_normalize(void *user_data, uint64_t iterations) {
+  BenchData *d = (BenchData *) user_data;
+  for (uint64_t i = 0; i < iterations; i++) {
+    Quaternion r = rwm_q_normalize(d->q[i & BENCH_MASK]);
+    RWBN_DO_NOT_OPTIMIZE(r);
+  }
+}
+
+static void bench_q_rotate_v3(void *user_data, uint64_t iterations) {
+  BenchData *d = (BenchData *) user_data;
+  for (uint64_t i = 0; i < iterations; i++) {
+    Vec3 r = rwm_q_v3_apply_rotation(d->q[i & BENCH_MASK], d->v3[i & BENCH_MASK]);
+    RWBN_DO_NOT_OPTIMIZE(r);
+  }
+}
+
+static void bench_q_slerp(void *user_data, uint64_t iterations) {
+  BenchData *d = (BenchData *) user_data;
+  for (uint64_t i = 0; i < iterations; i++) {
+    Quaternion r = rwm_slerp(d->q[i & BENCH_MASK], d->q[(i + 1) & BENCH_MASK], 0.3f);
+    RWBN_DO_NOT_OPTIMIZE(r);
+  }
+}
+
+static void bench_q_to_m4(void *user_data, uint64_t iterations) {
+  BenchData *d = (BenchData *) user_data;
+  for (uint64_t i = 0; i < iterations; i++) {
+    Mat4 r = rwm_q_rotation_to_m4(d->q[i & BENCH_MASK]);
+    RWBN_DO_NOT_OPTIMIZE(r);
+  }
+}
+
+// __TRANSFORM
+
+static void bench_tr_pt3_apply(void *user_data, uint64_t iterations) {
+  BenchData *d = (BenchData *) user_data;
+  for (uint64_t i = 0; i < iterations; i++) {
+    Point3 r = rwtr_pt3_apply(&d->tr[i & BENCH_MASK], d->v3[(i + 1) & BENCH_MASK]);
+    RWBN_DO_NOT_OPTIMIZE(r);
+  }
+}
+
+static void bench_tr_compose(void *user_data, uint64_t iterations) {
+  BenchData *d = (BenchData *) user_data;
+  for (uint64_t i = 0; i < iterations; i++) {
+    Transform r = rwtr_compose(&d->tr[i & BENCH_MASK], &d->tr[(i + 1) & BENCH_MASK]);
+    RWBN_DO_NOT_OPTIMIZE(r);
+  }
+}
+
+static void bench_tr_invert(void *user_data, uint64_t iterations) {
+  BenchData *d = (BenchData *) user_data;
+  for (uint64_t i = 0; i < iterations; i++) {
+    Transform r = rwtr_invert(&d->tr[i & BENCH_MASK]);
+    RWBN_DO_NOT_OPTIMIZE(r);
+  }
+}
+
+// One iteration transforms BENCH_N points
+static void bench_tr_pt3_apply_n(void *user_data, uint64_t iterations) {
+  BenchData *d = (BenchData *) user_data;
+  for (uint64_t i = 0; i < iterations; i++) {
+    rwtr_pt3_apply_n(&d->tr[i & BENCH_MASK], d->v3, d->pt3_out, BENCH_N);
+    RWBN_CLOBBER_MEMORY();
+  }
+}
+
+// __ARENA
+// NOTE(ray): One iteration is one allocation. The arena is reset every BENCH_ARENA_ALLOCS
+// allocations so the cost of that is included, pools and heaps keep the last 64 allocations alive.
+
+static void bench_arena_alloc(void *user_data, uint64_t iterations) {
+  BenchData *d = (BenchData *) user_data;
+  for (uint64_t i = 0; i < iterations; i++) {
+    if ((i % BENCH_ARENA_ALLOCS) == 0) rwmem_arena_reset(&d->arena);
+    void *p = rwmem_arena_alloc(&d->arena, 48);
+    RWBN_DO_NOT_OPTIMIZE(p);
+  }
+}
+
+static void bench_arena_alloc_aligned(void *user_data, uint64_t iterations) {
+  BenchData *d = (BenchData *) user_data;
+  for (uint64_t i = 0; i < iterations; i++) {
+    if ((i % BENCH_ARENA_ALLOCS) == 0) rwmem_arena_reset(&d->arena);
+    void *p = rwmem_arena_alloc_aligned(&d->arena, 40, 32);
+    RWBN_DO_NOT_OPTIMIZE(p);
+  }
+}
+
+static void bench_arena_mark_rewind(void *user_data, uint64_t iterations) {
+  BenchData *d = (BenchData *) user_data;
+  rwmem_arena_reset(&d->arena);
+  for (uint64_t i = 0; i < iterations; i++) {
+    MemoryArenaMark mark = rwmem_arena_mark(&d->arena);
+    void *p = rwmem_arena_alloc(&d->arena, 256);
+    RWBN_DO_NOT_OPTIMIZE(p);
+    rwmem_arena_rewind(&d->arena, mark);
+  }
+}
+
+static void bench_pool_alloc_release(void *user_data, uint64_t iterations) {
+  BenchData *d = (BenchData *) user_data;
+  for (uint64_t i = 0; i < iterations; i++) {
+    int slot = (int) (i & 63);
+    if (i >= 64) rwmem_pool_release(&d->pool, d->ptrs[slot]);
+    d->ptrs[slot] = RWMEM_POOL_ALLOC(&d->pool, Mat4);
+  }
+  uint64_t live = iterations < 64 ? iterations : 64;
+  for (uint64_t j = 0; j < live; j++) rwmem_pool_release(&d->pool, d->ptrs[j]);
+  RWBN_CLOBBER_MEMORY();
+}
+
+static void bench_heap_alloc_free(void *user_data, uint64_t iterations) {
+  BenchData *d = (BenchData *) user_data;
+  for (uint64_t i = 0; i < iterations; i++) {
+    // Sizes from 16 to 136 bytes
+    int slot = (int) (i & 63);
+    if (i >= 64) rwmem_heap_free(&d->heap, d->ptrs[slot]);
+    d->ptrs[slot] = rwmem_heap_alloc(&d->heap, 16 + (i & 15) * 8);
+  }
+  uint64_t live = iterations < 64 ? iterations : 64;
+  for (uint64_t j = 0; j < live; j++) rwmem_heap_free(&d->heap, d->ptrs[j]);
+  RWBN_CLOBBER_MEMORY();
+}
+
+static void bench_malloc_free(void *user_data, uint64_t iterations) {
+  BenchData *d = (BenchData *) user_data;
+  for (uint64_t i = 0; i < iterations; i++) {
+    int slot = (int) (i & 63);
+    if (i >= 64) free(d->ptrs[slot]);
+    d->ptrs[slot] = malloc(16 + (i & 15) * 8);
+  }
+  uint64_t live = iterations < 64 ? iterations : 64;
+  for (uint64_t j = 0; j < live; j++) free(d->ptrs[j]);
+  RWBN_CLOBBER_MEMORY();
+}
+
+int main(int argc, char **argv) {
+  BenchData *d = &bench_data;
+  bench_init(d);
+
+  rwbn_add("v3/add", bench_v3_add, d);
+  rwbn_add("v3/dot", bench_v3_dot, d);
+  rwbn_add("v3/cross", bench_v3_cross, d);
+  rwbn_add("v3/normalize", bench_v3_normalize, d);
+  rwbn_add("v4/add", bench_v4_add, d);
+  rwbn_add("v4/dot", bench_v4_dot, d);
+  rwbn_add("v4/normalize", bench_v4_normalize, d);
+  rwbn_add("m4/multiply", bench_m4_multiply, d);
+  rwbn_add("m4/transpose", bench_m4_transpose, d);
+  rwbn_add("m4/inverse", bench_m4_inverse, d);
+  rwbn_add("m4/inverse_affine", bench_m4_inverse_affine, d);
+  rwbn_add("q/mult", bench_q_mult, d);
+  rwbn_add("q/normalize", bench_q_normalize, d);
+  rwbn_add("q/rotate_v3", bench_q_rotate_v3, d);
+  rwbn_add("q/slerp", bench_q_slerp, d);
+  rwbn_add("q/to_m4", bench_q_to_m4, d);
+  rwbn_add("tr/pt3_apply", bench_tr_pt3_apply, d);
+  rwbn_add("tr/compose", bench_tr_compose, d);
+  rwbn_add("tr/invert", bench_tr_invert, d);
+  rwbn_add("tr/pt3_apply_n/256", bench_tr_pt3_apply_n, d);
+  rwbn_add("arena/alloc", bench_arena_alloc, d);
+  rwbn_add("arena/alloc_aligned", bench_arena_alloc_aligned, d);
+  rwbn_add("arena/mark_rewind", bench_arena_mark_rewind, d);
+  rwbn_add("pool/alloc_release", bench_pool_alloc_release, d);
+  rwbn_add("heap/alloc_free", bench_heap_alloc_free, d);
+  rwbn_add("heap/malloc_free", bench_malloc_free, d);
+  int result = rwbn_main(argc, argv);
+
+  rwmem_arena_free(&d->arena);
+  rwmem_pool_free(&d->pool);
+  free(d->heap_memory);
+  return result;
+}
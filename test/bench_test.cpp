@@ -0,0 +1,164 @@
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#define RWBN_IMPLEMENTATION
+#include "../rw_bench.h"
+
+static void bench_test_work(void *user_data, uint64_t iterations) {
+  uint64_t *calls = (uint64_t *) user_data;
+  for (uint64_t i = 0; i < iterations; i++) {
+    uint64_t x = i * i;
+    RWBN_DO_NOT_OPTIMIZE(x);
+  }
+  (*calls)++;
+}
+
+void run_rwbn_test() {
+	printf("run_rwbn_test");
+
+  // Statistics
+  rwbn_result r = {};
+  r.name = "stats";
+  r.num_samples = 7;
+  double samples[] = {5.0, 1.0, 3.0, 2.0, 100.0, 4.0, 3.0};
+  memcpy(r.samples, samples, sizeof(samples));
+  rwbn_compute_stats(&r);
+  assert(r.median == 3.0 && r.min == 1.0 && r.max == 100.0);
+  assert(fabs(r.mean - 118.0 / 7.0) < 1e-9);
+  // |x - 3| = 2 2 0 1 97 1 0 -> 0 0 1 1 2 2 97
+  assert(r.mad == 1.0);
+  // sorted 1 2 3 3 4 5 100, rank 0.9 * 6 = 5.4
+  assert(fabs(r.p90 - (5.0 + 0.4 * 95.0)) < 1e-9);
+  assert(fabs(r.p10 - 1.6) < 1e-9);
+  double even[] = {1.0, 2.0, 3.0, 4.0};
+  assert(rwbn_percentile(even, 4, 0.5) == 2.5 && rwbn_percentile(even, 4, 1.0) == 4.0);
+  assert(rwbn_percentile(even, 1, 0.99) == 1.0);
+
+  // Auto-scaled iterations
+  uint64_t calls = 0;
+  rwbn_config config = rwbn_default_config();
+  config.warmup_ns = 1000000;
+  config.min_sample_ns = 200000;
+  config.num_samples = 5;
+  rwbn_result run;
+  rwbn_run("work", bench_test_work, &calls, &config, &run);
+  assert(strcmp(run.name, "work") == 0 && run.num_samples == 5 && run.iterations > 1);
+  assert(calls > 5);
+  assert(run.min > 0.0 && run.min <= run.median && run.median <= run.max);
+  // Samples were scaled to about min_sample_ns, loose since later samples can run faster
+  assert(run.median * run.iterations >= 0.25 * config.min_sample_ns);
+  config.num_samples = RWBN_MAX_SAMPLES + 10;
+  config.warmup_ns = 0;
+  rwbn_run("clamped", bench_test_work, &calls, &config, &run);
+  assert(run.num_samples == RWBN_MAX_SAMPLES);
+  for (int c = 0; c < RWBN_NUM_COUNTERS; c++) assert(run.counters[c] < 0.0);
+  assert(run.ipc < 0.0);
+
+  // Hardware counters, whatever is available on this machine
+  config.num_samples = 5;
+  config.counters = true;
+  bool any_counter = rwbn_counters_open();
+  rwbn_run("counters", bench_test_work, &calls, &config, &run);
+  assert(run.num_samples == 5 && run.median > 0.0);
+  for (int c = 0; c < RWBN_NUM_COUNTERS; c++) {
+    if (!rwbn_counter_available((rwbn_counter) c)) assert(run.counters[c] < 0.0);
+  }
+  if (any_counter && rwbn_counter_available(RWBN_COUNTER_INSTRUCTIONS)) {
+    // At least the multiply and the loop
+    assert(run.counters[RWBN_COUNTER_INSTRUCTIONS] >= 2.0);
+  }
+  assert(strcmp(rwbn_counter_name(RWBN_COUNTER_L1D_MISSES), "l1d_misses") == 0);
+  assert(strcmp(rwbn_counter_name(RWBN_NUM_COUNTERS), "unknown") == 0);
+
+  // Output
+  for (int c = 0; c < RWBN_NUM_COUNTERS; c++) r.counters[c] = -1.0;
+  r.ipc = -1.0;
+  rwbn_result results[2] = {r, r};
+  results[1].name = "with \"quotes\", comma";
+  results[1].counters[RWBN_COUNTER_CYCLES] = 10.0;
+  results[1].counters[RWBN_COUNTER_INSTRUCTIONS] = 25.0;
+  results[1].ipc = 2.5;
+  static char text[8192];
+  FILE *f = tmpfile();
+  assert(f);
+  rwbn_write_json(f, results, 2);
+  rewind(f);
+  size_t len = fread(text, 1, sizeof(text) - 1, f);
+  text[len] = '\0';
+  fclose(f);
+  const char *json_start = "{\"benchmarks\":[\n{\"name\":\"stats\",\"iterations\":0,\"median_ns\":3.0000,";
+  assert(strncmp(text, json_start, strlen(json_start)) == 0);
+  assert(strstr(text, "\"samples_ns\":[5.0000,1.0000,3.0000,2.0000,100.0000,4.0000,3.0000]},"));
+  assert(strstr(text, "3.0000],\"counters\":{\"cycles\":10.0000,\"instructions\":25.0000,\"ipc\":2.5000}}"));
+  assert(strstr(text, "\"name\":\"with \\\"quotes\\\", comma\""));
+  assert(strcmp(text + len - 4, "\n]}\n") == 0);
+
+  f = tmpfile();
+  assert(f);
+  rwbn_write_csv(f, results, 2);
+  rewind(f);
+  len = fread(text, 1, sizeof(text) - 1, f);
+  text[len] = '\0';
+  fclose(f);
+  const char *csv_header = "name,iterations,samples,median_ns,mad_ns,";
+  assert(strncmp(text, csv_header, strlen(csv_header)) == 0);
+  assert(strstr(text, "\n\"stats\",0,7,3.0000,1.0000,"));
+  assert(strstr(text, "\n\"with \"\"quotes\"\", comma\",0,7,"));
+  assert(strstr(text, ",max_ns,cycles,instructions,l1d_misses,llc_misses,branch_misses,dtlb_misses,ipc\n"));
+  assert(strstr(text, ",100.0000,,,,,,,\n"));
+  assert(strstr(text, ",100.0000,10.0000,25.0000,,,,,2.5000\n"));
+
+  // Baselines
+  f = tmpfile();
+  assert(f);
+  rwbn_write_json(f, results, 2);
+  rewind(f);
+  rwbn_result read[3];
+  assert(rwbn_read_json(f, read, 3) == 2);
+  fclose(f);
+  assert(strcmp(read[0].name, "stats") == 0 && strcmp(read[1].name, "with \"quotes\", comma") == 0);
+  assert(read[1].num_samples == 7 && read[1].samples[4] == 100.0 && read[1].median == 3.0 && read[1].mad == 1.0);
+  assert(read[1].counters[RWBN_COUNTER_CYCLES] < 0.0 && read[1].ipc < 0.0);
+  free((void *) read[0].name);
+  free((void *) read[1].name);
+  f = tmpfile();
+  assert(f);
+  fputs("name,iterations\n", f);
+  rewind(f);
+  assert(rwbn_read_json(f, read, 3) == -1);
+  fclose(f);
+
+  // Mann-Whitney. No overlap: U = 0, mean 12.5, variance 25 * 11 / 12.
+  // Ties: U = 3, mean 8, variance 16 / 12 * (9 - 48 / 56)
+  double a[] = {1.1, 2.2, 3.3, 4.4, 5.5};
+  double b[] = {6.6, 7.7, 8.8, 9.9, 10.1};
+  assert(fabs(rwbn_mann_whitney(a, 5, b, 5) - 0.012186) < 1e-5);
+  assert(fabs(rwbn_mann_whitney(b, 5, a, 5) - 0.012186) < 1e-5);
+  double ties[] = {1.0, 2.0, 2.0, 3.0};
+  double ties_b[] = {2.0, 3.0, 3.0, 4.0};
+  assert(fabs(rwbn_mann_whitney(ties, 4, ties_b, 4) - 0.172034) < 1e-5);
+  assert(rwbn_mann_whitney(a, 5, a, 5) == 1.0);
+  double same[] = {2.0, 2.0, 2.0};
+  assert(rwbn_mann_whitney(same, 3, same, 3) == 1.0);
+
+  rwbn_result base = {}, slow = {};
+  base.num_samples = slow.num_samples = 20;
+  for (int i = 0; i < 20; i++) {
+    base.samples[i] = 10.0 + 0.01 * i;
+    slow.samples[i] = 11.0 + 0.01 * i;
+  }
+  rwbn_compute_stats(&base);
+  rwbn_compute_stats(&slow);
+  rwbn_comparison c = rwbn_compare(&base, &slow, 0.05);
+  assert(c.verdict == RWBN_SLOWER && c.p_value < 1e-6 && fabs(c.delta - 0.1 / 1.0095) < 1e-3);
+  assert(rwbn_compare(&slow, &base, 0.05).verdict == RWBN_FASTER);
+  // Significant, but under the threshold
+  assert(rwbn_compare(&base, &slow, 0.2).verdict == RWBN_SAME);
+  // Over the threshold, but not significant
+  base.num_samples = slow.num_samples = 2;
+  assert(rwbn_compare(&base, &slow, 0.05).verdict == RWBN_SAME);
+
+  puts(" - PASSED");
+}
@@ -0,0 +1,245 @@
+#include <assert.h>
+#include <stdio.h>
+#include <float.h>
+#include <string.h>
+#define RWBVH_PARALLEL
+#define RWBVH_IMPLEMENTATION
+#include "../rw_bvh.h"
+
+#define BVH_TEST_NUM_SPHERES 500
+#define BVH_TEST_NUM_RAYS 500
+// Enough to take the parallel binning path at the top of the tree
+#define BVH_TEST_NUM_BOXES 40000
+// Pairs of boxes spread out exponentially along the 6 axis directions build a very deep tree
+#define BVH_TEST_NUM_DEEP 2400
+
+struct BVHTestSphere {
+	Point3 c;
+	float r;
+};
+
+static uint32_t bvh_test_rng_state = 1234567;
+
+static float bvh_test_rand01() {
+	bvh_test_rng_state = bvh_test_rng_state * 1664525u + 1013904223u;
+	return (bvh_test_rng_state >> 8) / 16777216.0f;
+}
+
+static bool bvh_test_equal(BVH *a, BVH *b) {
+	return a->num_nodes == b->num_nodes && a->num_nodes4 == b->num_nodes4 && a->num_prims == b->num_prims &&
+		memcmp(a->nodes, b->nodes, a->num_nodes * sizeof(BVHLinearNode)) == 0 &&
+		memcmp(a->nodes4, b->nodes4, a->num_nodes4 * sizeof(BVH4Node)) == 0 &&
+		memcmp(a->prim_indices, b->prim_indices, a->num_prims * sizeof(int)) == 0;
+}
+
+struct BVHTestBuild {
+	Rect3 *boxes;
+	BVH bvh;
+};
+
+static void *bvh_test_build_entry(void *arg) {
+	BVHTestBuild *build = (BVHTestBuild *) arg;
+	build->bvh = rwbvh_build_parallel(build->boxes, BVH_TEST_NUM_BOXES, 4, 0);
+	return NULL;
+}
+
+static float bvh_test_intersect_sphere(void *user_data, int prim_index, Point3 o, Vec3 d, float t_max) {
+	BVHTestSphere *s = ((BVHTestSphere *) user_data) + prim_index;
+	Vec3 oc = rwm_v3_subtract(o, s->c);
+	float a = rwm_v3_dot(d, d);
+	float b = rwm_v3_dot(oc, d);
+	float c = rwm_v3_dot(oc, oc) - SQUARE(s->r);
+	float disc = b*b - a*c;
+	if (disc < 0.0f) return FLT_MAX;
+	float sq = rwm_sqrt(disc);
+	float t = (-b - sq) / a;
+	if (t < 0.0f) t = (-b + sq) / a;
+	if (t < 0.0f || t >= t_max) return FLT_MAX;
+	return t;
+}
+
+static float bvh_test_intersect_box(void *user_data, int prim_index, Point3 o, Vec3 d, float t_max) {
+	Rect3 *b = ((Rect3 *) user_data) + prim_index;
+	float t0 = 0.0f, t1 = t_max;
+	for (int axis = 0; axis < 3; axis++) {
+		float inv_d = 1.0f / d.e[axis];
+		float t_near = (b->min_p.e[axis] - o.e[axis]) * inv_d;
+		float t_far = (b->max_p.e[axis] - o.e[axis]) * inv_d;
+		if (t_near > t_far) { float tmp = t_near; t_near = t_far; t_far = tmp; }
+		if (t_near > t0) t0 = t_near;
+		if (t_far < t1) t1 = t_far;
+		if (t0 > t1) return FLT_MAX;
+	}
+	return t0 < t_max ? t0 : FLT_MAX;
+}
+
+struct BVHTestDeep {
+	Rect3 *boxes;
+	int count;
+};
+
+static float bvh_test_count_box(void *user_data, int prim_index, Point3 o, Vec3 d, float t_max) {
+	BVHTestDeep *deep = (BVHTestDeep *) user_data;
+	if (bvh_test_intersect_box(deep->boxes, prim_index, o, d, t_max) < t_max) deep->count++;
+	return FLT_MAX;
+}
+
+void run_rwbvh_test() {
+	printf("run_rwbvh_test");
+
+	BVHTestSphere spheres[BVH_TEST_NUM_SPHERES];
+	Rect3 bounds[BVH_TEST_NUM_SPHERES];
+	for (int i = 0; i < BVH_TEST_NUM_SPHERES; i++) {
+		spheres[i].c = rwm_v3_init(20.0f * bvh_test_rand01() - 10.0f, 20.0f * bvh_test_rand01() - 10.0f, 20.0f * bvh_test_rand01() - 10.0f);
+		spheres[i].r = 0.05f + 0.3f * bvh_test_rand01();
+		Vec3 r = rwm_v3_init(spheres[i].r, spheres[i].r, spheres[i].r);
+		bounds[i] = rwm_r3_init_v3(rwm_v3_subtract(spheres[i].c, r), rwm_v3_add(spheres[i].c, r));
+	}
+
+	BVH bvh = rwbvh_build(bounds, BVH_TEST_NUM_SPHERES, 4);
+	assert(bvh.num_nodes > 1 && bvh.num_nodes <= 2 * BVH_TEST_NUM_SPHERES - 1);
+	assert(bvh.num_nodes4 > 0 && bvh.num_nodes4 < bvh.num_nodes);
+
+	// Every primitive must appear exactly once in the leaves
+	int seen[BVH_TEST_NUM_SPHERES] = { 0 };
+	for (int i = 0; i < bvh.num_prims; i++) {
+		seen[bvh.prim_indices[i]]++;
+	}
+	for (int i = 0; i < BVH_TEST_NUM_SPHERES; i++) {
+		assert(seen[i] == 1);
+	}
+
+	// Compare against brute force
+	int num_hits = 0;
+	for (int i = 0; i < BVH_TEST_NUM_RAYS; i++) {
+		Point3 o = rwm_v3_init(30.0f * bvh_test_rand01() - 15.0f, 30.0f * bvh_test_rand01() - 15.0f, 30.0f * bvh_test_rand01() - 15.0f);
+		Vec3 d = rwm_v3_init(2.0f * bvh_test_rand01() - 1.0f, 2.0f * bvh_test_rand01() - 1.0f, 2.0f * bvh_test_rand01() - 1.0f);
+		if (i % 10 == 0) d.y = 0.0f; // axis aligned rays
+
+		float expected_t = FLT_MAX;
+		int expected_prim = -1;
+		for (int p = 0; p < BVH_TEST_NUM_SPHERES; p++) {
+			float t = bvh_test_intersect_sphere(spheres, p, o, d, expected_t);
+			if (t < expected_t) {
+				expected_t = t;
+				expected_prim = p;
+			}
+		}
+
+		BVHHit hit;
+		bool did_hit = rwbvh_intersect(&bvh, o, d, FLT_MAX, bvh_test_intersect_sphere, spheres, &hit);
+		assert(did_hit == (expected_prim != -1));
+		assert(hit.prim_index == expected_prim);
+		assert(rwbvh_occluded(&bvh, o, d, FLT_MAX, bvh_test_intersect_sphere, spheres) == did_hit);
+		if (did_hit) {
+			assert(hit.t == expected_t);
+			assert(!rwbvh_occluded(&bvh, o, d, expected_t, bvh_test_intersect_sphere, spheres));
+			num_hits++;
+		}
+	}
+	assert(num_hits > 0);
+
+	// Single primitive
+	BVH single = rwbvh_build(bounds, 1, 4);
+	BVHHit hit;
+	Vec3 to_sphere = rwm_v3_subtract(spheres[0].c, rwm_v3_zero());
+	assert(rwbvh_intersect(&single, rwm_v3_zero(), to_sphere, FLT_MAX, bvh_test_intersect_sphere, spheres, &hit));
+	assert(hit.prim_index == 0);
+	rwbvh_free(&single);
+
+	// Parallel builds must match the serial build exactly
+	for (int num_threads = 2; num_threads <= 5; num_threads += 3) {
+		BVH parallel = rwbvh_build_parallel(bounds, BVH_TEST_NUM_SPHERES, 4, num_threads);
+		assert(bvh_test_equal(&bvh, &parallel));
+		rwbvh_free(&parallel);
+	}
+
+	// Boxes with lots of shared centroids and signed zeros
+	Rect3 *boxes = (Rect3 *) malloc(BVH_TEST_NUM_BOXES * sizeof(Rect3));
+	for (int i = 0; i < BVH_TEST_NUM_BOXES; i++) {
+		Point3 p = rwm_v3_init(100.0f * bvh_test_rand01(), 100.0f * bvh_test_rand01(), 10.0f * bvh_test_rand01());
+		Vec3 size = rwm_v3_init(bvh_test_rand01(), bvh_test_rand01(), 0.0f);
+		if (i % 7 == 0) {
+			p = rwm_v3_init(0.0f, (i % 2) ? -0.0f : 0.0f, 5.0f);
+			size = rwm_v3_init(1.0f, 1.0f, 0.0f);
+		}
+		boxes[i] = rwm_r3_init_v3(p, rwm_v3_add(p, size));
+	}
+	BVH boxes_serial = rwbvh_build(boxes, BVH_TEST_NUM_BOXES, 4);
+	BVH boxes_parallel = rwbvh_build_parallel(boxes, BVH_TEST_NUM_BOXES, 4, 4);
+	assert(bvh_test_equal(&boxes_serial, &boxes_parallel));
+	rwbvh_free(&boxes_parallel);
+	boxes_parallel = rwbvh_build_parallel(boxes, BVH_TEST_NUM_BOXES, 4, 0);
+	assert(bvh_test_equal(&boxes_serial, &boxes_parallel));
+	rwbvh_free(&boxes_parallel);
+	// On the job system
+	rwth_jobs_init(3);
+	boxes_parallel = rwbvh_build_parallel(boxes, BVH_TEST_NUM_BOXES, 4, 0);
+	assert(bvh_test_equal(&boxes_serial, &boxes_parallel));
+	rwbvh_free(&boxes_parallel);
+	// From a thread outside of the job system, which starts its own threads instead
+	BVHTestBuild build = {boxes, {}};
+	rwth_thread build_thread;
+	assert(rwth_thread_create(&build_thread, bvh_test_build_entry, &build));
+	rwth_thread_join(&build_thread);
+	assert(bvh_test_equal(&boxes_serial, &build.bvh));
+	rwbvh_free(&build.bvh);
+	rwth_jobs_shutdown();
+	rwbvh_free(&boxes_serial);
+	free(boxes);
+
+	// Deep, skewed tree. Every box crosses the ray below and SAH keeps splitting off the far
+	// pairs, which are left on the traversal stack while the near side is opened, so
+	// traversal needs more stack than RWBVH_TRAVERSAL_STACK_SIZE.
+	Rect3 *deep = (Rect3 *) malloc(BVH_TEST_NUM_DEEP * sizeof(Rect3));
+	for (int i = 0; i < BVH_TEST_NUM_DEEP; i++) {
+		int pair = i / 2, arm = pair % 6, axis = arm / 2;
+		float c = powf(1.5f, (float) (pair / 6)) * ((arm % 2) ? -1.0f : 1.0f);
+		Vec3 lo = rwm_v3_init(-0.5f, -0.5f, -0.5f + (i % 2) * 0.6f);
+		Vec3 hi = rwm_v3_init(0.5f, 0.5f, 0.5f + (i % 2) * 0.6f);
+		if (axis == 0) {
+			lo.x += c;
+			hi.x += c;
+		} else if (c > 0.0f) {
+			hi.e[axis] += c;
+		} else {
+			lo.e[axis] += c;
+		}
+		deep[i] = rwm_r3_init_v3(lo, hi);
+	}
+	BVH deep_bvh = rwbvh_build(deep, BVH_TEST_NUM_DEEP, 1);
+	assert(3 * deep_bvh.depth4 + 1 > RWBVH_TRAVERSAL_STACK_SIZE);
+	// Nothing is ever hit so every node along the ray is visited, and each box the ray
+	// passes through is tested exactly once
+	BVHTestDeep counter = { deep, 0 };
+	Point3 deep_o = rwm_v3_init(-1e37f, 0.1f, 0.2f);
+	Vec3 deep_d = rwm_v3_init(1.0f, 0.0f, 0.0f);
+	int expected_count = 0;
+	for (int p = 0; p < BVH_TEST_NUM_DEEP; p++) {
+		if (bvh_test_intersect_box(deep, p, deep_o, deep_d, FLT_MAX) < FLT_MAX) expected_count++;
+	}
+	assert(expected_count == BVH_TEST_NUM_DEEP);
+	assert(!rwbvh_intersect(&deep_bvh, deep_o, deep_d, FLT_MAX, bvh_test_count_box, &counter, &hit));
+	assert(counter.count == expected_count);
+	// Closest hit, from near the middle where the distances are still exact
+	deep_o = rwm_v3_init(-0.75f, 0.1f, 0.2f);
+	float expected_t = FLT_MAX;
+	int expected_prim = -1;
+	for (int p = 0; p < BVH_TEST_NUM_DEEP; p++) {
+		float t = bvh_test_intersect_box(deep, p, deep_o, deep_d, expected_t);
+		if (t < expected_t) {
+			expected_t = t;
+			expected_prim = p;
+		}
+	}
+	assert(expected_prim != -1);
+	assert(rwbvh_intersect(&deep_bvh, deep_o, deep_d, FLT_MAX, bvh_test_intersect_box, deep, &hit));
+	// Many boxes start at the same distance, any of them is the closest
+	assert(hit.t == expected_t);
+	assert(rwbvh_occluded(&deep_bvh, deep_o, deep_d, FLT_MAX, bvh_test_intersect_box, deep));
+	rwbvh_free(&deep_bvh);
+	free(deep);
+
+	rwbvh_free(&bvh);
+	printf(" - PASSED\n");
+}
@@ -141,5 +141,46 @@ void run_rwm_m4_test() {
 		1.0f, 0.0f, -1.0f, 0.0f
 	);
 
+	// Singular matrices return the identity
+	Mat4 singular_inverse_m = rwm_m4_inverse(m2);
+	rwm_m4_assert_eq(&singular_inverse_m,
+		1.0f, 0.0f, 0.0f, 0.0f,
+		0.0f, 1.0f, 0.0f, 0.0f,
+		0.0f, 0.0f, 1.0f, 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f
+	);
+
+	// Affine inverse
+	Mat4 affine_m = rwm_m4_init_f(
+		2.0f, 1.0f, 0.0f, 3.0f,
+		0.0f, 1.0f, 4.0f, -1.0f,
+		1.0f, 0.0f, 1.0f, 2.0f,
+		0.0f, 0.0f, 0.0f, 1.0f
+	);
+	assert(rwm_m4_is_affine(affine_m));
+	assert(!rwm_m4_is_affine(m2));
+	Mat4 affine_inverse_m = rwm_m4_inverse_affine(affine_m);
+	Mat4 general_inverse_m = rwm_m4_inverse(affine_m);
+	for (int i = 0; i < 4; i++) {
+		for (int j = 0; j < 4; j++) {
+			assert(ABS(affine_inverse_m.e[i][j] - general_inverse_m.e[i][j]) < EPSILON);
+		}
+	}
+
+	// Rigid inverse (rotation of 90 degrees about z then a translation)
+	Mat4 rigid_m = rwm_m4_init_f(
+		0.0f, -1.0f, 0.0f, 1.0f,
+		1.0f, 0.0f, 0.0f, 2.0f,
+		0.0f, 0.0f, 1.0f, 3.0f,
+		0.0f, 0.0f, 0.0f, 1.0f
+	);
+	Mat4 rigid_inverse_m = rwm_m4_inverse_rigid(rigid_m);
+	rwm_m4_assert_eq(&rigid_inverse_m,
+		0.0f, 1.0f, 0.0f, -2.0f,
+		-1.0f, 0.0f, 0.0f, 1.0f,
+		0.0f, 0.0f, 1.0f, -3.0f,
+		0.0f, 0.0f, 0.0f, 1.0f
+	);
+
 	printf(" - PASSED\n");
 }
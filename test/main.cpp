@@ -17,14 +17,20 @@
 #include "m4_test.cpp"
 #include "q_test.cpp"
 #include "tr_test.cpp"
+
+#define RWTH_IMPLEMENTATION
+#include "../rw_th.h"
 #include "mem_test.cpp"
 
 #define RWTM_IMPLEMENTATION
 #include "../rw_time.h"
+#include "tm_test.cpp"
 
-#define RWTH_IMPLEMENTATION
-#include "../rw_th.h"
 #include "th_test.cpp"
+#include "prof_test.cpp"
+#include "bench_test.cpp"
+
+#include "bvh_test.cpp"
 
 using namespace std;
 
@@ -35,8 +41,12 @@ int main() {
   run_rwm_m4_test();
   run_rwm_q_test();
   run_rwtr_test();
+  run_rwtm_test();
   run_rwth_test();
   run_rwmem_test();
+  run_rwbvh_test();
+  run_rwpf_test();
+  run_rwbn_test();
 
   rwtm_init();
   double now = rwtm_now();
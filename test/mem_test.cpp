@@ -1,4 +1,7 @@
+#include <string.h>
 #define RWMEM_IMPLEMENTATION
+#define RWMEM_CONCURRENT
+#define RWMEM_TRACK_STATS
 #include "../rw_memory.h"
 
 struct BigTest {
@@ -31,6 +34,185 @@ SmallTest *create_small(MemoryArena *arena, float a, int b, char c) {
   printf("%f %d %c\n", result->a, result->b, result->c);
 }
 
+static void run_rwmem_stats_test() {
+  MemoryArena arena = rwmem_arena_create(1024);
+  rwmem_arena_alloc(&arena, 10);
+  rwmem_arena_alloc(&arena, 100);
+  MemoryArenaStats *stats = &arena.stats;
+  assert(stats->num_allocs == 2 && stats->bytes_requested == 110 && stats->largest_alloc == 100);
+  // The second allocation was padded to 16 bytes
+  assert(stats->padding_bytes == 6 && stats->bytes_in_use == 116);
+  assert(stats->num_blocks_allocated == 1 && stats->num_rollovers == 0);
+  assert(stats->bytes_reserved == stats->peak_bytes_reserved && stats->bytes_reserved > 1024);
+  MemoryArenaMark mark = rwmem_arena_mark(&arena);
+  rwmem_arena_alloc(&arena, 1000);
+  assert(stats->num_rollovers == 1 && stats->tail_bytes_wasted == 1024 - 116);
+  assert(stats->num_blocks_allocated == 2 && stats->peak_bytes_in_use == 1116);
+  rwmem_arena_rewind(&arena, mark);
+  assert(stats->bytes_in_use == 116 && stats->peak_bytes_in_use == 1116);
+  rwmem_arena_alloc(&arena, 5000);
+  rwmem_arena_reset(&arena);
+  assert(stats->bytes_in_use == 0 && stats->num_blocks_allocated == 3);
+  assert(stats->size_histogram[0] == 1 && stats->size_histogram[3] == 1);
+  assert(stats->size_histogram[6] == 1 && stats->size_histogram[9] == 1);
+  rwmem_arena_free(&arena);
+  assert(stats->bytes_reserved == 0 && stats->num_allocs == 4);
+}
+
+static void run_rwmem_heap_test() {
+  const size_t heap_size = 1 << 20;
+  uint8_t *memory = (uint8_t *) malloc(heap_size + 8);
+  // Unaligned on purpose
+  MemoryHeap heap = rwmem_heap_create(memory + 8, heap_size);
+  MemoryHeapStats stats = rwmem_heap_stats(&heap);
+  size_t initial_free = stats.free_bytes;
+  assert(stats.num_free_blocks == 1 && stats.num_used_blocks == 0);
+  assert(initial_free > heap_size - 64 && stats.fragmentation == 0.0f);
+
+  // Random allocations and frees, every live allocation keeps its own byte pattern
+  const int num_slots = 512;
+  uint8_t *ptrs[num_slots] = {};
+  size_t sizes[num_slots] = {};
+  uint32_t rng = 12345;
+  for (int iter = 0; iter < 20000; iter++) {
+    rng = rng * 1664525u + 1013904223u;
+    int slot = (rng >> 8) % num_slots;
+    if (ptrs[slot]) {
+      for (size_t b = 0; b < sizes[slot]; b++) assert(ptrs[slot][b] == (uint8_t) slot);
+      rwmem_heap_free(&heap, ptrs[slot]);
+      ptrs[slot] = NULL;
+    } else {
+      size_t size = (rng >> 20) % ((rng & 3) == 0 ? 8192 : 256) + 1;
+      ptrs[slot] = (uint8_t *) rwmem_heap_alloc(&heap, size);
+      if (ptrs[slot]) {
+        assert(IS_ALIGNED(ptrs[slot], 16) && rwmem_heap_alloc_size(ptrs[slot]) >= size);
+        memset(ptrs[slot], (uint8_t) slot, size);
+        sizes[slot] = size;
+      }
+    }
+  }
+  stats = rwmem_heap_stats(&heap);
+  assert(stats.used_bytes + stats.free_bytes + 16 * (stats.num_used_blocks + stats.num_free_blocks - 1) == initial_free);
+  assert(stats.fragmentation >= 0.0f && stats.fragmentation < 1.0f);
+  for (int i = 0; i < num_slots; i++) rwmem_heap_free(&heap, ptrs[i]);
+  // Everything merged back into one block
+  stats = rwmem_heap_stats(&heap);
+  assert(stats.num_free_blocks == 1 && stats.num_used_blocks == 0);
+  assert(stats.free_bytes == initial_free && stats.largest_free_block == initial_free);
+
+  // Too big, then exactly everything
+  assert(rwmem_heap_alloc(&heap, heap_size) == NULL);
+  // Would wrap around when rounded up
+  assert(rwmem_heap_alloc(&heap, SIZE_MAX - 7) == NULL && rwmem_heap_alloc(&heap, SIZE_MAX) == NULL);
+  void *all = rwmem_heap_alloc(&heap, initial_free);
+  assert(all != NULL && rwmem_heap_alloc(&heap, 1) == NULL);
+  rwmem_heap_free(&heap, all);
+  // Freed neighbours merge in either order
+  void *a = rwmem_heap_alloc(&heap, 100);
+  void *b = rwmem_heap_alloc(&heap, 100);
+  void *c = rwmem_heap_alloc(&heap, 100);
+  rwmem_heap_free(&heap, a);
+  rwmem_heap_free(&heap, c);
+  assert(rwmem_heap_stats(&heap).num_free_blocks == 2);
+  rwmem_heap_free(&heap, b);
+  assert(rwmem_heap_stats(&heap).num_free_blocks == 1);
+  free(memory);
+}
+
+#define CA_NUM_THREADS 4
+#define CA_ALLOCS_PER_THREAD 5000
+
+struct ConcurrentArenaTest {
+  ConcurrentArena *arena;
+  uint8_t tag;
+  uint8_t *ptrs[CA_ALLOCS_PER_THREAD];
+};
+
+static size_t ca_test_size(int i) { return 1 + (i * 37) % 300; }
+
+static void *ca_test_thread(void *arg) {
+  ConcurrentArenaTest *test = (ConcurrentArenaTest *) arg;
+  for (int i = 0; i < CA_ALLOCS_PER_THREAD; i++) {
+    size_t alignment = (size_t) 16 << (i % 3);
+    uint8_t *p = (uint8_t *) rwmem_concurrent_arena_alloc_aligned(test->arena, ca_test_size(i), alignment);
+    assert(IS_ALIGNED(p, alignment));
+    memset(p, test->tag, ca_test_size(i));
+    test->ptrs[i] = p;
+    if (i % 64 == 0) rwth_thread_yield();
+  }
+  return NULL;
+}
+
+static MemoryArenaRegistry registry_test;
+static MemoryArena *registry_seen[CA_NUM_THREADS + 1];
+
+static void registry_test_range(void *data, int start, int end) {
+  MemoryArena *arena = rwmem_arena_registry_get(&registry_test);
+  int index = rwth_jobs_worker_index();
+  assert(index >= 0 && index < CA_NUM_THREADS);
+  assert(registry_seen[index] == NULL || registry_seen[index] == arena);
+  registry_seen[index] = arena;
+  int *values = (int *) data;
+  for (int i = start; i < end; i++) {
+    int *p = RWMEM_PUSH_STRUCT(arena, int);
+    *p = i;
+    values[i] = *p;
+  }
+}
+
+static void run_rwmem_concurrent_test() {
+  // Every thread's allocations stay intact, so none of them overlapped
+  ConcurrentArena arena = rwmem_concurrent_arena_create(4096);
+  static ConcurrentArenaTest tests[CA_NUM_THREADS];
+  rwth_thread threads[CA_NUM_THREADS];
+  for (int t = 0; t < CA_NUM_THREADS; t++) {
+    tests[t].arena = &arena;
+    tests[t].tag = (uint8_t) (t + 1);
+    bool started = rwth_thread_create(&threads[t], ca_test_thread, &tests[t]);
+    assert(started);
+  }
+  for (int t = 0; t < CA_NUM_THREADS; t++) {
+    rwth_thread_join(&threads[t]);
+  }
+  for (int t = 0; t < CA_NUM_THREADS; t++) {
+    for (int i = 0; i < CA_ALLOCS_PER_THREAD; i++) {
+      for (size_t b = 0; b < ca_test_size(i); b++) {
+        assert(tests[t].ptrs[i][b] == tests[t].tag);
+      }
+    }
+  }
+  // Large allocations get their own block
+  uint8_t *large = (uint8_t *) rwmem_concurrent_arena_alloc(&arena, 10000);
+  memset(large, 0, 10000);
+  // After a reset the current block starts over and full blocks are reused
+  CA_BlockHeader *cur = arena.cur_block;
+  rwmem_concurrent_arena_reset(&arena);
+  assert(arena.used_blocks == NULL && arena.available_blocks != NULL);
+  assert(rwmem_concurrent_arena_alloc(&arena, 16) == (uint8_t *) cur + RWMEM__CA_HEADER_SIZE);
+  CA_BlockHeader *available = arena.available_blocks;
+  for (int i = 0; i < 4; i++) rwmem_concurrent_arena_alloc(&arena, 1000);
+  assert(arena.cur_block == cur);
+  rwmem_concurrent_arena_alloc(&arena, 1000);
+  assert(arena.cur_block == available);
+  rwmem_concurrent_arena_free(&arena);
+
+  // Registry, each job system thread gets its own arena
+  static int values[10000];
+  rwth_jobs_init(CA_NUM_THREADS);
+  registry_test = rwmem_arena_registry_create(1024);
+  assert(registry_test.num_arenas == CA_NUM_THREADS + 1);
+  rwth_parallel_for(0, 10000, 100, registry_test_range, values);
+  for (int i = 0; i < 10000; i++) assert(values[i] == i);
+  for (int i = 0; i < CA_NUM_THREADS; i++) {
+    assert(registry_seen[i] == NULL || registry_seen[i] == &registry_test.arenas[i]);
+  }
+  rwmem_arena_registry_reset(&registry_test);
+  assert(registry_test.arenas[0].cur_block_pos == 0);
+  rwth_jobs_shutdown();
+  assert(rwmem_arena_registry_get(&registry_test) == &registry_test.arenas[CA_NUM_THREADS]);
+  rwmem_arena_registry_free(&registry_test);
+}
+
 void run_rwmem_test() {
   char *p = (char *) rwmem_aligned_alloc(19, 8);
   assert(IS_ALIGNED(p, 8));
@@ -65,4 +247,169 @@ void run_rwmem_test() {
 	  printf("%f %d %c\n", bt_ptrs[i]->a, bt_ptrs[i]->b, bt_ptrs[i]->c);
   }
   rwmem_arena_free(&arena);
+
+  // Lots of block rollovers. After a reset the same pattern reuses exactly the same blocks.
+  const int num_blocks = 1000;
+  static void *first_pass[num_blocks], *second_pass[num_blocks];
+  arena = rwmem_arena_create(1024);
+  for (int pass = 0; pass < 2; pass++) {
+    void **ptrs = pass == 0 ? first_pass : second_pass;
+    for (int i = 0; i < num_blocks; i++) {
+      // Doesn't fit in what's left of the block so every allocation starts a new one
+      ptrs[i] = rwmem_arena_alloc(&arena, 1000);
+      assert(IS_ALIGNED(ptrs[i], 16));
+    }
+    rwmem_arena_reset(&arena);
+  }
+  for (int i = 0; i < num_blocks; i++) {
+    bool found = false;
+    for (int j = 0; j < num_blocks && !found; j++) {
+      found = second_pass[i] == first_pass[j];
+    }
+    assert(found);
+  }
+  // Large allocations get their own block and are reused as well
+  void *large = rwmem_arena_alloc(&arena, 5000);
+  rwmem_arena_alloc(&arena, 1000);
+  rwmem_arena_reset(&arena);
+  assert(rwmem_arena_alloc(&arena, 4000) == large);
+  rwmem_arena_free(&arena);
+
+  // Rewinding to a mark, including across block rollovers and nested scopes
+  arena = rwmem_arena_create(1024);
+  rwmem_arena_alloc(&arena, 100);
+  MemoryArenaMark mark = rwmem_arena_mark(&arena);
+  void *first = rwmem_arena_alloc(&arena, 100);
+  for (int i = 0; i < 10; i++) {
+    rwmem_arena_alloc(&arena, 1000);
+  }
+  rwmem_arena_alloc(&arena, 3000);
+  rwmem_arena_rewind(&arena, mark);
+  assert(rwmem_arena_alloc(&arena, 100) == first);
+  void *after_scope;
+  {
+    MemoryArenaScope outer(&arena);
+    after_scope = rwmem_arena_alloc(&arena, 500);
+    {
+      MemoryArenaScope inner(&arena);
+      for (int i = 0; i < 5; i++) {
+        rwmem_arena_alloc(&arena, 800);
+      }
+    }
+    assert(rwmem_arena_alloc(&arena, 16) == (uint8_t *) after_scope + 512);
+  }
+  assert(rwmem_arena_alloc(&arena, 500) == after_scope);
+  // Rewinding to before the first block
+  MemoryArena empty = rwmem_arena_create(256);
+  MemoryArenaMark empty_mark = rwmem_arena_mark(&empty);
+  void *block_start = rwmem_arena_alloc(&empty, 64);
+  rwmem_arena_alloc(&empty, 256);
+  rwmem_arena_rewind(&empty, empty_mark);
+  assert(rwmem_arena_alloc(&empty, 64) == block_start);
+  rwmem_arena_free(&empty);
+  rwmem_arena_free(&arena);
+
+  // Alignment and packing
+  struct Packed3 { float x, y, z; };
+  arena = rwmem_arena_create(1024);
+  char *c0 = (char *) rwmem_arena_alloc_packed(&arena, 3);
+  char *c1 = (char *) rwmem_arena_alloc_packed(&arena, 5);
+  assert(c1 == c0 + 3);
+  Packed3 *v0 = RWMEM_PUSH_STRUCT(&arena, Packed3);
+  Packed3 *v1 = RWMEM_PUSH_STRUCT(&arena, Packed3);
+  assert(IS_ALIGNED(v0, 4) && v1 == v0 + 1);
+  float *avx = (float *) rwmem_arena_alloc_aligned(&arena, 8 * sizeof(float), 32);
+  assert(IS_ALIGNED(avx, 32));
+  void *line = rwmem_arena_alloc_aligned(&arena, 1, 64);
+  assert(IS_ALIGNED(line, 64));
+  assert(IS_ALIGNED(rwmem_arena_alloc(&arena, 1), 16));
+  // Big aligned allocation that needs its own block
+  double *big = RWMEM_PUSH_ARRAY(&arena, double, 500);
+  assert(IS_ALIGNED(big, RWMEM_ALIGNOF(double)));
+  void *big_line = rwmem_arena_alloc_aligned(&arena, 2000, 256);
+  assert(IS_ALIGNED(big_line, 256));
+  rwmem_arena_free(&arena);
+
+  // Virtual arena, one contiguous range no matter how much is allocated
+  size_t reserve = 64 * 1024 * 1024;
+  arena = rwmem_arena_create_virtual(reserve);
+  assert(arena.reserved_bytes == reserve && arena.committed_bytes == 0);
+  uint8_t *vbase = (uint8_t *) rwmem_arena_alloc(&arena, 10000);
+  memset(vbase, 1, 10000);
+  for (int i = 1; i < 1000; i++) {
+    uint8_t *p = (uint8_t *) rwmem_arena_alloc_packed(&arena, 10000);
+    assert(p == vbase + i * 10000);
+    memset(p, (i & 0xff), 10000);
+  }
+  assert(vbase[9999] == 1 && vbase[999 * 10000] == (999 & 0xff));
+  assert(arena.committed_bytes >= 1000 * 10000 && arena.committed_bytes < 1000 * 10000 + RWMEM_VIRTUAL_COMMIT_BYTES);
+  MemoryArenaMark vmark = rwmem_arena_mark(&arena);
+  void *vafter = rwmem_arena_alloc_aligned(&arena, 100, 64);
+  assert(IS_ALIGNED(vafter, 64));
+  rwmem_arena_rewind(&arena, vmark);
+  assert(rwmem_arena_alloc_aligned(&arena, 100, 64) == vafter);
+  // Out of reserved space
+  assert(rwmem_arena_alloc(&arena, reserve) == NULL);
+  // Reset keeps the range but gives back the pages
+  rwmem_arena_reset(&arena);
+  assert(arena.committed_bytes == RWMEM_VIRTUAL_COMMIT_BYTES);
+  assert(rwmem_arena_alloc(&arena, 16) == vbase);
+  uint8_t *whole = (uint8_t *) rwmem_arena_alloc(&arena, reserve - 16);
+  assert(whole == vbase + 16);
+  whole[reserve - 17] = 2;
+  assert(arena.committed_bytes == reserve);
+  rwmem_arena_free(&arena);
+
+  // Pool, released elements are reused before anything new is carved
+  MemoryPool pool = RWMEM_POOL_CREATE(SmallTest, 4, NULL);
+  SmallTest *elems[10];
+  for (int i = 0; i < 10; i++) {
+    elems[i] = RWMEM_POOL_ALLOC(&pool, SmallTest);
+    assert(IS_ALIGNED(elems[i], RWMEM_ALIGNOF(SmallTest)));
+    elems[i]->b = i;
+  }
+  assert(pool.num_chunks == 3 && pool.num_used == 10);
+  assert((uint8_t *) elems[3] == (uint8_t *) elems[0] + 3 * pool.slot_size);
+  rwmem_pool_release(&pool, elems[2]);
+  rwmem_pool_release(&pool, elems[7]);
+  assert(RWMEM_POOL_ALLOC(&pool, SmallTest) == elems[7]);
+  assert(RWMEM_POOL_ALLOC(&pool, SmallTest) == elems[2]);
+  for (int i = 0; i < 10; i++) rwmem_pool_release(&pool, elems[i]);
+  for (int i = 0; i < 1000; i++) {
+    rwmem_pool_release(&pool, rwmem_pool_alloc(&pool));
+  }
+  assert(pool.num_used == 0 && pool.num_slots == 10);
+  rwmem_pool_free(&pool);
+
+  // Pool with handles, chunks from an arena
+  arena = rwmem_arena_create(DEFAULT_ARENA_BLOCK_SIZE_BYTES);
+  pool = rwmem_pool_create(sizeof(BigTest), 64, 16, &arena, true);
+  MemoryPoolHandle null_handle = {};
+  assert(rwmem_pool_get(&pool, null_handle) == NULL);
+  MemoryPoolHandle handles[40];
+  for (int i = 0; i < 40; i++) {
+    handles[i] = rwmem_pool_alloc_handle(&pool);
+    BigTest *t = (BigTest *) rwmem_pool_get(&pool, handles[i]);
+    assert(t != NULL && IS_ALIGNED(t, 64));
+    t->b = i;
+  }
+  for (int i = 0; i < 40; i += 2) rwmem_pool_release_handle(&pool, handles[i]);
+  for (int i = 0; i < 40; i++) {
+    BigTest *t = (BigTest *) rwmem_pool_get(&pool, handles[i]);
+    assert(i % 2 == 0 ? t == NULL : t->b == i);
+  }
+  // Same slot, new generation
+  MemoryPoolHandle reused = rwmem_pool_alloc_handle(&pool);
+  assert(reused.index == handles[38].index && reused.generation != handles[38].generation);
+  rwmem_pool_release_handle(&pool, handles[38]);
+  assert(rwmem_pool_get(&pool, reused) != NULL && pool.num_used == 21);
+  // Releasing by pointer invalidates handles too
+  rwmem_pool_release(&pool, rwmem_pool_get(&pool, handles[1]));
+  assert(rwmem_pool_get(&pool, handles[1]) == NULL);
+  rwmem_pool_free(&pool);
+  rwmem_arena_free(&arena);
+
+  run_rwmem_stats_test();
+  run_rwmem_heap_test();
+  run_rwmem_concurrent_test();
 }
@@ -0,0 +1,122 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#define RWPF_IMPLEMENTATION
+#include "../rw_prof.h"
+
+static void prof_work(int n) {
+  volatile int x = 0;
+  for (int i = 0; i < n; i++) x = x + 1;
+}
+
+static void *prof_thread(void *arg) {
+  rwpf_set_thread_name("prof worker");
+  for (int i = 0; i < 10; i++) {
+    RWPF_ZONE("worker zone");
+    prof_work(1000);
+  }
+  return NULL;
+}
+
+static void *prof_short_thread(void *arg) {
+  bool *recorded = (bool *) arg;
+  *recorded = rwpf_set_thread_name("short lived");
+  RWPF_ZONE_BEGIN("short lived zone");
+  RWPF_ZONE_END();
+  rwpf_thread_shutdown();
+  return NULL;
+}
+
+static const rwpf_zone_stats *prof_find(const char *name, int parent) {
+  const rwpf_zone_stats *zones;
+  int n = rwpf_frame_zones(&zones);
+  for (int i = 0; i < n; i++) {
+    if (strcmp(zones[i].name, name) == 0 && zones[i].parent == parent) return &zones[i];
+  }
+  return NULL;
+}
+
+void run_rwpf_test() {
+	printf("run_rwpf_test");
+
+  rwtm_init();
+  rwpf_frame_mark();
+  RWPF_ZONE_BEGIN("spans frames");
+  rwpf_frame_mark();
+  {
+    RWPF_ZONE("frame");
+    for (int i = 0; i < 3; i++) {
+      RWPF_ZONE_BEGIN("update");
+      {
+        RWPF_ZONE("physics");
+        prof_work(10000);
+      }
+      RWPF_ZONE_END();
+    }
+    RWPF_ZONE("render");
+  }
+  rwth_thread threads[2];
+  for (int i = 0; i < 2; i++) rwth_thread_create(&threads[i], prof_thread, NULL);
+  for (int i = 0; i < 2; i++) rwth_thread_join(&threads[i]);
+  RWPF_ZONE_END();
+  uint64_t frame_ns = rwpf_frame_mark();
+
+  // Tree of the frame
+  const rwpf_zone_stats *zones;
+  int num_zones = rwpf_frame_zones(&zones);
+  assert(num_zones == 6);
+  const rwpf_zone_stats *spans = prof_find("spans frames", -1);
+  const rwpf_zone_stats *frame = prof_find("frame", (int) (spans - zones));
+  assert(spans && frame && frame->count == 1 && frame->depth == 1);
+  const rwpf_zone_stats *update = prof_find("update", (int) (frame - zones));
+  const rwpf_zone_stats *render = prof_find("render", (int) (frame - zones));
+  assert(update && update->count == 3 && render && render->count == 1);
+  const rwpf_zone_stats *physics = prof_find("physics", (int) (update - zones));
+  assert(physics && physics->count == 3 && physics->depth == 3);
+  assert(physics->max_ns <= physics->total_ns && physics->self_ns == physics->total_ns);
+  assert(update->self_ns == update->total_ns - physics->total_ns);
+  assert(frame->self_ns == frame->total_ns - update->total_ns - render->total_ns);
+  const rwpf_zone_stats *worker = prof_find("worker zone", -1);
+  assert(worker && worker->count == 20 && worker->depth == 0);
+  assert(spans->total_ns >= frame->total_ns && frame->total_ns <= frame_ns);
+  // Nothing happened since
+  rwpf_frame_mark();
+  assert(rwpf_frame_zones(&zones) == 0);
+
+  // Chrome trace
+  FILE *f = tmpfile();
+  assert(f && rwpf_write_chrome_trace(f));
+  static char json[1 << 16];
+  rewind(f);
+  size_t len = fread(json, 1, sizeof(json) - 1, f);
+  json[len] = '\0';
+  fclose(f);
+  assert(strncmp(json, "{\"traceEvents\":[", 16) == 0);
+  assert(strstr(json, "\"ph\":\"X\"") && strstr(json, "\"name\":\"physics\"") && strstr(json, "\"prof worker\""));
+  assert(strcmp(json + len - 4, "\n]}\n") == 0);
+
+  // Overwritten events are skipped
+  RWPF_ZONE_BEGIN("lost");
+  for (int i = 0; i < RWPF_EVENTS_PER_THREAD; i++) {
+    RWPF_ZONE("spam");
+  }
+  RWPF_ZONE_END();
+  rwpf_frame_mark();
+  const rwpf_zone_stats *spam = prof_find("spam", -1);
+  assert(spam && spam->count > 0 && spam->count <= RWPF_EVENTS_PER_THREAD / 2);
+  assert(prof_find("lost", -1) == NULL);
+
+  // Buffers of threads that shut down are reused, so there can be more threads than buffers
+  for (int i = 0; i < 2 * RWPF_MAX_THREADS; i++) {
+    bool recorded = false;
+    rwth_thread thread;
+    rwth_thread_create(&thread, prof_short_thread, &recorded);
+    rwth_thread_join(&thread);
+    assert(recorded);
+  }
+  rwpf_frame_mark();
+  const rwpf_zone_stats *short_lived = prof_find("short lived zone", -1);
+  assert(short_lived && short_lived->count == 2 * RWPF_MAX_THREADS);
+
+  puts(" - PASSED");
+}
@@ -0,0 +1,124 @@
+// Contention benchmark for the rw_th.h queues.
+// Every configuration pushes the same total number of elements through the queue
+// and reports throughput, e.g. make queue_bench && ./queue_bench [num_items]
+#include <stdio.h>
+#include <stdlib.h>
+#define RWTH_IMPLEMENTATION
+#include "../rw_th.h"
+#define RWTM_IMPLEMENTATION
+#include "../rw_time.h"
+
+#define QUEUE_BENCH_CAPACITY 1024
+#define QUEUE_BENCH_MAX_THREADS 16
+
+enum QueueBenchKind {
+  QUEUE_BENCH_MPMC,
+  QUEUE_BENCH_MPSC,
+  QUEUE_BENCH_SPSC,
+};
+
+struct QueueBench {
+  QueueBenchKind kind;
+  rwth_mpmc_queue mpmc; // also used as the mpsc queue
+  rwth_spsc_queue spsc;
+  int64_t items_per_producer;
+  int64_t volatile remaining; // items left to pop
+  int64_t volatile start; // threads spin on this so they all begin together
+};
+
+static inline void queue_bench_backoff(int *fails) {
+  if (++(*fails) < 64) {
+    rwth_cpu_relax();
+  } else {
+    rwth_thread_yield();
+    *fails = 0;
+  }
+}
+
+static void *queue_bench_producer(void *arg) {
+  QueueBench *b = (QueueBench *) arg;
+  while (!rwth_atomic_load_i64(&b->start, RWTH_ACQUIRE)) rwth_cpu_relax();
+  int fails = 0;
+  for (int64_t i = 0; i < b->items_per_producer; i++) {
+    for (;;) {
+      bool pushed;
+      switch (b->kind) {
+        case QUEUE_BENCH_MPMC: pushed = rwth_mpmc_queue_push(&b->mpmc, &i); break;
+        case QUEUE_BENCH_MPSC: pushed = rwth_mpsc_queue_push(&b->mpmc, &i); break;
+        default: pushed = rwth_spsc_queue_push(&b->spsc, &i); break;
+      }
+      if (pushed) break;
+      queue_bench_backoff(&fails);
+    }
+  }
+  return NULL;
+}
+
+static void *queue_bench_consumer(void *arg) {
+  QueueBench *b = (QueueBench *) arg;
+  while (!rwth_atomic_load_i64(&b->start, RWTH_ACQUIRE)) rwth_cpu_relax();
+  int fails = 0;
+  int64_t item;
+  while (rwth_atomic_load_i64(&b->remaining, RWTH_RELAXED) > 0) {
+    bool popped;
+    switch (b->kind) {
+      case QUEUE_BENCH_MPMC: popped = rwth_mpmc_queue_pop(&b->mpmc, &item); break;
+      case QUEUE_BENCH_MPSC: popped = rwth_mpsc_queue_pop(&b->mpmc, &item); break;
+      default: popped = rwth_spsc_queue_pop(&b->spsc, &item); break;
+    }
+    if (popped) {
+      rwth_atomic_add_i64_explicit(&b->remaining, -1, RWTH_RELAXED);
+    } else {
+      queue_bench_backoff(&fails);
+    }
+  }
+  return NULL;
+}
+
+static void queue_bench_run(const char *name, QueueBenchKind kind, int num_producers, int num_consumers, int64_t num_items) {
+  QueueBench b;
+  b.kind = kind;
+  b.mpmc = rwth_mpmc_queue_create(QUEUE_BENCH_CAPACITY, sizeof(int64_t));
+  b.spsc = rwth_spsc_queue_create(QUEUE_BENCH_CAPACITY, sizeof(int64_t));
+  b.items_per_producer = num_items / num_producers;
+  b.remaining = b.items_per_producer * num_producers;
+  b.start = 0;
+  int64_t total = b.remaining;
+
+  rwth_thread threads[QUEUE_BENCH_MAX_THREADS];
+  int num_threads = 0;
+  for (int i = 0; i < num_producers; i++) {
+    rwth_thread_create(&threads[num_threads++], queue_bench_producer, &b);
+  }
+  for (int i = 0; i < num_consumers; i++) {
+    rwth_thread_create(&threads[num_threads++], queue_bench_consumer, &b);
+  }
+
+  double start = rwtm_now();
+  rwth_atomic_store_i64(&b.start, 1, RWTH_RELEASE);
+  for (int i = 0; i < num_threads; i++) {
+    rwth_thread_join(&threads[i]);
+  }
+  double seconds = rwtm_to_sec(rwtm_since(start));
+
+  printf("%-5s %2d producers %2d consumers: %8.2f Mops/s (%.2f ns/op)\n",
+         name, num_producers, num_consumers, total / seconds / 1e6, seconds * 1e9 / total);
+  rwth_mpmc_queue_free(&b.mpmc);
+  rwth_spsc_queue_free(&b.spsc);
+}
+
+int main(int argc, char **argv) {
+  int64_t num_items = argc > 1 ? atoll(argv[1]) : 4000000;
+  rwtm_init();
+  printf("%d cpus, %lld items per run, capacity %d\n", rwth_num_cpus(), (long long) num_items, QUEUE_BENCH_CAPACITY);
+
+  queue_bench_run("spsc", QUEUE_BENCH_SPSC, 1, 1, num_items);
+  queue_bench_run("mpsc", QUEUE_BENCH_MPSC, 1, 1, num_items);
+  queue_bench_run("mpsc", QUEUE_BENCH_MPSC, 4, 1, num_items);
+  queue_bench_run("mpmc", QUEUE_BENCH_MPMC, 1, 1, num_items);
+  queue_bench_run("mpmc", QUEUE_BENCH_MPMC, 2, 2, num_items);
+  queue_bench_run("mpmc", QUEUE_BENCH_MPMC, 4, 1, num_items);
+  queue_bench_run("mpmc", QUEUE_BENCH_MPMC, 4, 4, num_items);
+  queue_bench_run("mpmc", QUEUE_BENCH_MPMC, 8, 8, num_items);
+  return 0;
+}
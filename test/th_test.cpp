@@ -10,8 +10,259 @@
 
 static int64_t val = 0;
 
+#define NUM_JOB_THREADS 4
+#define NUM_PARENT_JOBS 100
+#define NUM_CHILD_JOBS 10
+#define PARALLEL_FOR_COUNT 10007
+
+static int64_t job_sum = 0;
+
+static void add_job(void *data) {
+  rwth_atomic_add_i64(&job_sum, (int64_t) (intptr_t) data);
+}
+
+// Depends on its children finishing before it does
+static void parent_job(void *data) {
+  rwth_counter children = {};
+  for (int i = 0; i < NUM_CHILD_JOBS; i++) {
+    rwth_jobs_run(add_job, (void *) 1, &children);
+  }
+  rwth_jobs_wait(&children);
+  assert(children.value == 0);
+}
+
+static void increment_range(void *data, int start, int end) {
+  int *visits = (int *) data;
+  for (int i = start; i < end; i++) {
+    visits[i]++;
+  }
+}
+
+#define NUM_CAS_THREADS 4
+#define NUM_CAS_INCREMENTS 2000
+
+static rwth_u128 volatile cas_128_val;
+static int32_t volatile cas_32_val;
+
+// Bumps lo and hi together, like a pointer and its ABA tag
+static void *cas_func(void *arg) {
+  for (int i = 0; i < NUM_CAS_INCREMENTS; i++) {
+    rwth_u128 expected;
+    expected.lo = cas_128_val.lo;
+    expected.hi = cas_128_val.hi;
+    rwth_u128 desired;
+    do {
+      desired.lo = expected.lo + 1;
+      desired.hi = expected.hi + 2;
+    } while (!rwth_atomic_cas_128(&cas_128_val, &expected, desired));
+
+    int32_t old = rwth_atomic_load_i32(&cas_32_val, RWTH_RELAXED);
+    int32_t prev;
+    while ((prev = rwth_atomic_cas_i32_explicit(&cas_32_val, old, old + 1, RWTH_ACQ_REL)) != old) {
+      old = prev;
+    }
+  }
+  return NULL;
+}
+
+static void run_rwth_atomics_test() {
+  int32_t volatile v32 = 0;
+  rwth_atomic_store_i32(&v32, 5, RWTH_RELEASE);
+  assert(rwth_atomic_load_i32(&v32, RWTH_ACQUIRE) == 5);
+  assert(rwth_atomic_add_i32(&v32, 3) == 5);
+  assert(rwth_atomic_add_i32_explicit(&v32, -1, RWTH_RELAXED) == 8);
+  assert(rwth_atomic_exchange_i32(&v32, 1) == 7);
+  assert(rwth_atomic_cas_i32(&v32, 2, 3) == 1 && v32 == 1);
+  assert(rwth_atomic_cas_i32_explicit(&v32, 1, 3, RWTH_RELEASE) == 1 && v32 == 3);
+
+  int64_t volatile v64 = 0;
+  rwth_atomic_store_i64(&v64, 1LL << 40, RWTH_SEQ_CST);
+  assert(rwth_atomic_load_i64(&v64, RWTH_SEQ_CST) == 1LL << 40);
+  assert(rwth_atomic_add_i64_explicit(&v64, 1, RWTH_ACQ_REL) == 1LL << 40);
+  assert(rwth_atomic_exchange_i64_explicit(&v64, 2, RWTH_ACQUIRE) == (1LL << 40) + 1);
+  assert(rwth_atomic_cas_i64_explicit(&v64, 2, 4, RWTH_SEQ_CST) == 2 && v64 == 4);
+
+  int a, b;
+  void * volatile p = NULL;
+  rwth_atomic_store_ptr(&p, &a, RWTH_RELEASE);
+  assert(rwth_atomic_load_ptr(&p, RWTH_ACQUIRE) == &a);
+  assert(rwth_atomic_exchange_ptr(&p, &b) == &a);
+  assert(rwth_atomic_cas_ptr(&p, &a, NULL) == &b && p == &b);
+  assert(rwth_atomic_cas_ptr_explicit(&p, &b, NULL, RWTH_ACQ_REL) == &b && p == NULL);
+  rwth_atomic_thread_fence(RWTH_SEQ_CST);
+  rwth_atomic_compiler_fence();
+
+  rwth_u128 expected = { 1, 1 };
+  rwth_u128 desired = { 2, 3 };
+  assert(!rwth_atomic_cas_128(&cas_128_val, &expected, desired));
+  assert(expected.lo == 0 && expected.hi == 0);
+  assert(rwth_atomic_cas_128(&cas_128_val, &expected, expected));
+
+  rwth_thread threads[NUM_CAS_THREADS];
+  for (int i = 0; i < NUM_CAS_THREADS; i++) {
+    assert(rwth_thread_create(&threads[i], cas_func, NULL));
+  }
+  for (int i = 0; i < NUM_CAS_THREADS; i++) {
+    rwth_thread_join(&threads[i]);
+  }
+  assert(cas_128_val.lo == NUM_CAS_THREADS * NUM_CAS_INCREMENTS);
+  assert(cas_128_val.hi == 2 * NUM_CAS_THREADS * NUM_CAS_INCREMENTS);
+  assert(cas_32_val == NUM_CAS_THREADS * NUM_CAS_INCREMENTS);
+}
+
+#define NUM_QUEUE_PRODUCERS 3
+#define NUM_QUEUE_ITEMS 20000
+
+struct QueueTestItem {
+  int32_t producer;
+  int32_t index;
+};
+
+static rwth_mpmc_queue test_mpmc;
+static rwth_mpsc_queue test_mpsc;
+static rwth_spsc_queue test_spsc;
+static int64_t volatile mpmc_popped_sum;
+static int64_t volatile mpmc_popped_count;
+
+static void *mpmc_producer_func(void *arg) {
+  QueueTestItem item = { (int32_t) (intptr_t) arg, 0 };
+  for (item.index = 0; item.index < NUM_QUEUE_ITEMS; item.index++) {
+    while (!rwth_mpmc_queue_push(&test_mpmc, &item)) rwth_thread_yield();
+  }
+  return NULL;
+}
+
+static void *mpmc_consumer_func(void *arg) {
+  QueueTestItem item;
+  while (rwth_atomic_load_i64(&mpmc_popped_count, RWTH_RELAXED) < NUM_QUEUE_PRODUCERS * NUM_QUEUE_ITEMS) {
+    if (rwth_mpmc_queue_pop(&test_mpmc, &item)) {
+      rwth_atomic_add_i64(&mpmc_popped_sum, item.index);
+      rwth_atomic_add_i64(&mpmc_popped_count, 1);
+    } else {
+      rwth_thread_yield();
+    }
+  }
+  return NULL;
+}
+
+static void *mpsc_producer_func(void *arg) {
+  QueueTestItem item = { (int32_t) (intptr_t) arg, 0 };
+  for (item.index = 0; item.index < NUM_QUEUE_ITEMS; item.index++) {
+    while (!rwth_mpsc_queue_push(&test_mpsc, &item)) rwth_thread_yield();
+  }
+  return NULL;
+}
+
+static void *spsc_producer_func(void *arg) {
+  for (int32_t i = 0; i < NUM_QUEUE_ITEMS; i++) {
+    while (!rwth_spsc_queue_push(&test_spsc, &i)) rwth_thread_yield();
+  }
+  return NULL;
+}
+
+static void run_rwth_queues_test() {
+  // Single threaded: FIFO order, full and empty
+  rwth_mpmc_queue q = rwth_mpmc_queue_create(3, sizeof(int));
+  int v;
+  assert(!rwth_mpmc_queue_pop(&q, &v));
+  for (int i = 0; i < 4; i++) {
+    assert(rwth_mpmc_queue_push(&q, &i));
+  }
+  assert(!rwth_mpmc_queue_push(&q, &v));
+  for (int i = 0; i < 4; i++) {
+    assert(rwth_mpmc_queue_pop(&q, &v) && v == i);
+  }
+  assert(!rwth_mpmc_queue_pop(&q, &v));
+  rwth_mpmc_queue_free(&q);
+
+  // Multiple producers and consumers, everything arrives exactly once
+  test_mpmc = rwth_mpmc_queue_create(64, sizeof(QueueTestItem));
+  rwth_thread producers[NUM_QUEUE_PRODUCERS], consumers[2];
+  for (int i = 0; i < NUM_QUEUE_PRODUCERS; i++) {
+    rwth_thread_create(&producers[i], mpmc_producer_func, (void *) (intptr_t) i);
+  }
+  for (int i = 0; i < 2; i++) {
+    rwth_thread_create(&consumers[i], mpmc_consumer_func, NULL);
+  }
+  for (int i = 0; i < NUM_QUEUE_PRODUCERS; i++) {
+    rwth_thread_join(&producers[i]);
+  }
+  for (int i = 0; i < 2; i++) {
+    rwth_thread_join(&consumers[i]);
+  }
+  assert(mpmc_popped_count == NUM_QUEUE_PRODUCERS * NUM_QUEUE_ITEMS);
+  assert(mpmc_popped_sum == (int64_t) NUM_QUEUE_PRODUCERS * NUM_QUEUE_ITEMS * (NUM_QUEUE_ITEMS - 1) / 2);
+  rwth_mpmc_queue_free(&test_mpmc);
+
+  // Multiple producers, one consumer. Each producer's items stay in order.
+  test_mpsc = rwth_mpsc_queue_create(64, sizeof(QueueTestItem));
+  for (int i = 0; i < NUM_QUEUE_PRODUCERS; i++) {
+    rwth_thread_create(&producers[i], mpsc_producer_func, (void *) (intptr_t) i);
+  }
+  int next[NUM_QUEUE_PRODUCERS] = { 0 };
+  for (int count = 0; count < NUM_QUEUE_PRODUCERS * NUM_QUEUE_ITEMS;) {
+    QueueTestItem item;
+    if (rwth_mpsc_queue_pop(&test_mpsc, &item)) {
+      assert(item.index == next[item.producer]++);
+      count++;
+    } else {
+      rwth_thread_yield();
+    }
+  }
+  for (int i = 0; i < NUM_QUEUE_PRODUCERS; i++) {
+    rwth_thread_join(&producers[i]);
+  }
+  rwth_mpsc_queue_free(&test_mpsc);
+
+  test_spsc = rwth_spsc_queue_create(16, sizeof(int32_t));
+  rwth_thread_create(&producers[0], spsc_producer_func, NULL);
+  for (int32_t expected = 0; expected < NUM_QUEUE_ITEMS;) {
+    int32_t i;
+    if (rwth_spsc_queue_pop(&test_spsc, &i)) {
+      assert(i == expected++);
+    } else {
+      rwth_thread_yield();
+    }
+  }
+  rwth_thread_join(&producers[0]);
+  rwth_spsc_queue_free(&test_spsc);
+}
+
+static void run_rwth_jobs_test() {
+  rwth_jobs_init(NUM_JOB_THREADS);
+  assert(rwth_jobs_num_threads() == NUM_JOB_THREADS);
+
+  rwth_counter counter = {};
+  for (int i = 0; i < NUM_PARENT_JOBS; i++) {
+    rwth_jobs_run(parent_job, NULL, &counter);
+  }
+  rwth_jobs_wait(&counter);
+  assert(job_sum == NUM_PARENT_JOBS * NUM_CHILD_JOBS);
+
+  static int visits[PARALLEL_FOR_COUNT];
+  rwth_parallel_for(0, PARALLEL_FOR_COUNT, 64, increment_range, visits);
+  rwth_parallel_for(7, PARALLEL_FOR_COUNT, 1000, increment_range, visits);
+  for (int i = 0; i < PARALLEL_FOR_COUNT; i++) {
+    assert(visits[i] == (i < 7 ? 1 : 2));
+  }
+
+  rwth_jobs_shutdown();
+  assert(rwth_jobs_num_threads() == 0);
+
+  // Without the job system everything runs immediately
+  job_sum = 0;
+  rwth_jobs_run(parent_job, NULL, &counter);
+  assert(job_sum == NUM_CHILD_JOBS && counter.value == 0);
+}
+
 #if defined(_WIN32)
-void run_rwth_test() {}
+void run_rwth_test() {
+	printf("run_rwth_test");
+  run_rwth_atomics_test();
+  run_rwth_queues_test();
+  run_rwth_jobs_test();
+	printf(" - PASSED\n");
+}
 #else
 
 void *add_func(void *t) {
@@ -43,6 +294,10 @@ void run_rwth_test() {
     }
   }
   assert(val == EXPECTED_RESULT);
+
+  run_rwth_atomics_test();
+  run_rwth_queues_test();
+  run_rwth_jobs_test();
 	printf(" - PASSED\n");
 }
 #endif
@@ -0,0 +1,118 @@
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+
+static uint64_t tm_thread_time;
+
+#if defined(RWTM_USE_TSC) && !defined(_WIN32)
+static uint64_t tm_os_now() {
+  struct timespec tp;
+  clock_gettime(CLOCK_MONOTONIC, &tp);
+  return SECS_TO_NANO(tp.tv_sec) + tp.tv_nsec;
+}
+#endif
+
+static void *tm_thread(void *arg) {
+  tm_thread_time = rwtm_now();
+  return NULL;
+}
+
+void run_rwtm_test() {
+	printf("run_rwtm_test");
+
+  rwtm_init();
+
+#if !defined(RWTM_USE_TSC)
+  // Default build, everything below runs on the OS clock
+  assert(!rwtm_using_tsc());
+#endif
+#if defined(RWTM_USE_TSC) && (defined(__x86_64__) || defined(_M_X64))
+  // The TSC clock has to keep up with the OS clock
+  if (rwtm_using_tsc()) {
+#if defined(_WIN32)
+    uint64_t start = rwtm_now();
+    Sleep(50);
+    assert(rwtm_since(start) >= 45000000);
+#else
+    // Every read of rwtm_now is between two OS reads, so being preempted only widens the
+    // range it has to be in rather than failing
+    uint64_t os_start[2], os_end[2];
+    os_start[0] = tm_os_now();
+    uint64_t start = rwtm_now();
+    os_start[1] = tm_os_now();
+    usleep(50000);
+    os_end[0] = tm_os_now();
+    uint64_t end = rwtm_now();
+    os_end[1] = tm_os_now();
+    uint64_t elapsed = end - start;
+    // Allow 1% for the calibration
+    assert(elapsed * 100 >= (os_end[0] - os_start[1]) * 99);
+    assert(elapsed * 99 <= (os_end[1] - os_start[0]) * 100);
+#endif
+  }
+#endif
+  // One timebase, rwtm_init doesn't restart it and other threads read the same clock
+  uint64_t before = rwtm_now();
+  rwtm_init();
+  rwth_thread thread;
+  rwth_thread_create(&thread, tm_thread, NULL);
+  rwth_thread_join(&thread);
+  uint64_t after = rwtm_now();
+  assert(before <= tm_thread_time && tm_thread_time <= after);
+
+  uint64_t prev = rwtm_now();
+  for (int i = 0; i < 100000; i++) {
+    uint64_t now = rwtm_now();
+    assert(now >= prev);
+    prev = now;
+  }
+
+  // Partly filled window
+  static rwtm_window window;
+  rwtm_window_stats stats = rwtm_window_get_stats(&window);
+  assert(stats.count == 0 && stats.avg == 0);
+  for (uint64_t i = 1; i <= 100; i++) rwtm_window_add(&window, i);
+  stats = rwtm_window_get_stats(&window);
+  assert(stats.count == 100 && stats.avg == 50 && stats.min == 1 && stats.max == 100);
+  assert(stats.p50 == 50 && stats.p95 == 95 && stats.p99 == 99);
+  assert(fabs(stats.stddev - 28.866) < 0.01);
+
+  // Sliding, min/max have to follow samples out of the window
+  static rwtm_window sliding;
+  uint32_t rng = 1;
+  uint64_t values[1000];
+  for (int i = 0; i < 1000; i++) {
+    rng = rng * 1664525u + 1013904223u;
+    values[i] = (i / 100) % 2 ? rng >> 20 : 5000 + i;
+    rwtm_window_add(&sliding, values[i]);
+    stats = rwtm_window_get_stats(&sliding);
+    int first = i + 1 > RWTM_WINDOW_SIZE ? i + 1 - RWTM_WINDOW_SIZE : 0;
+    uint64_t min = values[first], max = values[first], sum = 0;
+    for (int j = first; j <= i; j++) {
+      if (values[j] < min) min = values[j];
+      if (values[j] > max) max = values[j];
+      sum += values[j];
+    }
+    assert(stats.count == i + 1 - first && stats.min == min && stats.max == max);
+    assert(stats.avg == sum / stats.count);
+    assert(stats.p50 >= min && stats.p50 <= stats.p95 && stats.p95 <= stats.p99 && stats.p99 <= max);
+  }
+
+  // Named windows
+  assert(rwtm_mark("frame") == 0);
+  assert(rwtm_named_window("frame")->num_samples == 0);
+  uint64_t total = 0;
+  for (int i = 0; i < 5; i++) total += rwtm_mark("frame");
+  rwtm_window *frame = rwtm_named_window("frame");
+  assert(frame->num_samples == 5 && rwtm_window_avg("frame") == total / 5);
+  // Asking for the average of unknown names doesn't use up windows
+  static char unknown[RWTM_MAX_NAMED_WINDOWS][16];
+  for (int i = 0; i < RWTM_MAX_NAMED_WINDOWS; i++) {
+    snprintf(unknown[i], sizeof(unknown[i]), "unknown %d", i);
+    assert(rwtm_window_avg(unknown[i]) == 0);
+  }
+  rwtm_window *other = rwtm_named_window("other");
+  assert(other != NULL && other != frame && other->num_samples == 0);
+
+  puts(" - PASSED");
+}
@@ -44,5 +44,77 @@ void run_rwtr_test() {
 	Vec4 translated_v4 = rwtr_v4_apply(&translate_tr, v4);
 	rwm_v4_assert_eq(translated_v4, 9.0f, 10.0f, 11.0f, 4.0f);
 
+	// Array versions (count is not a multiple of 4 to hit the scalar tail)
+	Transform trs_tr = rwtr_trs(rwm_v3_init(1.0f, -2.0f, 3.0f), rwm_v3_init(2.0f, 3.0f, 0.5f), RWTR_Y_AXIS, 30.0f);
+	const int n = 7;
+	Vec3 in[n], out[n];
+	Vec4 in4[n], out4[n];
+	struct Vertex { Point3 p; Normal3 n; Vec2 uv; } verts[n];
+	for (int i = 0; i < n; i++) {
+		in[i] = rwm_v3_init(1.0f + i, 2.0f - i, 0.5f * i);
+		in4[i] = rwm_v4_init(1.0f + i, 2.0f - i, 0.5f * i, 1.0f);
+		verts[i].p = in[i];
+		verts[i].n = in[i];
+	}
+
+	rwtr_pt3_apply_n(&trs_tr, in, out, n);
+	for (int i = 0; i < n; i++) {
+		Point3 e = rwtr_pt3_apply(&trs_tr, in[i]);
+		rwm_v3_assert_eq(out[i], e.x, e.y, e.z);
+	}
+	rwtr_v3_apply_n(&trs_tr, in, out, n);
+	for (int i = 0; i < n; i++) {
+		Vec3 e = rwtr_v3_apply(&trs_tr, in[i]);
+		rwm_v3_assert_eq(out[i], e.x, e.y, e.z);
+	}
+	rwtr_n3_apply_n(&trs_tr, in, out, n);
+	for (int i = 0; i < n; i++) {
+		Normal3 e = rwtr_n3_apply(&trs_tr, in[i]);
+		rwm_v3_assert_eq(out[i], e.x, e.y, e.z);
+	}
+	rwtr_v4_apply_n(&trs_tr, in4, out4, n);
+	for (int i = 0; i < n; i++) {
+		Vec4 e = rwtr_v4_apply(&trs_tr, in4[i]);
+		rwm_v4_assert_eq(out4[i], e.x, e.y, e.z, e.w);
+	}
+
+	// In place on an interleaved buffer
+	rwtr_pt3_apply_strided(&trs_tr, &verts[0].p, sizeof(Vertex), &verts[0].p, sizeof(Vertex), n);
+	rwtr_n3_apply_strided(&trs_tr, &verts[0].n, sizeof(Vertex), &verts[0].n, sizeof(Vertex), n);
+	for (int i = 0; i < n; i++) {
+		Point3 e = rwtr_pt3_apply(&trs_tr, in[i]);
+		rwm_v3_assert_eq(verts[i].p, e.x, e.y, e.z);
+		Normal3 en = rwtr_n3_apply(&trs_tr, in[i]);
+		rwm_v3_assert_eq(verts[i].n, en.x, en.y, en.z);
+	}
+	rwtr_pt3_apply_n(&trs_tr, in, in, n);
+	for (int i = 0; i < n; i++) {
+		rwm_v3_assert_eq(in[i], verts[i].p.x, verts[i].p.y, verts[i].p.z);
+	}
+
+	// Bounding boxes should match the box around all 8 transformed corners
+	Rect3 boxes[n], tr_boxes[n], inv_boxes[n];
+	for (int i = 0; i < n; i++) {
+		boxes[i] = rwm_r3_init(-1.0f * i, 2.0f, 0.5f, 3.0f, -2.0f - i, 4.0f);
+	}
+	rwtr_r3_apply_n(&trs_tr, boxes, tr_boxes, n);
+	rwtr_r3_apply_inv_n(&trs_tr, boxes, inv_boxes, n);
+	for (int i = 0; i < n; i++) {
+		Rect3 e = rwm_r3_init_p(rwtr_pt3_apply(&trs_tr, boxes[i].min_p));
+		Rect3 e_inv = rwm_r3_init_p(rwtr_pt3_apply_inv(&trs_tr, boxes[i].min_p));
+		for (int c = 1; c < 8; c++) {
+			Point3 corner = rwm_v3_init(boxes[i].p[c & 1].x, boxes[i].p[(c >> 1) & 1].y, boxes[i].p[c >> 2].z);
+			e = rwm_r3_union_p(e, rwtr_pt3_apply(&trs_tr, corner));
+			e_inv = rwm_r3_union_p(e_inv, rwtr_pt3_apply_inv(&trs_tr, corner));
+		}
+		Rect3 single = rwtr_r3_apply(&trs_tr, boxes[i]);
+		rwm_v3_assert_eq(single.min_p, e.min_px, e.min_py, e.min_pz);
+		rwm_v3_assert_eq(single.max_p, e.max_px, e.max_py, e.max_pz);
+		rwm_v3_assert_eq(tr_boxes[i].min_p, e.min_px, e.min_py, e.min_pz);
+		rwm_v3_assert_eq(tr_boxes[i].max_p, e.max_px, e.max_py, e.max_pz);
+		rwm_v3_assert_eq(inv_boxes[i].min_p, e_inv.min_px, e_inv.min_py, e_inv.min_pz);
+		rwm_v3_assert_eq(inv_boxes[i].max_p, e_inv.max_px, e_inv.max_py, e_inv.max_pz);
+	}
+
 	puts(" - PASSED");
 }
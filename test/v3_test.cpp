@@ -80,5 +80,67 @@ void run_rwm_v3_test() {
 	v *= 2.0f;
 	rwm_v3_assert_eq(v, 2.0f, 4.0f, 6.0f);
 
+	// Batch (count is not a multiple of the lane width to hit the scalar tail)
+	const int n = 11;
+	Vec3 a_aos[n], b_aos[n], out_aos[n];
+	float ax[n], ay[n], az[n], bx[n], by[n], bz[n], ox[n], oy[n], oz[n], dots[n];
+	for (int i = 0; i < n; i++) {
+		a_aos[i] = rwm_v3_init(1.0f + i, 2.0f - i, 0.5f * i);
+		b_aos[i] = rwm_v3_init(3.0f, -1.0f * i, 2.0f + i);
+	}
+	Vec3Batch a_b = rwm_v3_batch_init(ax, ay, az);
+	Vec3Batch b_b = rwm_v3_batch_init(bx, by, bz);
+	Vec3Batch out_b = rwm_v3_batch_init(ox, oy, oz);
+	rwm_v3_batch_from_aos(a_aos, a_b, n);
+	rwm_v3_batch_from_aos(b_aos, b_b, n);
+
+	rwm_v3_batch_add(a_b, b_b, out_b, n);
+	rwm_v3_batch_to_aos(out_b, out_aos, n);
+	for (int i = 0; i < n; i++) {
+		Vec3 e = rwm_v3_add(a_aos[i], b_aos[i]);
+		rwm_v3_assert_eq(out_aos[i], e.x, e.y, e.z);
+	}
+
+	rwm_v3_batch_subtract(a_b, b_b, out_b, n);
+	rwm_v3_batch_to_aos(out_b, out_aos, n);
+	for (int i = 0; i < n; i++) {
+		Vec3 e = rwm_v3_subtract(a_aos[i], b_aos[i]);
+		rwm_v3_assert_eq(out_aos[i], e.x, e.y, e.z);
+	}
+
+	rwm_v3_batch_scalar_mult(2.0f, a_b, out_b, n);
+	rwm_v3_batch_to_aos(out_b, out_aos, n);
+	for (int i = 0; i < n; i++) {
+		Vec3 e = rwm_v3_scalar_mult(2.0f, a_aos[i]);
+		rwm_v3_assert_eq(out_aos[i], e.x, e.y, e.z);
+	}
+
+	rwm_v3_batch_dot(a_b, b_b, dots, n);
+	for (int i = 0; i < n; i++) {
+		assert(ABS(dots[i] - rwm_v3_dot(a_aos[i], b_aos[i])) < EPSILON);
+	}
+
+	rwm_v3_batch_cross(a_b, b_b, out_b, n);
+	rwm_v3_batch_to_aos(out_b, out_aos, n);
+	for (int i = 0; i < n; i++) {
+		Vec3 e = rwm_v3_cross(a_aos[i], b_aos[i]);
+		rwm_v3_assert_eq(out_aos[i], e.x, e.y, e.z);
+	}
+
+	rwm_v3_batch_lerp(a_b, 0.25f, b_b, out_b, n);
+	rwm_v3_batch_to_aos(out_b, out_aos, n);
+	for (int i = 0; i < n; i++) {
+		Vec3 e = rwm_v3_lerp(a_aos[i], 0.25f, b_aos[i]);
+		rwm_v3_assert_eq(out_aos[i], e.x, e.y, e.z);
+	}
+
+	// In place
+	rwm_v3_batch_normalize(a_b, a_b, n);
+	rwm_v3_batch_to_aos(a_b, out_aos, n);
+	for (int i = 0; i < n; i++) {
+		Vec3 e = rwm_v3_normalize(a_aos[i]);
+		rwm_v3_assert_eq(out_aos[i], e.x, e.y, e.z);
+	}
+
 	printf(" - PASSED\n");
 }